@@ -0,0 +1,26 @@
+# Branch-heavy code.
+#
+# A condition that ends in a comparison compiles to one fused
+# compare-and-branch instruction (OP_JUMP_IF_NOT_LESS and friends) instead
+# of a comparison, a conditional jump and a pop on each path.
+
+from harness import bench
+
+fib = """
+fn fib(n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+println fib(%d);
+"""
+bench("fib(27), if (n < 2)", fib % 27)
+
+classify = """
+fn classify(i, n, count) {
+    if (i >= n) return count;
+    if (i > 100 and i <= 200 or i == 7) return classify(i + 1, n, count + 1);
+    return classify(i + 1, n, count);
+}
+println classify(0, %d, 0);
+"""
+bench("and/or conditions (%d)" % 500000, classify % 500000)
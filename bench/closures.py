@@ -0,0 +1,55 @@
+# Closure creation and captured-variable access.
+#
+# Each loop iteration calls a function that makes a closure over one of its
+# locals, in the three ways the compiler tells apart: a variable nobody
+# assigns (copied into the closure), an assigned one used only by a local
+# function that is called directly (left on the stack), and an assigned
+# one captured by a closure that is returned (moved into a heap cell).
+
+from harness import bench
+
+N = 1000000
+
+source = """
+%s
+{
+    var sum = 0;
+    for (var i = 0; i < %d; i = i + 1) {
+        sum = sum + run(i);
+    }
+    println sum;
+}
+"""
+
+flat = """
+fn run(n) {
+    var f = fn(x) { return x + n; };
+    return f(1);
+}
+"""
+
+stack = """
+fn run(n) {
+    var total = n;
+    fn add(x) { total = total + x; }
+    add(1);
+    add(2);
+    return total;
+}
+"""
+
+cell = """
+fn make(n) {
+    var total = n;
+    return fn(x) { total = total + x; return total; };
+}
+fn run(n) {
+    var f = make(n);
+    f(1);
+    return f(2);
+}
+"""
+
+bench("flat capture (%d)" % N, source % (flat, N))
+bench("stack capture (%d)" % N, source % (stack, N))
+bench("cell capture (%d)" % N, source % (cell, N))
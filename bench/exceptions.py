@@ -0,0 +1,35 @@
+# try/catch: what a protected loop costs when nothing throws, and the cost
+# of a throw unwinding through a few frames to its handler.
+#
+# Entering a try block executes nothing, so the first two should time the
+# same; only the exception tables searched on a throw cost anything.
+
+from harness import bench
+
+N = 2000000
+
+body = """
+fn step(i) { return i * 2 + 1; }
+var sum = 0;
+for (var i = 0; i < %d; i = i + 1) {
+    %s
+}
+println sum;
+"""
+
+bench("loop without try (%d)" % N, body % (N, "sum = sum + step(i);"))
+bench("loop, body in try (%d)" % N, body % (N, "try { sum = sum + step(i); } catch (e) { sum = 0; }"))
+
+THROWS = 200000
+throwing = """
+fn inner(i) { throw i; }
+fn middle(i) { inner(i); return 0; }
+fn outer(i) { middle(i); return 0; }
+var sum = 0;
+for (var i = 0; i < %d; i = i + 1) {
+    try { outer(i); } catch (e) { sum = sum + e; }
+}
+println sum;
+""" % THROWS
+
+bench("throw through 3 frames (%d)" % THROWS, throwing)
@@ -0,0 +1,22 @@
+# Garbage collector benchmarks: allocation-heavy string workloads.
+#
+# Every concatenation below produces a new, distinct string, so most of the
+# heap dies young. Run with `--gc-stats` to see the minor/major split.
+
+from harness import bench
+
+# a binary tree of concatenations: 2^depth distinct short-lived strings
+DEPTH = 18
+tree = """
+fn build(d, s) {
+    if (d < 1) return s;
+    build(d - 1, s + "a");
+    return build(d - 1, s + "b");
+}
+println build(%d, "");
+""" % DEPTH
+bench("short-lived strings (2^%d leaves)" % DEPTH, tree)
+
+# the same churn with a few long-lived globals the nursery must not free
+held = "".join('var keep%d = "k%d" + "%s";\n' % (i, i, "x" * 32) for i in range(1000))
+bench("short-lived + 1000 long-lived", held + tree)
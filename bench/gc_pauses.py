@@ -0,0 +1,43 @@
+# GC pause-time distribution: stop-the-world vs incremental major collections.
+#
+# A large long-lived heap (tens of thousands of globals) plus steady string
+# churn, so major collections happen while the program runs. Each
+# configuration reports the pause percentiles printed by `--gc-stats`.
+
+import os
+import re
+import subprocess
+
+from harness import MAVIX, write_source
+
+GLOBALS = 40000
+DEPTH = 19
+
+source = "".join('var keep%d = "k%d" + "%s";\n' % (i, i, "x" * 240) for i in range(GLOBALS))
+source += """
+fn build(d, s) {
+    if (d < 1) return s;
+    build(d - 1, s + "a");
+    return build(d - 1, s + "b");
+}
+println build(%d, "");
+""" % DEPTH
+
+PAUSES = re.compile(r"gc: (\d+) pauses .*p50 ([\d.]+) us, p90 ([\d.]+) us, "
+                    r"p99 ([\d.]+) us, max ([\d.]+) us")
+
+path = write_source(source)
+try:
+    print("%-24s %7s %10s %10s %10s %10s" % ("mode", "pauses", "p50 us", "p90 us", "p99 us", "max us"))
+    for label, args in [("stop-the-world", ()),
+                        ("--gc-max-pause-us 1000", ("--gc-max-pause-us", "1000")),
+                        ("--gc-max-pause-us 200", ("--gc-max-pause-us", "200")),
+                        ("--gc-max-pause-us 50", ("--gc-max-pause-us", "50"))]:
+        proc = subprocess.run([MAVIX, "--gc-stats", *args, path], capture_output=True, text=True)
+        match = PAUSES.search(proc.stderr)
+        if proc.returncode != 0 or match is None:
+            raise SystemExit("%s failed (%d):\n%s" % (label, proc.returncode, proc.stderr))
+        count, *times = match.groups()
+        print("%-24s %7s %10s %10s %10s %10s" % (label, count, *times))
+finally:
+    os.remove(path)
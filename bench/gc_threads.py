@@ -0,0 +1,54 @@
+# Parallel marking: time spent marking with 1 to 16 marking threads.
+#
+# A large long-lived heap (tens of thousands of globals) plus string churn,
+# with stop-the-world collections. Reports the marking time printed by
+# `--gc-stats` and the speedup over a single thread. Speedups are capped by
+# the number of cores on the machine running it.
+
+import os
+import re
+import subprocess
+
+from harness import MAVIX, write_source
+
+GLOBALS = 40000
+DEPTH = 19
+RUNS = 3
+
+source = "".join('var keep%d = "k%d" + "%s";\n' % (i, i, "x" * 240) for i in range(GLOBALS))
+source += """
+fn build(d, s) {
+    if (d < 1) return s;
+    build(d - 1, s + "a");
+    return build(d - 1, s + "b");
+}
+println build(%d, "");
+""" % DEPTH
+
+MARKING = re.compile(r"gc: ([\d.]+) ms marking")
+
+
+def marking_ms(path, threads):
+    best = None
+    for _ in range(RUNS):
+        proc = subprocess.run([MAVIX, "--gc-stats", "--gc-threads", str(threads), path],
+                              capture_output=True, text=True)
+        match = MARKING.search(proc.stderr)
+        if proc.returncode != 0 or match is None:
+            raise SystemExit("--gc-threads %d failed (%d):\n%s" % (threads, proc.returncode, proc.stderr))
+        ms = float(match.group(1))
+        best = ms if best is None else min(best, ms)
+    return best
+
+
+path = write_source(source)
+try:
+    print("%d cores available" % os.cpu_count())
+    print("%-10s %12s %8s" % ("threads", "marking ms", "speedup"))
+    base = None
+    for threads in (1, 2, 4, 8, 16):
+        ms = marking_ms(path, threads)
+        base = ms if base is None else base
+        print("%-10d %12.2f %7.2fx" % (threads, ms, base / ms))
+finally:
+    os.remove(path)
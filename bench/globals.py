@@ -0,0 +1,17 @@
+# Global variable lookup throughput against table size.
+#
+# Each script defines N globals and then performs the same number of reads,
+# spread evenly over all N names, so the only thing that changes between
+# runs is how big (and how full) vm.globals is.
+
+from harness import bench
+
+READS = 200000
+PER_STATEMENT = 50
+
+for n in (16, 256, 4096, 65536):
+    lines = ["var g%d = %d;" % (i, i) for i in range(n)]
+    names = ["g%d" % ((i * 7919) % n) for i in range(READS)]
+    for i in range(0, READS, PER_STATEMENT):
+        lines.append(" + ".join(names[i:i + PER_STATEMENT]) + ";")
+    bench("%6d globals, %d reads" % (n, READS), "\n".join(lines) + "\n")
@@ -0,0 +1,45 @@
+# Shared helpers for the benchmark scripts in this directory.
+#
+# Each benchmark generates a Mavix source file, runs the interpreter on it a
+# few times and reports the best wall-clock time. Build first with `make`.
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+MAVIX = os.environ.get("MAVIX", os.path.join(ROOT, "mavix"))
+
+
+def write_source(text):
+    fd, path = tempfile.mkstemp(suffix=".mav")
+    with os.fdopen(fd, "w") as f:
+        f.write(text)
+    return path
+
+
+def run(path, args=(), runs=5):
+    """Run mavix on `path` `runs` times; return (best seconds, last stdout)."""
+    best = None
+    out = ""
+    for _ in range(runs):
+        start = time.perf_counter()
+        proc = subprocess.run([MAVIX, *args, path], capture_output=True, text=True)
+        elapsed = time.perf_counter() - start
+        if proc.returncode != 0:
+            sys.exit("%s failed (%d):\n%s" % (path, proc.returncode, proc.stderr))
+        out = proc.stdout
+        best = elapsed if best is None else min(best, elapsed)
+    return best, out
+
+
+def bench(label, text, args=(), runs=5):
+    path = write_source(text)
+    try:
+        best, out = run(path, args, runs)
+    finally:
+        os.remove(path)
+    print("%-40s %8.2f ms" % (label, best * 1000))
+    return best, out
@@ -0,0 +1,39 @@
+# Hot loops.
+#
+# A loop whose backward jump has been taken HOT_LOOP_THRESHOLD times has
+# its body rewritten in place with superinstructions, while it runs. The
+# scripts are one long top-level loop each: tiering up only when a
+# function is called would never reach them.
+
+from harness import bench
+
+N = 5000000
+
+arithmetic = """
+{
+    var n = %d;
+    var sum = 0;
+    var odd = 0;
+    var i = 0;
+    while (i < n) {
+        sum = sum + i * 3;
+        odd = odd + i - sum;
+        i = i + 1;
+    }
+    println sum;
+    println odd;
+}
+"""
+bench("top-level while, locals (%d)" % N, arithmetic % N)
+
+globals = """
+var n = %d;
+var sum = 0;
+var i = 0;
+while (i < n) {
+    sum = sum + i;
+    i = i + 1;
+}
+println sum;
+"""
+bench("top-level while, globals (%d)" % N, globals % N)
@@ -0,0 +1,24 @@
+# Calls of small functions, which the compiler copies into the caller.
+#
+# The same loop calls a pair of one-line helpers, once as written (inlined)
+# and once with each helper marked `// @noinline`, which makes every call a
+# real one: a frame pushed, the arguments windowed and a return.
+
+from harness import bench
+
+N = 2000000
+
+source = """
+%sfn square(x) { return x * x; }
+%sfn add(a, b) { return a + b; }
+{
+    var sum = 0;
+    for (var i = 0; i < %d; i = i + 1) {
+        sum = add(sum, square(i));
+    }
+    println sum;
+}
+"""
+
+bench("inlined calls (%d)" % N, source % ("", "", N))
+bench("real calls (%d)" % N, source % ("// @noinline\n", "// @noinline\n", N))
@@ -0,0 +1,28 @@
+# Integer-heavy code.
+#
+# Literals without a '.' are ints, and +, -, * on two ints stay in int64
+# (with an overflow check) instead of going through doubles.
+
+from harness import bench
+
+N = 1000000
+
+count = """
+fn count(i, n, sum) {
+    if (i < n) return count(i + 1, n, sum + i * 3 - 1);
+    return sum;
+}
+println count(0, %d, 0);
+"""
+bench("counting loop, ints (%d)" % N, count % N)
+bench("counting loop, doubles (%d)" % N, count.replace("0, %d, 0", "0.0, %d.0, 0.0") % N)
+
+# sums past 2^53 are still exact
+big = """
+fn sum(i, n, total) {
+    if (i < n) return sum(i + 1, n, total + 9007199254740993);
+    return total;
+}
+println sum(0, %d, 0);
+"""
+bench("sums beyond 2^53 (%d)" % N, big % N)
@@ -0,0 +1,27 @@
+# Arithmetic the optimizing pass can take out of a loop or compute once.
+#
+# The loop body recomputes an expression of values fixed before the loop,
+# repeats a subexpression and branches on a constant; it runs unoptimized
+# (-O0, the default), with constants propagated (-O1) and with invariant
+# code hoisted and repeats reused as well (-O2).
+
+from harness import bench
+
+N = 3000000
+
+source = """
+fn run(n, x) {
+    var scale = x * 1.5;
+    var debug = 2 * 3 > 7;
+    var sum = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        if (debug) println i;
+        sum = sum + scale * scale + (i + 1) * (i + 1) + (60 * 60 * 24);
+    }
+    return sum;
+}
+println run(%d, 2);
+"""
+
+for level in (0, 1, 2):
+    bench("-O%d (%d)" % (level, N), source % N, args=("-O%d" % level,))
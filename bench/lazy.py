@@ -0,0 +1,28 @@
+# Startup of a script that declares many functions and calls a few.
+#
+# Every body is long enough to be compiled lazily, on its first call; with
+# --strict all of them are compiled up front, as before.
+
+from harness import bench
+
+FUNCTIONS = 5000
+CALLED = 10
+
+body = """
+fn f%d(a, b) {
+    var x = a * 2 + b;
+    var y = x - a / 3;
+    for (var i = 0; i < 3; i = i + 1) {
+        if (x > y) x = x - 1; else y = y + 1;
+    }
+    return x + y + %d;
+}
+"""
+
+source = "".join(body % (i, i) for i in range(FUNCTIONS))
+source += "var sum = 0;\n"
+source += "".join("sum = sum + f%d(1, 2);\n" % (i * (FUNCTIONS // CALLED)) for i in range(CALLED))
+source += "println sum;\n"
+
+bench("lazy bodies (%d declared, %d called)" % (FUNCTIONS, CALLED), source)
+bench("--strict (%d declared, %d called)" % (FUNCTIONS, CALLED), source, args=("--strict",))
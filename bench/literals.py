@@ -0,0 +1,21 @@
+# Compiling sources dominated by number literals.
+#
+# The scanner computes each literal's value as it reads the digits (see
+# decimalToDouble() in number.c) instead of the compiler re-parsing the
+# text with strtod().
+
+import random
+
+from harness import bench
+
+N = 40000
+random.seed(1)
+
+ints = " + ".join(str(random.randrange(1000000)) for _ in range(N))
+bench("integer literals (%d)" % N, "println %s;\n" % ints)
+
+decimals = " + ".join("%d.%03d" % (random.randrange(1000), random.randrange(1000)) for _ in range(N))
+bench("short decimals (%d)" % N, "println %s;\n" % decimals)
+
+precise = " + ".join(repr(random.random() * 1000) for _ in range(N))
+bench("17-digit decimals (%d)" % N, "println %s;\n" % precise)
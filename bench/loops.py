@@ -0,0 +1,44 @@
+# Loops.
+#
+# `for (var i = a; i < limit; i = i + 1)` with a local or constant limit
+# ends in one OP_FOR_INCR_LT per iteration; the same loop written with a
+# while, or with a global limit, runs the generic increment, compare and
+# jump instructions.
+
+from harness import bench
+
+N = 5000000
+
+counted = """
+{
+    var n = %d;
+    var sum = 0;
+    for (var i = 0; i < n; i = i + 1) sum = sum + i;
+    println sum;
+}
+"""
+bench("counted for, local limit (%d)" % N, counted % N)
+
+generic = """
+var n = %d;
+{
+    var sum = 0;
+    for (var i = 0; i < n; i = i + 1) sum = sum + i;
+    println sum;
+}
+"""
+bench("for with a global limit (%d)" % N, generic % N)
+
+loop = """
+{
+    var n = %d;
+    var sum = 0;
+    var i = 0;
+    while (i < n) {
+        sum = sum + i;
+        i = i + 1;
+    }
+    println sum;
+}
+"""
+bench("equivalent while loop (%d)" % N, loop % N)
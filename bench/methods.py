@@ -0,0 +1,33 @@
+# Method calls through OP_INVOKE.
+#
+# A counter object has small methods that are called in a tight loop: an
+# own method, one inherited from the superclass, and one that calls up to
+# the superclass through `super`. Each call looks the method up in the
+# site's cache and calls it in place, with no bound method in between.
+
+from harness import bench
+
+N = 1000000
+
+source = """
+class Base {
+    init() { this.count = 0; }
+    step(d) { this.count = this.count + d; return this; }
+    value() { return this.count; }
+}
+class Counter < Base {
+    bump() { return this.step(1); }
+    step(d) { return super.step(d * 2); }
+}
+{
+    var c = Counter();
+    for (var i = 0; i < %d; i = i + 1) {
+        %s
+    }
+    println c.value();
+}
+"""
+
+bench("own method (%d)" % N, source % (N, "c.bump();"))
+bench("inherited method (%d)" % N, source % (N, "c.value();"))
+bench("super call (%d)" % N, source % (N, "c.step(1);"))
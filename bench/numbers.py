@@ -0,0 +1,20 @@
+# Number formatting throughput.
+#
+# Whole numbers take the integer fast path; fractions go through Grisu2
+# (see number.c) instead of printf's "%g".
+
+from harness import bench
+
+N = 200000
+
+emit = """
+fn emit(n) {
+    if (n < 1) return n;
+    println %s;
+    return emit(n - 1);
+}
+emit(%d);
+"""
+bench("print integers (%d)" % N, emit % ("n * 3", N))
+bench("print fractions (%d)" % N, emit % ("n / 7", N))
+bench("print large numbers (%d)" % N, emit % ("n * 1234567.891 * 1000000000000000000", N))
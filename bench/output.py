@@ -0,0 +1,58 @@
+# Output-heavy scripts.
+#
+# `println` appends to the VM's output buffer, which reaches stdout in
+# 64 KiB blocks. Through a pipe stdio buffered too, so the gain shows on a
+# terminal, where stdio used to write every line separately.
+
+import os
+import pty
+import subprocess
+import threading
+import time
+
+from harness import MAVIX, bench, write_source
+
+N = 200000
+
+lines = """
+fn emit(n) {
+    if (n < 1) return n;
+    println n;
+    println "a line of text";
+    return emit(n - 1);
+}
+emit(%d);
+"""
+
+
+def bench_tty(label, text, runs=5):
+    """Like bench(), but with stdout connected to a pseudo-terminal."""
+    path = write_source(text)
+    best = None
+    try:
+        for _ in range(runs):
+            master, slave = pty.openpty()
+            drain = threading.Thread(target=lambda: drain_pty(master))
+            drain.start()
+            start = time.perf_counter()
+            subprocess.run([MAVIX, path], stdout=slave, check=True)
+            elapsed = time.perf_counter() - start
+            os.close(slave)
+            drain.join()
+            os.close(master)
+            best = elapsed if best is None else min(best, elapsed)
+    finally:
+        os.remove(path)
+    print("%-40s %8.2f ms" % (label, best * 1000))
+
+
+def drain_pty(master):
+    try:
+        while os.read(master, 65536):
+            pass
+    except OSError:
+        pass        # EIO once the other side is closed
+
+
+bench("println to a pipe (%d lines)" % (2 * N), lines % N)
+bench_tty("println to a terminal (%d lines)" % (2 * N), lines % N)
@@ -0,0 +1,43 @@
+# Property access through inline caches.
+#
+# The loop cycles through eight instances, reading and writing their fields
+# at the same sites. The instances have 1, 2, 4 or 8 distinct shapes (the
+# same fields, added in different orders). Up to INLINE_CACHE_WAYS shapes
+# every access is a cache hit; beyond that the sites are megamorphic and
+# look fields up along the shape chain.
+
+from harness import bench
+
+N = 1000000
+OBJECTS = 8
+FIELDS = ["x", "y", "z", "a", "b", "c", "d", "e"]
+
+source = """
+class P {}
+{
+%s
+    var n = %d;
+    var sum = 0;
+    var k = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        var o = o0;
+%s
+        o.x = o.x + 1;
+        sum = sum + o.y + o.z;
+        k = k + 1;
+        if (k == %d) k = 0;
+    }
+    println sum;
+}
+"""
+
+for shapes in (1, 2, 4, 8):
+    setup = []
+    for s in range(OBJECTS):
+        shift = s % shapes
+        order = FIELDS[shift:] + FIELDS[:shift]
+        setup.append("    var o%d = P();" % s)
+        setup += ["    o%d.%s = %d;" % (s, f, k) for k, f in enumerate(order)]
+    select = "\n".join("        if (k == %d) o = o%d;" % (s, s) for s in range(1, OBJECTS))
+    text = source % ("\n".join(setup), N, select, OBJECTS)
+    bench("%d shape(s) per site (%d)" % (shapes, N), text)
@@ -0,0 +1,22 @@
+# Recursion depth probe (the Mavix counterpart of tests/recursion_limit.py).
+#
+# Non-tail recursion to increasing depths, then unbounded recursion to find
+# where the guard page stops it. The limit is set by the address space
+# reserved for the call stack, not by a fixed slot count.
+
+import re
+import subprocess
+
+from harness import MAVIX, bench, write_source
+
+DOWN = "fn down(n) { if (n == 0) return 0; return 1 + down(n - 1); }\n"
+
+for depth in (1000, 100000, 1000000, 5000000):
+    bench("recursion depth %d" % depth, DOWN + "println down(%d);\n" % depth, runs=3)
+
+# not a tail call, which would reuse the frame and never overflow
+path = write_source("fn forever(n) { return 1 + forever(n + 1); }\nforever(0);\n")
+proc = subprocess.run([MAVIX, path], capture_output=True, text=True)
+more = re.search(r"\.\.\. (\d+) more calls", proc.stderr)
+print("unbounded recursion: %s after %s frames" % (
+    proc.stderr.splitlines()[0], int(more.group(1)) + 17 if more else "?"))
@@ -0,0 +1,36 @@
+# String benchmarks: equality-heavy and string-constant-heavy scripts.
+#
+# Strings are interned, so `==` on two strings is a pointer comparison and
+# repeated literals share a single ObjString.
+
+from harness import bench
+
+N = 20000
+
+# the same handful of tags compared over and over
+tags = ["alpha", "beta", "gamma", "delta"]
+terms = ['("%s" == "%s")' % (tags[i % 4], tags[(i * 7) % 4]) for i in range(N)]
+bench("equality-heavy (%d comparisons)" % N, " == ".join(terms) + ";\n")
+
+# thousands of distinct literals -> exercises interning and long constants
+terms = ['("key%d" == "key%d")' % (i, i + 1) for i in range(N)]
+bench("constant-heavy (%d distinct literals)" % (N + 1), " == ".join(terms) + ";\n")
+
+# the same long literal repeated -> one allocation, many table hits
+lit = '"%s"' % ("x" * 64)
+terms = ["(%s == %s)" % (lit, lit) for _ in range(N)]
+bench("repeated long literal (%d uses)" % (2 * N), " == ".join(terms) + ";\n")
+
+# strings built at run time: up to 7 chars stay inline in the Value, longer
+# ones are heap strings (allocated, then found in the intern table)
+M = 200000
+spin = """
+fn spin(n, a, b) {
+    if (n < 1) return a + b;
+    var s = a + b;
+    return spin(n - 1, a, b);
+}
+println spin(%d, "%s", "%s");
+"""
+bench("short concatenations (%d, inline)" % M, spin % (M, "tag", "s"))
+bench("long concatenations (%d, heap)" % M, spin % (M, "tagname", "s"))
@@ -0,0 +1,22 @@
+# Tail-recursive loops.
+#
+# `return f(...)` compiles to OP_TAIL_CALL, which reuses the caller's frame,
+# so a 10M-iteration tail-recursive loop runs in constant stack. The
+# non-tail version of the same count needs one frame per iteration.
+
+from harness import bench
+
+N = 10000000
+
+bench("tail-recursive loop, %d iterations" % N,
+      "fn loop(n, acc) { if (n == 0) return acc; return loop(n - 1, acc + 1); }\n"
+      "println loop(%d, 0);\n" % N, runs=3)
+
+bench("mutual tail recursion, %d calls" % N,
+      "fn even(n) { if (n == 0) return true; return odd(n - 1); }\n"
+      "fn odd(n) { if (n == 0) return false; return even(n - 1); }\n"
+      "println even(%d);\n" % N, runs=3)
+
+bench("non-tail recursion, %d deep" % N,
+      "fn count(n) { if (n == 0) return 0; return 1 + count(n - 1); }\n"
+      "println count(%d);\n" % N, runs=3)
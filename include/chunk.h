@@ -12,6 +12,27 @@ typedef enum {
     OP_NULL,
     OP_TRUE,
     OP_FALSE,
+    OP_POP,
+    OP_GET_LOCAL,
+    OP_GET_LOCAL_LONG,
+    OP_SET_LOCAL,
+    OP_SET_LOCAL_LONG,
+    OP_GET_GLOBAL,
+    OP_GET_GLOBAL_LONG,
+    OP_DEFINE_GLOBAL,
+    OP_DEFINE_GLOBAL_LONG,
+    OP_SET_GLOBAL,
+    OP_SET_GLOBAL_LONG,
+    // a variable captured by the running closure -> index of the capture
+    OP_GET_UPVALUE,
+    OP_SET_UPVALUE,
+    // a parameter of an inlined function -> its distance from the stack top
+    OP_GET_ARGUMENT,
+    OP_SET_ARGUMENT,
+    // property access through the inline cache named by a 16-bit operand
+    OP_GET_PROPERTY,
+    OP_SET_PROPERTY,
+    OP_GET_SUPER,
     OP_EQUAL,
     OP_GREATER,
     OP_LESS,
@@ -21,16 +42,144 @@ typedef enum {
     OP_DIVIDE,
     OP_NOT,
     OP_NEGATE,
+    OP_PRINT,
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,
+    // a comparison fused with the branch on its result: pop both operands
+    // and jump if the comparison comes out as named (see conditionJump())
+    OP_JUMP_IF_LESS,
+    OP_JUMP_IF_NOT_LESS,
+    OP_JUMP_IF_GREATER,
+    OP_JUMP_IF_NOT_GREATER,
+    OP_JUMP_IF_EQUAL,
+    OP_JUMP_IF_NOT_EQUAL,
+    // backward jumps carry a loop number, which indexes the function's
+    // hotness counters (see countBackedge() in vm.c)
+    OP_LOOP,
+    // `i = i + 1; if (i < limit) loop` for a counted for loop, with the
+    // limit in a local slot or in the constant table
+    OP_FOR_INCR_LT,
+    OP_FOR_INCR_LT_CONST,
+    OP_CALL,
+    OP_TAIL_CALL,
+    // `receiver.name(args)` and `super.name(args)` in one instruction, without
+    // a bound method in between -> cache index (16 bits), argument count
+    OP_INVOKE,
+    OP_SUPER_INVOKE,
+    // a call whose callee's body was copied in (see inlineCall() in the
+    // compiler) -> argument count, the expected callee (24-bit constant) and
+    // a 16-bit offset past the inlined body, taken after calling any other
+    // callee the usual way
+    OP_INLINE_GUARD,
+    // end of an inlined body: drop the callee and its arguments from under
+    // the result -> argument count
+    OP_INLINE_RETURN,
+    // wrap a function constant in a closure; each capture follows as a
+    // CaptureKind byte and a 16-bit slot or capture index
+    OP_CLOSURE,
+    OP_CLOSURE_LONG,
+    // pop a local that a cell captured, moving its value into the cell
+    OP_CLOSE_UPVALUE,
     OP_RETURN,
+    OP_CLASS,
+    OP_CLASS_LONG,
+    OP_METHOD,
+    OP_METHOD_LONG,
+    OP_INHERIT,
+    // raise the value on top of the stack (see catchException() in vm.c)
+    OP_THROW,
+
+    // superinstructions the optimizer writes over hot loops, in place of
+    // the sequence named (see optimizer.c); never emitted by the compiler
+    OP_LOCALS_BINARY,           // GET_LOCAL a; GET_LOCAL b; <op>
+    OP_LOCAL_CONSTANT_BINARY,   // GET_LOCAL a; CONSTANT k; <op>
+    OP_SET_LOCAL_POP,           // SET_LOCAL x; POP
+    OP_SET_GLOBAL_POP,          // SET_GLOBAL x; POP
 } OpCode;
 
 
+// how OP_CLOSURE captures a variable (see Capture in object.h)
+typedef enum {
+    CAPTURE_LOCAL,      // a local of the creating function, kind not decided yet (compiler only)
+    CAPTURE_FLAT,       // a local, copied
+    CAPTURE_STACK,      // a local, by its stack slot
+    CAPTURE_CELL,       // a local, through an ObjUpvalue
+    CAPTURE_UPVALUE,    // one of the creating closure's own captures, shared as is
+} CaptureKind;
+
+
 // struct to store line info (run-length encoding)
 typedef struct {
     int lineNumber;     // the actual line number
     int count;          // number of instructions in this line
 } LineEntry;
 
+struct ObjShape;
+struct ObjFunction;
+
+// shapes an inline cache remembers; a site that sees more is megamorphic
+// and takes the slow path for the shapes that didn't fit
+#define INLINE_CACHE_WAYS 4
+
+typedef struct {
+    struct ObjShape* shape;         // the receiver shape this entry is for
+    struct ObjShape* transition;    // a store that adds the field: the shape after it
+    Obj* method;                    // an invoke on a shape without the field: what it calls
+    int slot;                       // where the field is, -1 if the shape has none
+} CacheEntry;
+
+/**
+ * What a property instruction learned about the shapes it has seen.
+ *
+ * Each OP_GET_PROPERTY / OP_SET_PROPERTY / OP_INVOKE / OP_SUPER_INVOKE
+ * owns one. A hit turns the access into a pointer compare and an indexed
+ * load or store, or a direct call of the cached method; a miss looks the
+ * name up along the shape chain (and in the class) and records the result.
+ * A class's methods can't change once its declaration has run, and each
+ * shape belongs to one class, so the shape alone decides the method. Entries hold
+ * their shapes strongly (see visitReferences()), so a cached shape can
+ * never be freed and its address reused for a different layout.
+ */
+typedef struct {
+    ObjString* name;
+    int count;                      // entries in use
+    CacheEntry entries[INLINE_CACHE_WAYS];
+} InlineCache;
+
+
+/**
+ * A function body the compiler copied into this chunk, in place of a call.
+ *
+ * Lets a stack trace show the call that isn't there: an instruction in
+ * [start, end) reports its own line as being in `function`, and `line`
+ * for the call. The function is also a constant of the chunk (its
+ * OP_INLINE_GUARD compares against it), which keeps it alive.
+ */
+typedef struct {
+    int start;
+    int end;
+    struct ObjFunction* function;
+    int line;               // of the call
+} InlinedCall;
+
+
+/**
+ * A `try` block of this chunk and the `catch` block its exceptions go to.
+ *
+ * Entering the block executes nothing: only once something throws does
+ * the VM look the throwing instruction up here, the way getLine() looks
+ * up its line. An instruction in [start, end) that throws resumes at
+ * `handler`, with the frame's stack cut back to `height` slots and the
+ * exception pushed on top.
+ */
+typedef struct {
+    int start;
+    int end;
+    int handler;
+    int height;             // locals of the frame in scope at the `try`
+} ExceptionHandler;
+
+
 typedef struct {
     int count;              // number of elements in the array
     int capacity;           // size of the array
@@ -39,6 +188,15 @@ typedef struct {
     int lineCount;          // number of used entries in lines
     int lineCapacity;       // capacity of lines array
     ValueArray constants;   // array of constants
+    InlineCache* caches;    // one per property access or invoke
+    int cacheCount;
+    int cacheCapacity;
+    InlinedCall* inlined;   // innermost first where they nest
+    int inlinedCount;
+    int inlinedCapacity;
+    ExceptionHandler* handlers; // innermost first where they nest
+    int handlerCount;
+    int handlerCapacity;
 } Chunk;
 
 
@@ -48,5 +206,10 @@ void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 void writeConstant(Chunk* chunk, Value value, int line);
+void truncateChunk(Chunk* chunk, int count);
 int addConstant(Chunk* chunk, Value value);
+int addInlineCache(Chunk* chunk, ObjString* name);
+void addInlinedCall(Chunk* chunk, int start, int end, struct ObjFunction* function, int line);
+void addExceptionHandler(Chunk* chunk, int start, int end, int handler, int height);
 int getLine(Chunk* chunk, int index);
+int instructionLength(Chunk* chunk, int offset);
@@ -4,5 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
\ No newline at end of file
+#define UINT8_COUNT (UINT8_MAX + 1)
+
+// DEBUG_PRINT_CODE and DEBUG_TRACE_EXECUTION are switched on by `make debug`
+// DEBUG_STRESS_GC runs a collection on every allocation (pass -DDEBUG_STRESS_GC)
@@ -2,5 +2,10 @@
 
 #include "vm.h"
 
-bool compile(const char* source, Chunk* chunk);
+#include "object.h"
+
+ObjFunction* compile(const char* source);
+bool compileLazy(ObjFunction* function);
+void markCompilerRoots();
+void freeCompiler();
 
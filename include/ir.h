@@ -0,0 +1,34 @@
+#pragma once
+#include "common.h"
+#include "object.h"
+
+// the compiler's optional optimizing pass (-O1, -O2)
+
+// the highest level optimizeFunction() takes
+#define OPTIMIZE_MAX 2
+
+/**
+ * Optimizes a function the compiler has just finished.
+ *
+ * The compiler emits bytecode as it parses and keeps no tree, so the pass
+ * works from that bytecode: it splits it into basic blocks and runs the
+ * stack and the local slots symbolically, which turns every value an
+ * instruction computes into a node of an SSA graph, with phis where
+ * control flow merges.
+ *
+ * Level 1 propagates constants through the graph sparsely and
+ * conditionally: constant expressions fold to one instruction, branches
+ * whose condition is settled become jumps (or nothing) and the blocks
+ * nothing reaches are dropped, along with values computed only to be
+ * popped and stores to locals nobody reads again. Level 2 also hoists
+ * invariant arithmetic out of loops and computes a repeated expression
+ * once, keeping it in a temporary slot the function reserves on entry.
+ *
+ * What the graph learns goes back into the chunk as edits to its code;
+ * jumps, the line table and inlined-call ranges are moved to match. A
+ * function using something the pass doesn't model is left as it is.
+ *
+ * @param function The function, with its code complete.
+ * @param level 1 or 2.
+ */
+void optimizeFunction(ObjFunction* function, int level);
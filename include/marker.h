@@ -0,0 +1,30 @@
+#pragma once
+#include "common.h"
+#include "object.h"
+
+// parallel marking for stop-the-world collections
+
+// most marking threads `--gc-threads` accepts
+#define MARK_THREADS_MAX 64
+
+/**
+ * Traces everything reachable from `grays` using `threads` threads.
+ *
+ * The gray objects must already be marked. They are dealt out to the
+ * threads' work-stealing deques; each thread then marks what it reaches
+ * (mark bits are set atomically, so every object is traced once) and
+ * steals from the others when it runs dry. Returns once every thread has
+ * run out of work. The calling thread takes part as marker 0; the others
+ * are started on first use and kept parked between collections.
+ *
+ * @param grays The marked objects whose references haven't been traced.
+ * @param count How many there are.
+ * @param threads Number of marking threads, the caller included.
+ * @param minor Whether old objects are to be left alone (minor collection).
+ */
+void markParallel(Obj** grays, int count, int threads, bool minor);
+
+/**
+ * Stops and joins the marking threads, if any were started.
+ */
+void stopMarkers();
@@ -1,8 +1,27 @@
 #pragma once
 #include "common.h"
+#include "object.h"
 
 // Memory management functions and macros
 
+/**
+ * Macro to allocate a new array of `count` elements of the given `type`.
+ *
+ * @param type The data type of the elements.
+ * @param count The number of elements to allocate.
+ * @return A pointer to the newly allocated block.
+ */
+#define ALLOCATE(type, count) \
+    (type*) reallocate(NULL, 0, sizeof(type) * (count))
+
+/**
+ * Macro to free a single object of the given `type`.
+ *
+ * @param type The data type of the object.
+ * @param pointer A pointer to the object to be freed.
+ */
+#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
+
 /**
  * Macro to calculate the new capacity for a dynamic array.
  * 
@@ -66,3 +85,198 @@
  */
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
 
+// collector statistics, printed by `--gc-stats`
+typedef struct {
+    int minorCollections;
+    int majorCollections;
+    double minorPauseTotal;     // seconds
+    double majorPauseTotal;
+    double maxPause;
+    size_t bytesFreed;
+    size_t objectsPromoted;
+    size_t peakBytes;
+    double markTotal;           // time spent marking (roots and tracing)
+
+    // every individual pause, for the distribution (incremental mode)
+    double* pauses;
+    int pauseCount;
+    int pauseCapacity;
+    int incrementalCycles;
+} GCStats;
+
+
+// where the collector is in an incremental major cycle
+typedef enum {
+    GC_IDLE,            // not collecting; minor/major collections run atomically
+    GC_MARKING,         // tracing the gray worklist a slice at a time
+    GC_SWEEPING,        // freeing the white old objects a slice at a time
+} GCPhase;
+
+
+/**
+ * State of the generational collector.
+ *
+ * Objects don't move (C code all over the VM holds raw Obj pointers), so the
+ * nursery is a byte budget plus a list of young objects rather than a bump
+ * region: a minor collection runs whenever `nurserySize` bytes have been
+ * allocated since the last one. It traces only young objects, starting from
+ * the roots and the remembered set, and promotes survivors once they reach
+ * `promotionAge`. A major collection traces everything and runs when the
+ * heap outgrows `nextGC`.
+ *
+ * With `maxPause` set (`--gc-max-pause-us`) a major collection is
+ * incremental instead: marking and sweeping are split into slices of at
+ * most `maxPause` seconds, run each time another `stepSize` bytes have been
+ * allocated. The mutator keeps running between slices, so stores of
+ * references go through `writeBarrier()` / `globalsBarrier()`. Minor
+ * collections are held off while marking and resume while sweeping.
+ */
+typedef struct {
+    size_t nurserySize;
+    size_t nurseryAllocated;    // bytes allocated since the last minor collection
+    size_t nextGC;              // heap size that triggers a major collection
+    int promotionAge;
+
+    bool minor;                 // the collection in progress is a minor one
+
+    // incremental major collections
+    double maxPause;            // seconds per slice; 0 = stop-the-world
+    size_t stepSize;            // bytes allocated between slices
+    size_t stepAllocated;       // bytes allocated since the last slice
+    GCPhase phase;
+    int markThreads;            // threads tracing stop-the-world phases
+    int globalsCursor;          // next globals entry to mark this cycle
+    int globalsCapacity;        // globals capacity when the scan (re)started
+    Obj* sweeping;              // old objects not yet swept this cycle
+
+    // young objects stored into the globals table (see globalsBarrier())
+    Value* youngGlobals;
+    int youngGlobalCount;
+    int youngGlobalCapacity;
+
+    // old objects that may point at young ones (our stand-in for card
+    // marking: one "card" per object, set by writeBarrier())
+    Obj** remembered;
+    int rememberedCount;
+    int rememberedCapacity;
+
+    // marked objects whose references haven't been traced yet
+    Obj** grayStack;
+    int grayCount;
+    int grayCapacity;
+
+    GCStats stats;
+} GC;
+
+
+/**
+ * Reserves a large region of address space followed by a guard page.
+ *
+ * The region is mapped with MAP_NORESERVE, so nothing is committed up front:
+ * the kernel backs each page the first time it is touched. The page right
+ * after the region is mapped PROT_NONE, so running off the end faults
+ * instead of corrupting memory.
+ *
+ * If the full size cannot be reserved, the request is halved until it can.
+ *
+ * @param size In: the desired size in bytes. Out: the size actually reserved.
+ * @return The base of the usable region, or NULL if nothing could be mapped.
+ */
+void* reserveGuarded(size_t* size);
+
+/**
+ * Releases a region obtained from `reserveGuarded()`, guard page included.
+ *
+ * @param base The base returned by `reserveGuarded()`.
+ * @param size The size it reported.
+ */
+void releaseGuarded(void* base, size_t size);
+
+/**
+ * Runs a collection. Minor unless the heap has outgrown `nextGC`.
+ *
+ * Normally triggered from `reallocate()` when the nursery fills.
+ */
+void collectGarbage();
+
+/**
+ * Runs a full (major) collection regardless of the heap size.
+ *
+ * Finishes an incremental cycle in progress first.
+ */
+void collectGarbageFull();
+
+// marking entry points for roots that live outside the VM (the compiler)
+void markObject(Obj* object);
+void markValue(Value value);
+
+// callback used to walk the references held by an object
+typedef void (*ObjVisitor)(Obj* object, void* context);
+
+/**
+ * Calls `visit` for every object directly referenced by `object`.
+ */
+void visitReferences(Obj* object, ObjVisitor visit, void* context);
+
+/**
+ * Records `owner` in the remembered set. Use `writeBarrier()` instead.
+ */
+void rememberObject(Obj* owner);
+
+/**
+ * Shades `value` gray if an incremental mark is in progress.
+ *
+ * The slow path of `writeBarrier()` and `globalsBarrier()`.
+ */
+void markBarrier(Value value);
+
+/**
+ * Barrier for stores into the globals table -> call with the key and value.
+ *
+ * The globals table is a root rather than an object. Minor collections
+ * don't scan it; young objects stored into it are recorded here instead.
+ * An incremental mark scans it only once, so later stores are shaded too.
+ */
+void globalsBarrier(Value value);
+
+/**
+ * Call on an object fetched from a weak table (the intern table), which may
+ * hand back garbage an incremental sweep hasn't freed yet.
+ */
+void reviveObject(Obj* object);
+
+/**
+ * Write barrier -> call after storing `value` into a field of `owner`.
+ *
+ * A minor collection doesn't trace old objects, so an old object that gains
+ * a reference to a young one must be remembered, or the young object would
+ * look unreachable.
+ *
+ * During an incremental mark, a marked (black or gray) object that gains a
+ * reference to an unmarked (white) one shades it gray, so the marker can't
+ * miss it. Outside a mark nothing is marked except old objects waiting to be
+ * swept, for which `markBarrier()` is a no-op.
+ */
+static inline void writeBarrier(Obj* owner, Value value) {
+    if (value.type != VAL_OBJ) return;
+
+    Obj* target = value.as.obj;
+    if (owner->isOld && !owner->isRemembered && !target->isOld) {
+        rememberObject(owner);
+    }
+    if (owner->isMarked && !target->isMarked) {
+        markBarrier(value);
+    }
+}
+
+void initGC(GC* gc);
+void freeGC(GC* gc);
+void printGCStats();
+
+/**
+ * Frees every heap object owned by the VM.
+ *
+ * Walks both generations' object lists and releases each object.
+ * Called from `freeVM()`.
+ */
+void freeObjects();
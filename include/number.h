@@ -0,0 +1,49 @@
+#pragma once
+#include "common.h"
+
+// converting numbers to and from text
+
+// longest text formatNumber() produces, plus room to spare
+#define NUMBER_BUFFER_SIZE 32
+
+/**
+ * Writes text that reads back as exactly `value`, and is usually the
+ * shortest that does (Grisu2 is a digit longer for about 0.1% of values).
+ *
+ * Whole numbers below 2^53 are printed as integers directly; anything
+ * else goes through Grisu2. Numbers whose decimal point falls within 21
+ * digits are written out in full, others in exponent form ("1e+21",
+ * "5e-7").
+ *
+ * @param value The number to format.
+ * @param buffer At least NUMBER_BUFFER_SIZE bytes; not null-terminated.
+ * @return The number of characters written.
+ */
+int formatNumber(double value, char* buffer);
+
+/**
+ * Writes an integer in decimal.
+ *
+ * @param value The integer to format.
+ * @param buffer At least NUMBER_BUFFER_SIZE bytes; not null-terminated.
+ * @return The number of characters written.
+ */
+int formatInteger(int64_t value, char* buffer);
+
+/**
+ * Converts a decimal number, already split up by the scanner, to a double.
+ *
+ * The value is `mantissa * 10^exponent`, correctly rounded. Exact small
+ * cases are computed with one floating-point multiply or divide (Clinger's
+ * fast path), most others with the Eisel-Lemire algorithm; whatever those
+ * can't round with certainty is handed to strtod() on `text`.
+ *
+ * @param mantissa The first (up to 19) significant digits.
+ * @param exponent The power of ten `mantissa` is scaled by.
+ * @param truncated Whether nonzero digits were dropped from the mantissa.
+ * @param text The literal itself (need not be null-terminated).
+ * @param length Its length.
+ * @return The nearest double.
+ */
+double decimalToDouble(uint64_t mantissa, int exponent, bool truncated,
+                       const char* text, int length);
@@ -0,0 +1,288 @@
+#pragma once
+#include <string.h>
+
+#include "common.h"
+#include "chunk.h"
+#include "table.h"
+#include "value.h"
+
+// heap-allocated objects -> everything that doesn't fit inside a Value
+
+#define OBJ_TYPE(value)     (AS_OBJ(value)->type)
+
+#define IS_FUNCTION(value)  isObjType(value, OBJ_FUNCTION)
+#define IS_CLOSURE(value)   isObjType(value, OBJ_CLOSURE)
+#define IS_NATIVE(value)    isObjType(value, OBJ_NATIVE)
+#define IS_STRING(value)    isObjType(value, OBJ_STRING)
+#define IS_ROPE(value)      isObjType(value, OBJ_ROPE)
+#define IS_CLASS(value)     isObjType(value, OBJ_CLASS)
+#define IS_INSTANCE(value)  isObjType(value, OBJ_INSTANCE)
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
+// any string value: inline (short), interned or a concatenation result
+#define IS_ANY_STRING(value) (IS_SHORT_STRING(value) || IS_STRING(value) || IS_ROPE(value))
+
+#define AS_FUNCTION(value)  ((ObjFunction*)AS_OBJ(value))
+#define AS_CLOSURE(value)   ((ObjClosure*)AS_OBJ(value))
+#define AS_NATIVE(value)    (((ObjNative*)AS_OBJ(value))->function)
+#define AS_STRING(value)    ((ObjString*)AS_OBJ(value))
+#define AS_CSTRING(value)   (((ObjString*)AS_OBJ(value))->chars)
+#define AS_ROPE(value)      ((ObjRope*)AS_OBJ(value))
+#define AS_CLASS(value)     ((ObjClass*)AS_OBJ(value))
+#define AS_INSTANCE(value)  ((ObjInstance*)AS_OBJ(value))
+#define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
+
+// concatenations shorter than this are interned like any other string
+#define ROPE_MIN_LENGTH     64
+
+
+typedef enum {
+    OBJ_FUNCTION,
+    OBJ_CLOSURE,
+    OBJ_UPVALUE,
+    OBJ_NATIVE,
+    OBJ_STRING,
+    OBJ_ROPE,
+    OBJ_SHAPE,
+    OBJ_CLASS,
+    OBJ_INSTANCE,
+    OBJ_BOUND_METHOD,
+} ObjType;
+
+
+// common header shared by every heap object
+struct Obj {
+    ObjType type;
+    bool isMarked;          // reached during the current collection
+    bool isOld;             // promoted to the old generation
+    bool isRemembered;      // old object listed in the remembered set
+    uint8_t age;            // minor collections survived while young
+    struct Obj* next;       // next object in the same generation's list
+};
+
+
+// a compiled function -> owns the bytecode of its body
+typedef struct ObjFunction {
+    Obj obj;
+    int arity;
+    int upvalueCount;       // variables captured from enclosing functions
+    Chunk chunk;
+    ObjString* name;        // NULL for the top-level script
+    int oldConstants;       // constants below this index are all old (see memory.c)
+    int loopCount;          // loops in the body, numbered by the compiler
+    uint16_t* loopHeat;     // backedges taken per loop, up to HOT_LOOP_THRESHOLD
+
+    // a body left to compile on the first call (see compileLazy()); NULL
+    // once compiled, or once that failed
+    const char* lazySource; // its text, from the '(' of the parameters to the closing '}'
+    int lazyLength;
+    int lazyLine;
+    bool ownsSource;        // lazySource is a copy, freed with the function (see releaseSource())
+} ObjFunction;
+
+
+/**
+ * A captured variable that may outlive the frame it was declared in.
+ *
+ * While the frame is live the variable stays in its stack slot and the
+ * upvalue is open: `location` points at the slot, and the upvalue sits in
+ * the VM's list of open upvalues. When the variable goes out of scope the
+ * value moves into `closed` and `location` follows it.
+ */
+typedef struct ObjUpvalue {
+    Obj obj;
+    Value* location;
+    Value closed;
+    struct ObjUpvalue* next;    // next open upvalue, further down the stack
+} ObjUpvalue;
+
+
+/**
+ * How a closure reaches one variable it captured (see captureKind() in
+ * compiler.c for which one is picked):
+ *
+ * - flat: the variable is never assigned, so the closure keeps a copy in
+ *   `value`, and `location` points at it;
+ * - stack: the closure can't outlive the variable's frame, so `location`
+ *   points straight at its stack slot;
+ * - cell: otherwise -> the variable's ObjUpvalue, shared by every closure
+ *   that captured it, and `location` is unused.
+ */
+typedef struct {
+    Value* location;
+    ObjUpvalue* cell;
+    Value value;
+} Capture;
+
+
+// a function together with the variables it captured
+typedef struct {
+    Obj obj;
+    ObjFunction* function;
+    int captureCount;
+    Capture captures[];     // function->upvalueCount of them
+} ObjClosure;
+
+
+// functions implemented in C and exposed to scripts
+typedef Value (*NativeFn)(int argCount, Value* args);
+
+typedef struct {
+    Obj obj;
+    NativeFn function;
+} ObjNative;
+
+
+// where the characters of an ObjString live
+typedef enum {
+    STRING_INLINE,          // right after the header, in the same allocation
+    STRING_VIEW,            // in the source text the string was compiled from
+    STRING_COPY,            // a separate copy, made when that source was released
+} StringStorage;
+
+
+/**
+ * A heap string.
+ *
+ * Strings built at run time store their characters inline after the header
+ * (flexible array member), so they cost a single allocation. String
+ * constants are views: `chars` points straight into the source, which must
+ * stay alive until it is handed to `releaseSource()` (see vm.h). The FNV-1a
+ * hash is computed once on creation and cached, because every string is
+ * interned in `vm.strings`.
+ *
+ * A view's characters are not null-terminated -> print with "%.*s".
+ */
+struct ObjString {
+    Obj obj;
+    int length;
+    uint32_t hash;          // cached FNV-1a hash of chars
+    StringStorage storage;
+    const char* chars;
+    char inlineChars[];     // the characters of a STRING_INLINE string
+};
+
+
+// characters shared by a chain of ropes (see ObjRope)
+typedef struct {
+    char* chars;
+    int length;             // characters in use
+    int capacity;
+    int ropes;              // ropes still pointing here
+} StringBuffer;
+
+
+/**
+ * The result of a long concatenation.
+ *
+ * A rope's characters are the first `length` characters of its buffer.
+ * Appending to the rope that ends where the buffer's used part ends
+ * (`s = s + x`) writes into the buffer's spare capacity and returns a new,
+ * longer rope sharing it; the older rope still sees its own prefix, which
+ * nothing ever overwrites. Appending to any other rope copies first. So a
+ * loop that builds a string costs amortized O(1) per character instead of
+ * copying the whole string every time.
+ *
+ * Ropes are not interned: equality compares characters.
+ */
+typedef struct {
+    Obj obj;
+    int length;
+    StringBuffer* buffer;
+} ObjRope;
+
+
+/**
+ * The layout of an instance's fields (a hidden class).
+ *
+ * Each class has a tree of shapes: the root has no fields, and each child
+ * adds one field, `name`, in the next slot. Instances whose fields were
+ * added in the same order share a shape, so which slot holds a field is
+ * worked out once per shape, and an inline cache can remember the answer
+ * (see InlineCache in chunk.h). A parent keeps its children alive, so the
+ * same sequence of stores always arrives at the same shape.
+ */
+struct ObjShape {
+    Obj obj;
+    struct ObjShape* parent;    // NULL for the root
+    ObjString* name;            // the field this shape added (NULL for the root)
+    int fieldCount;             // slots in use; `name` is in the last one
+    Table transitions;          // field name -> the child that adds it
+};
+
+typedef struct ObjShape ObjShape;
+
+
+typedef struct ObjClass {
+    Obj obj;
+    ObjString* name;
+    Table methods;          // name -> ObjFunction or ObjClosure, inherited ones copied in
+    ObjShape* shape;        // the root of its instances' shapes
+    struct ObjClass* superclass;    // NULL if it has none
+} ObjClass;
+
+
+// fields live in a plain array; the shape says which name is in which slot
+typedef struct {
+    Obj obj;
+    ObjClass* klass;
+    ObjShape* shape;
+    Value* fields;          // shape->fieldCount of them in use
+    int fieldCapacity;
+} ObjInstance;
+
+
+// a method read off an instance without calling it right away
+typedef struct {
+    Obj obj;
+    Value receiver;
+    Obj* method;            // an ObjFunction or ObjClosure
+} ObjBoundMethod;
+
+
+// function prototypes
+ObjFunction* newFunction();
+ObjClosure* newClosure(ObjFunction* function);
+ObjUpvalue* newUpvalue(Value* slot);
+ObjNative* newNative(NativeFn function);
+ObjClass* newClass(ObjString* name);
+ObjInstance* newInstance(ObjClass* klass);
+ObjBoundMethod* newBoundMethod(Value receiver, Obj* method);
+int shapeSlot(ObjShape* shape, ObjString* name);
+ObjShape* shapeTransition(ObjShape* shape, ObjString* name);
+ObjString* copyString(const char* chars, int length);
+ObjString* viewString(const char* chars, int length);
+void copySourceStrings(const char* start, const char* end);
+void copyLazySources(const char* start, const char* end);
+Value stringValue(const char* chars, int length);
+Value concatenateStrings(Value a, Value b);
+uint32_t hashString(const char* key, int length);
+void writeObject(OutputBuffer* output, Value value);
+
+
+static inline bool isObjType(Value value, ObjType type) {
+    return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
+
+
+// the function behind a method, which is either a function or a closure
+static inline ObjFunction* methodFunction(Obj* method) {
+    return method->type == OBJ_CLOSURE ? ((ObjClosure*)method)->function : (ObjFunction*)method;
+}
+
+
+// characters of any kind of string (not null-terminated); valid as long
+// as `*value` is and, for a rope, until the next allocation
+static inline const char* stringChars(const Value* value) {
+    if (IS_SHORT_STRING(*value)) return AS_SHORT_CSTRING(*value);
+    if (IS_ROPE(*value)) return AS_ROPE(*value)->buffer->chars;
+    return AS_CSTRING(*value);
+}
+
+
+static inline int stringLength(Value value) {
+    if (IS_SHORT_STRING(value)) {
+        return (int)strnlen(AS_SHORT_CSTRING(value), SHORT_STRING_MAX);
+    }
+    if (IS_ROPE(value)) return AS_ROPE(value)->length;
+    return AS_STRING(value)->length;
+}
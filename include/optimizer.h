@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+#include "object.h"
+
+// run-time tier-up of hot loops
+
+// backward jumps a loop takes before its body is optimized
+#define HOT_LOOP_THRESHOLD 1000
+
+/**
+ * Rewrites the body of a hot loop with superinstructions.
+ *
+ * Each rewrite keeps the layout of the sequence it replaces: the opcode
+ * byte changes, operands stay where they were and the rest is skipped at
+ * run time. Every instruction boundary that survives is at the same offset,
+ * so a frame already running the loop, or suspended in a call from it,
+ * carries on in the optimized code with its `ip` untouched; that is the
+ * whole of on-stack replacement here. Sequences that a jump lands inside
+ * are left alone.
+ *
+ * @param function The function the loop belongs to.
+ * @param start Offset of the first instruction of the loop.
+ * @param end Offset of its backward jump.
+ */
+void optimizeLoop(ObjFunction* function, int start, int end);
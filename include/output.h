@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+
+// buffered output for what scripts print
+
+// bytes collected before a file descriptor sink is written to
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// the sink an OutputBuffer writes to when it has no file descriptor
+#define OUTPUT_MEMORY (-1)
+
+
+/**
+ * Output collected in memory and handed to the sink in large blocks.
+ *
+ * With a file descriptor as the sink the buffer is written out whenever
+ * it fills up, on `flushOutput()` and on `freeOutput()`; a single
+ * `write()` per block replaces a stdio call (and its locking) per printed
+ * value. With OUTPUT_MEMORY as the sink nothing is ever written: the
+ * buffer keeps growing until the embedder takes the text with
+ * `outputContents()` and `clearOutput()`.
+ *
+ * The buffer is malloc()ed directly rather than through `reallocate()`,
+ * so printing never starts a garbage collection.
+ */
+typedef struct {
+    char* chars;
+    int count;
+    int capacity;
+    int fd;                 // the sink, or OUTPUT_MEMORY
+} OutputBuffer;
+
+
+void initOutput(OutputBuffer* output, int fd);
+void freeOutput(OutputBuffer* output);
+
+void writeOutput(OutputBuffer* output, const char* chars, int length);
+void writeFormatted(OutputBuffer* output, const char* format, ...);
+void flushOutput(OutputBuffer* output);
+
+void redirectOutput(OutputBuffer* output, int fd);
+const char* outputContents(OutputBuffer* output, int* length);
+void clearOutput(OutputBuffer* output);
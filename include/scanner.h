@@ -14,10 +14,10 @@ typedef enum {
   // Literals.
   TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
   // Keywords.
-  TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
+  TOKEN_AND, TOKEN_CATCH, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
   TOKEN_FOR, TOKEN_FUN, TOKEN_IF, TOKEN_NULL, TOKEN_OR,
   TOKEN_PRINT, TOKEN_RETURN, TOKEN_SUPER, TOKEN_THIS,
-  TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE,
+  TOKEN_THROW, TOKEN_TRUE, TOKEN_TRY, TOKEN_VAR, TOKEN_WHILE,
 
   TOKEN_ERROR, TOKEN_EOF
 } TokenType;
@@ -29,7 +29,12 @@ typedef struct {
     const char* start;
     int length;
     int line;
+    double number;      // the value of a TOKEN_NUMBER, parsed while scanning
+    bool isInteger;     // written without a '.' and within int64 range...
+    int64_t integer;    // ...in which case this is its exact value
+    bool noinline;      // comes right after a `// @noinline` comment
 } Token;
 
 void initScanner(const char* source);
+void initScannerAt(const char* source, int line);
 Token scanToken();
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+#include "common.h"
+#include "value.h"
+
+// open-addressing hash table keyed by interned strings
+
+typedef struct {
+    ObjString* key;
+    Value value;
+} Entry;
+
+
+typedef struct {
+    int count;          // number of occupied entries, tombstones included
+    int capacity;       // always a power of two (or 0)
+    Entry* entries;
+} Table;
+
+
+// function prototypes
+void initTable(Table* table);
+void freeTable(Table* table);
+bool tableGet(Table* table, ObjString* key, Value* value);
+bool tableSet(Table* table, ObjString* key, Value value);
+bool tableDelete(Table* table, ObjString* key);
+void tableAddAll(Table* from, Table* to);
+void markTable(Table* table);
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
@@ -1,19 +1,33 @@
 #pragma once
 #include "common.h"
+#include "output.h"
 
+typedef struct Obj Obj;
+typedef struct ObjString ObjString;
 
 typedef enum {
     VAL_BOOL,
     VAL_NULL,
     VAL_NUMBER,
+    VAL_INT,            // a whole number kept exactly as an int64
+    VAL_SHORT_STRING,   // a string short enough to live in the Value itself
+    VAL_OBJ,        // pointer to a heap object (see object.h)
 } ValueType;
 
 
+// longest string kept inline; anything longer becomes an ObjString
+#define SHORT_STRING_MAX 7
+
+
 typedef struct {
     ValueType type;
     union {
         bool boolean;
         double number;
+        int64_t integer;
+        Obj* obj;
+        // null-padded, so the last byte is always '\0'
+        char shortChars[SHORT_STRING_MAX + 1];
     } as;
 } Value;
 
@@ -22,17 +36,29 @@ typedef struct {
 #define IS_BOOL(value)    ((value).type == VAL_BOOL)
 #define IS_NULL(value)     ((value).type == VAL_NULL)
 #define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
+#define IS_INT(value)     ((value).type == VAL_INT)
+// either representation of a number
+#define IS_ANY_NUMBER(value) (IS_NUMBER(value) || IS_INT(value))
+#define IS_SHORT_STRING(value) ((value).type == VAL_SHORT_STRING)
+#define IS_OBJ(value)     ((value).type == VAL_OBJ)
 
 
 // extract exact value from the Value struct
 #define AS_BOOL(value)     ((value).as.boolean)
 #define AS_NUMBER(value)   ((value).as.number)
+#define AS_INT(value)      ((value).as.integer)
+// any number as a double (evaluates `value` more than once)
+#define AS_FLOAT(value)    (IS_INT(value) ? (double)AS_INT(value) : AS_NUMBER(value))
+#define AS_SHORT_CSTRING(value) ((value).as.shortChars)
+#define AS_OBJ(value)      ((value).as.obj)
 
 
 // value creating macros
 #define BOOL_VAL(value)   ((Value){VAL_BOOL, {.boolean = value}})
 #define NULL_VAL           ((Value){VAL_NULL, {.number = 0}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
+#define INT_VAL(value)    ((Value){VAL_INT, {.integer = value}})
+#define OBJ_VAL(object)   ((Value){VAL_OBJ, {.obj = (Obj*)object}})
 
 
 // a dynamic array of values
@@ -43,9 +69,22 @@ typedef struct {
 } ValueArray;
 
 
+/**
+ * Makes an inline string value. `length` must be at most SHORT_STRING_MAX.
+ *
+ * The payload is zeroed first: equality compares all of its bytes.
+ */
+static inline Value shortStringValue(const char* chars, int length) {
+    Value value = {VAL_SHORT_STRING, {.number = 0}};
+    for (int i = 0; i < length; i++) value.as.shortChars[i] = chars[i];
+    return value;
+}
+
+
 // funtion prototypes
 bool valuesEqual(Value a, Value b);
 void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
+void writeValue(OutputBuffer* output, Value value);
 void printValue(Value value);
\ No newline at end of file
@@ -1,14 +1,50 @@
 #pragma once
 #include "chunk.h" 
+#include "memory.h"
+#include "object.h"
+#include "output.h"
+#include "table.h"
 #include "value.h"
 
-#define STACK_MAX 256
+// address space reserved for the call stack and the value stack; pages are
+// only committed as deep recursion actually touches them. The call stack is
+// sized in frames, so its depth limit doesn't shrink when CallFrame grows.
+#define FRAMES_RESERVE ((size_t)16 * 1024 * 1024 * sizeof(CallFrame))
+#define STACK_RESERVE  ((size_t)1024 * 1024 * 1024)
+
+
+// one in-progress function call
+typedef struct {
+    ObjFunction* function;
+    ObjClosure* closure;    // the closure being run, NULL for a function that captures nothing
+    uint8_t* ip;        // return address -> where the caller resumes
+    Value* slots;       // first stack slot this call can use (slot 0 = the callee)
+} CallFrame;
+
 
 typedef struct {
-    Chunk* chunk;
-    uint8_t* ip;    // instruction pointer (program counter) -> tracks the current instruction being executed by the VM's bytecode
-    Value stack[STACK_MAX];
+    CallFrame* frames;  // guard-paged, see reserveGuarded()
+    int frameCount;
+    int frameCapacity;
+
+    Value* stack;       // guard-paged; overflow faults instead of being checked per push
     Value* stackTop;
+    size_t stackCapacity;
+
+    ObjUpvalue* openUpvalues;   // upvalues still pointing into the stack, topmost first
+
+    Table globals;  // global variables, keyed by interned name
+    Table strings;  // intern table -> every live string, keyed by itself (weak)
+
+    Obj* objects;       // young generation, newest first
+    Obj* oldObjects;    // promoted objects
+    size_t bytesAllocated;
+    GC gc;
+
+    OutputBuffer output;    // what `println` writes; stdout unless redirected
+    ObjString* initString;  // "init", the name of initializers
+    int optimizeLevel;      // what optimizeFunction() runs on compiled functions, 0 for nothing
+    bool strict;            // compile every function body up front (see deferFunction() in the compiler)
 } VM;
 
 
@@ -19,11 +55,15 @@ typedef enum {
 } InterpretResult;
 
 
+extern VM vm;
+
+
 // function prototypes
 void initVM();
 void freeVM();
 
 InterpretResult interpret(const char* source);
+void releaseSource(const char* source);
 
 // stack operations prototypes
 void push(Value value);
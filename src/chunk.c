@@ -2,6 +2,7 @@
 #include "include/chunk.h"
 #include "include/memory.h"
 #include "include/common.h"
+#include "include/vm.h"
 
 // initialize the chunk with empty array
 void initChunk(Chunk* chunk) {
@@ -9,20 +10,33 @@ void initChunk(Chunk* chunk) {
     chunk->capacity = 0;
     chunk->code = NULL;
 
-    // Initialize line tracking array with a default capacity to prevent NULL access issues.
+    // Initialize line tracking array; it is allocated on the first writeChunk().
+    // (freeChunk() re-initializes the chunk, so allocating here would leak.)
     chunk->lineCount = 0;
     chunk->lineCapacity = 0;
-    chunk->lines = (LineEntry*) malloc(sizeof(LineEntry) * chunk->lineCapacity);
+    chunk->lines = NULL;
 
 
     initValueArray(&chunk->constants);
+    chunk->caches = NULL;
+    chunk->cacheCount = 0;
+    chunk->cacheCapacity = 0;
+    chunk->inlined = NULL;
+    chunk->inlinedCount = 0;
+    chunk->inlinedCapacity = 0;
+    chunk->handlers = NULL;
+    chunk->handlerCount = 0;
+    chunk->handlerCapacity = 0;
 }
 
 // free the chunk and initialize it
 void freeChunk(Chunk* chunk) {
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);  // Free the array
-    FREE_ARRAY(LineEntry, chunk->lines, chunk->capacity);
+    FREE_ARRAY(LineEntry, chunk->lines, chunk->lineCapacity);
     freeValueArray(&chunk->constants);
+    FREE_ARRAY(InlineCache, chunk->caches, chunk->cacheCapacity);
+    FREE_ARRAY(InlinedCall, chunk->inlined, chunk->inlinedCapacity);
+    FREE_ARRAY(ExceptionHandler, chunk->handlers, chunk->handlerCapacity);
     initChunk(chunk);                                   // Initialize the chunk
 }
 
@@ -75,6 +89,27 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
 }
 
 
+/**
+ * Drops the bytecode from `count` on, along with its line information.
+ *
+ * Lets the compiler take back instructions it just emitted and replace
+ * them with something better.
+ */
+void truncateChunk(Chunk* chunk, int count) {
+    int removed = chunk->count - count;
+    while (removed > 0) {
+        LineEntry* last = &chunk->lines[chunk->lineCount - 1];
+        if (last->count > removed) {
+            last->count -= removed;
+            break;
+        }
+        removed -= last->count;
+        chunk->lineCount--;
+    }
+    chunk->count = count;
+}
+
+
 /**
  * Retrieves the line number associated with a specific instruction index in the chunk.
  *
@@ -117,8 +152,11 @@ int getLine(Chunk* chunk, int index) {
  * @return The index of the newly added constant in the `constants` array.
  */
 int addConstant(Chunk* chunk, Value value) {
-    // add the value to the constants array in the chunk
+    // add the value to the constants array in the chunk; it sits on the VM
+    // stack meanwhile, since growing the array may trigger a collection
+    push(value);
     writeValueArray(&chunk->constants, value);
+    pop();
     
     // returns the index of the newly added constants
     return chunk->constants.count - 1;
@@ -126,6 +164,129 @@ int addConstant(Chunk* chunk, Value value) {
 
 
 
+// adds an empty inline cache for a property instruction & returns its index
+int addInlineCache(Chunk* chunk, ObjString* name) {
+    if (chunk->cacheCapacity < chunk->cacheCount + 1) {
+        int oldCapacity = chunk->cacheCapacity;
+        chunk->cacheCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->caches = GROW_ARRAY(InlineCache, chunk->caches, oldCapacity, chunk->cacheCapacity);
+    }
+
+    InlineCache* cache = &chunk->caches[chunk->cacheCount];
+    cache->name = name;
+    cache->count = 0;
+    return chunk->cacheCount++;
+}
+
+
+
+// records that code[start, end) is the body of `function`, inlined at `line`
+void addInlinedCall(Chunk* chunk, int start, int end, ObjFunction* function, int line) {
+    if (chunk->inlinedCapacity < chunk->inlinedCount + 1) {
+        int oldCapacity = chunk->inlinedCapacity;
+        chunk->inlinedCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->inlined = GROW_ARRAY(InlinedCall, chunk->inlined, oldCapacity, chunk->inlinedCapacity);
+    }
+
+    chunk->inlined[chunk->inlinedCount++] = (InlinedCall){start, end, function, line};
+}
+
+
+
+// records that an exception thrown in code[start, end) is caught at `handler`
+void addExceptionHandler(Chunk* chunk, int start, int end, int handler, int height) {
+    if (chunk->handlerCapacity < chunk->handlerCount + 1) {
+        int oldCapacity = chunk->handlerCapacity;
+        chunk->handlerCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->handlers = GROW_ARRAY(ExceptionHandler, chunk->handlers, oldCapacity, chunk->handlerCapacity);
+    }
+
+    chunk->handlers[chunk->handlerCount++] = (ExceptionHandler){start, end, handler, height};
+}
+
+
+
+// size in bytes of the instruction at `offset`, operands included
+int instructionLength(Chunk* chunk, int offset) {
+    switch (chunk->code[offset]) {
+        case OP_CLOSURE:
+        case OP_CLOSURE_LONG: {
+            // three bytes per capture after the function constant
+            int index = chunk->code[offset + 1];
+            int length = 2;
+            if (chunk->code[offset] == OP_CLOSURE_LONG) {
+                index = (index << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+                length = 4;
+            }
+            return length + 3 * AS_FUNCTION(chunk->constants.values[index])->upvalueCount;
+        }
+
+
+        case OP_CONSTANT:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_CLASS:
+        case OP_METHOD:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+        case OP_GET_ARGUMENT:
+        case OP_SET_ARGUMENT:
+        case OP_INLINE_RETURN:
+            return 2;
+
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+        case OP_GET_SUPER:
+        case OP_SET_LOCAL_POP:
+        case OP_SET_GLOBAL_POP:
+            return 3;
+
+        case OP_CONSTANT_LONG:
+        case OP_GET_LOCAL_LONG:
+        case OP_SET_LOCAL_LONG:
+        case OP_GET_GLOBAL_LONG:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_SET_GLOBAL_LONG:
+        case OP_CLASS_LONG:
+        case OP_METHOD_LONG:
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE:
+        case OP_LOOP:
+            return 4;
+
+        case OP_LOCALS_BINARY:
+        case OP_LOCAL_CONSTANT_BINARY:
+            return 5;
+
+        case OP_FOR_INCR_LT:
+        case OP_FOR_INCR_LT_CONST:
+            return 6;
+
+        case OP_INLINE_GUARD:
+            return 7;
+
+        default:
+            return 1;
+    }
+}
+
+
+
+
+
 /**
  * Writes a constant value to the chunk.
  *
@@ -1,9 +1,15 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "include/common.h"
 #include "include/compiler.h"
+#include "include/ir.h"
+#include "include/memory.h"
+#include "include/object.h"
 #include "include/scanner.h"
+#include "include/table.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "include/debug.h"
@@ -33,7 +39,7 @@ typedef enum {
 } Precedence;
 
 
-typedef void (*ParseFn) ();
+typedef void (*ParseFn) (bool canAssign);
 
 typedef struct {
     ParseFn prefix;
@@ -47,12 +53,86 @@ typedef struct {
 
 
 
+// local variables -> resolved to a fixed stack slot at compile time
+typedef struct {
+    Token name;
+    int depth;          // scope depth of the declaring block, -1 while uninitialized
+
+    // what closures do with it, for captureKind(); all known once its scope ends
+    bool isCaptured;            // some closure refers to it
+    bool isAssigned;            // written after its declaration, or captured before it had a value
+    bool capturedByEscaping;    // by a closure that may outlive this frame
+    bool escapes;               // its value was used other than by calling it
+    int closure;                // offset of the OP_CLOSURE of a local function declared in it, else -1
+    ObjFunction* inlined;       // a local function declared in it whose calls get inlined, else NULL
+} Local;
+
+
+// a variable of an enclosing function that the function being compiled captures
+typedef struct {
+    uint16_t index;     // the local's slot, or the enclosing function's capture index
+    bool isLocal;       // a local of the directly enclosing function
+    bool escapes;       // a closure nested in here that may outlive the enclosing frame uses it
+} Upvalue;
+
+
+// the wide (_LONG) local instructions could address far more; this keeps a
+// single frame's window to a sane size
+#define LOCALS_MAX (UINT8_COUNT * UINT8_COUNT)
+
+
+typedef enum {
+    TYPE_FUNCTION,
+    TYPE_LAMBDA,        // an anonymous `fn (params) { body }` expression
+    TYPE_METHOD,        // slot 0 holds `this`
+    TYPE_INITIALIZER,   // a method named init -> always returns `this`
+    TYPE_SCRIPT,        // the implicit top-level function
+} FunctionType;
+
+
+// per-function compilation state; nested function declarations form a chain
+typedef struct Compiler {
+    struct Compiler* enclosing;
+    ObjFunction* function;      // the function whose body is being compiled
+    FunctionType type;
+
+    Local* locals;      // index in this array == stack slot at runtime
+    int localCount;
+    int localCapacity;
+    int scopeDepth;     // 0 -> global scope
+
+    Upvalue upvalues[UINT8_COUNT];  // function->upvalueCount of them
+    int selfSlot;       // the enclosing function's local this function is declared in, -1 if none
+    int* closures;      // offsets of the OP_CLOSUREs emitted so far, whose captures get patched
+    int closureCount;
+    int closureCapacity;
+    int calleeSlot;     // the local just read, if it is about to be called; -1 otherwise
+    int lastCallee;     // the local called by the call at `lastCall`, -1 if none
+    ObjFunction* inlineCallee;  // the function just read, if it is about to be called and can be inlined
+
+    Table identifierConstants;  // name -> constant index, so each identifier is stored once per chunk
+    int lastCall;               // offset of the most recent OP_CALL, -1 if none
+    int lastCompare;            // offset of the most recent comparison, -1 if none
+    int jumpTarget;             // the furthest offset a forward jump lands on
+    int tryDepth;               // try blocks around the code being compiled
+} Compiler;
+
+
+// the class whose body is being compiled; classes nest like compilers do
+typedef struct ClassCompiler {
+    struct ClassCompiler* enclosing;
+    bool hasSuperclass;
+} ClassCompiler;
+
+
 Parser parser;
-Chunk* compilingChunk;
+Compiler* current = NULL;
+ClassCompiler* currentClass = NULL;
+Table inlinable;        // name -> global function whose calls get inlined
 
 
 static Chunk* currentChunk() {
-    return compilingChunk;
+    return &current->function->chunk;
 }
 
 
@@ -127,6 +207,19 @@ static void consume(TokenType type, const char* message) {
 }
 
 
+static bool check(TokenType type) {
+    return parser.current.type == type;
+}
+
+
+// consume the current token only if it has the given type
+static bool match(TokenType type) {
+    if (!check(type)) return false;
+    advance();
+    return true;
+}
+
+
 
 
 static void emitByte(uint8_t byte) {
@@ -139,26 +232,94 @@ static void emitBytes(uint8_t byte1, uint8_t byte2) {
     emitByte(byte2);
 }
 
+/**
+ * Emits a forward jump with a placeholder offset.
+ *
+ * @return The offset of the placeholder, to be filled in by `patchJump()`.
+ */
+static int emitJump(uint8_t instruction) {
+    emitByte(instruction);
+    emitByte(0xff);
+    emitByte(0xff);
+    return currentChunk()->count - 2;
+}
+
+
+
+/**
+ * Numbers a loop of the current function, for its backward jump.
+ *
+ * Each number gets its own hotness counter at run time. A function with
+ * more than 256 loops lets the last ones share a counter; that only
+ * changes when they're considered hot.
+ */
+static uint8_t loopNumber() {
+    ObjFunction* function = current->function;
+    if (function->loopCount <= UINT8_MAX) function->loopCount++;
+    return (uint8_t)(function->loopCount - 1);
+}
+
+
+
+// a backward jump to `loopStart`
+static void emitLoop(int loopStart) {
+    emitBytes(OP_LOOP, loopNumber());
+
+    int offset = currentChunk()->count - loopStart + 2;     // +2 for the operand itself
+    if (offset > UINT16_MAX) error("Loop body too large.");
+
+    emitByte((offset >> 8) & 0xff);
+    emitByte(offset & 0xff);
+}
+
+
+
+// functions without an explicit return statement return null; initializers return `this`
 static void emitReturn() {
+    if (current->type == TYPE_INITIALIZER) {
+        emitBytes(OP_GET_LOCAL, 0);
+    } else {
+        emitByte(OP_NULL);
+    }
     emitByte(OP_RETURN);
 }
 
 
 
 // Adds a constant & returns its index
-static uint8_t makeConstant(Value value) {
+static int makeConstant(Value value) {
     int constant = addConstant(currentChunk(), value);
-
-    if (constant <= UINT8_MAX) {
-        return (uint8_t)constant;
-    }
+    // the function may already have been promoted while we compile it
+    writeBarrier((Obj*)current->function, value);
 
     if (constant > 0xFFFFFF) {  // 16,777,215 max index
         error("Too many constants in one chunk.");
         return 0;
     }
 
-    return constant;  // We’ll handle this in emitConstant()
+    return constant;
+}
+
+
+/**
+ * Emits an instruction that takes a constant-table index as its operand.
+ *
+ * Indices that fit in a byte use the short form of the instruction; larger
+ * ones switch to the `_LONG` form with a 24-bit operand (high byte first).
+ *
+ * @param op The one-byte form of the instruction.
+ * @param longOp The 24-bit form of the instruction.
+ * @param index The constant-table index.
+ */
+static void emitIndexed(uint8_t op, uint8_t longOp, int index) {
+    if (index <= UINT8_MAX) {
+        emitBytes(op, (uint8_t)index);
+    } else {
+        emitByte(longOp);
+        emitByte((index >> 16) & 0xFF);      // high byte
+        emitByte((index >> 8) & 0xFF);       // middle byte
+        emitByte(index & 0xFF);              // low byte
+    }
 }
 
 
@@ -166,37 +327,278 @@ static uint8_t makeConstant(Value value) {
 // Adds a constant and emits bytecode 
 static void emitConstant(Value value) {
     // add constant to chunk's constant pool
-    int constant = addConstant(currentChunk(), value);
+    emitIndexed(OP_CONSTANT, OP_CONSTANT_LONG, makeConstant(value));
+}
+
+
+
+
+// backpatch a jump emitted by emitJump() to land on the next instruction
+static void patchJump(int offset) {
+    // -2 to adjust for the bytecode for the jump offset itself
+    int jump = currentChunk()->count - offset - 2;
+
+    if (jump > UINT16_MAX) {
+        error("Too much code to jump over.");
+    }
+
+    currentChunk()->code[offset] = (jump >> 8) & 0xff;
+    currentChunk()->code[offset + 1] = jump & 0xff;
+    current->jumpTarget = currentChunk()->count;
+}
+
+
 
-    if (constant <= UINT8_MAX) {
-        emitBytes(OP_CONSTANT, (uint8_t)constant);
+/**
+ * Emits the jump taken when the condition just compiled is false.
+ *
+ * If the condition ended in a comparison (optionally negated), the
+ * comparison is taken back and the jump becomes a fused compare-and-branch
+ * that pops the operands itself; otherwise it is an OP_JUMP_IF_FALSE that
+ * leaves the condition on the stack. Fusing is skipped when some jump
+ * lands after the comparison: code arriving there has a single value on
+ * the stack, not two operands.
+ *
+ * @param fused Set to whether the condition was consumed by the jump.
+ * @return The offset to pass to `patchJump()`.
+ */
+static int conditionJump(bool* fused) {
+    Chunk* chunk = currentChunk();
+    int compare = current->lastCompare;
+    *fused = false;
+
+    if (compare >= 0 && current->jumpTarget <= compare) {
+        int tail = chunk->count - compare;
+        bool negated = tail == 2 && chunk->code[compare + 1] == OP_NOT;
+
+        if (tail == 1 || negated) {
+            uint8_t jump;
+            switch (chunk->code[compare]) {
+                case OP_LESS:    jump = negated ? OP_JUMP_IF_LESS : OP_JUMP_IF_NOT_LESS; break;
+                case OP_GREATER: jump = negated ? OP_JUMP_IF_GREATER : OP_JUMP_IF_NOT_GREATER; break;
+                default:         jump = negated ? OP_JUMP_IF_EQUAL : OP_JUMP_IF_NOT_EQUAL; break;
+            }
+            truncateChunk(chunk, compare);
+            current->lastCompare = -1;
+            *fused = true;
+            return emitJump(jump);
+        }
+    }
+
+    return emitJump(OP_JUMP_IF_FALSE);
+}
+
+
+
+static void addLocal(Token name);
+
+// `function` is one declared earlier whose body is compiled now, or NULL for a new one
+static void initCompiler(Compiler* compiler, FunctionType type, ObjFunction* function) {
+    compiler->enclosing = current;
+    compiler->function = NULL;
+    compiler->type = type;
+    compiler->locals = NULL;
+    compiler->localCount = 0;
+    compiler->localCapacity = 0;
+    compiler->scopeDepth = 0;
+    compiler->selfSlot = -1;
+    compiler->closures = NULL;
+    compiler->closureCount = 0;
+    compiler->closureCapacity = 0;
+    compiler->calleeSlot = -1;
+    compiler->lastCallee = -1;
+    compiler->inlineCallee = NULL;
+    initTable(&compiler->identifierConstants);
+    compiler->lastCall = -1;
+    compiler->lastCompare = -1;
+    compiler->jumpTarget = 0;
+    compiler->tryDepth = 0;
+    compiler->function = function != NULL ? function : newFunction();
+    current = compiler;
+
+    if (function != NULL) {
+        // named when it was declared
+    } else if (type == TYPE_LAMBDA) {
+        current->function->name = copyString("lambda", 6);
+        writeBarrier((Obj*)current->function, OBJ_VAL(current->function->name));
+    } else if (type != TYPE_SCRIPT) {
+        current->function->name = viewString(parser.previous.start, parser.previous.length);
+        writeBarrier((Obj*)current->function, OBJ_VAL(current->function->name));
+    }
+
+    // slot 0 holds the function being called (the receiver, for a method);
+    // outside methods give it an unusable name
+    Token callee;
+    if (type == TYPE_METHOD || type == TYPE_INITIALIZER) {
+        callee.start = "this";
+        callee.length = 4;
+    } else {
+        callee.start = "";
+        callee.length = 0;
+    }
+    addLocal(callee);
+    current->locals[0].depth = 0;
+}
+
+
+
+/**
+ * Finds the captures of the OP_CLOSURE at `offset`.
+ *
+ * Each is three bytes: a CaptureKind, then the slot or capture index.
+ *
+ * @param count Set to how many there are.
+ * @return The offset of the first one.
+ */
+static int closureCaptures(int offset, int* count) {
+    Chunk* chunk = currentChunk();
+    int index = chunk->code[offset + 1];
+    int first = offset + 2;
+    if (chunk->code[offset] == OP_CLOSURE_LONG) {
+        index = (index << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+        first = offset + 4;
+    }
+
+    *count = AS_FUNCTION(chunk->constants.values[index])->upvalueCount;
+    return first;
+}
+
+
+
+// a closure that may outlive this frame has captured the local or upvalue `index`
+static void markEscaping(uint16_t index, bool isLocal) {
+    if (isLocal) {
+        current->locals[index].capturedByEscaping = true;
     } else {
-        emitByte(OP_CONSTANT_LONG);
-        emitByte((constant >> 16) & 0xFF);      // high byte
-        emitByte((constant >> 8) & 0xFF);       // middle byte
-        emitByte(constant & 0xFF);              // low byte
+        current->upvalues[index].escapes = true;
+    }
+}
+
+
+
+// the closure made by the OP_CLOSURE at `offset` may outlive this frame
+static void closureEscapes(int offset) {
+    int count;
+    int capture = closureCaptures(offset, &count);
+    uint8_t* code = currentChunk()->code;
+
+    for (int i = 0; i < count; i++, capture += 3) {
+        uint16_t index = (uint16_t)((code[capture + 1] << 8) | code[capture + 2]);
+        markEscaping(index, code[capture] != CAPTURE_UPVALUE);
     }
 }
 
 
 
+/**
+ * Decides how closures capture the local in `slot`, whose scope is over.
+ *
+ * By now every read and write of it has been compiled, so:
+ *
+ * - a local nobody assigns is copied into each closure (flat), as its
+ *   value can't change after the closure is made;
+ * - otherwise, if every closure that captured it is known not to outlive
+ *   this frame, they point at its stack slot;
+ * - otherwise it gets a heap cell, an ObjUpvalue, shared by all of them.
+ *
+ * A closure can only outlive the frame if it escapes: it is a lambda or a
+ * method, or a local function whose name is used other than to call it
+ * directly from this function or from its own body (see namedVariable()).
+ * A closure that escapes makes whatever it captured, from here or through
+ * enclosing functions, escape with it.
+ *
+ * The OP_CLOSUREs that captured the local are patched with the answer.
+ *
+ * @return The kind, or CAPTURE_LOCAL if no closure captured it.
+ */
+static CaptureKind captureKind(int slot) {
+    Local* local = &current->locals[slot];
+    if (local->closure != -1 && local->escapes) closureEscapes(local->closure);
+    if (!local->isCaptured) return CAPTURE_LOCAL;
+
+    CaptureKind kind = !local->isAssigned ? CAPTURE_FLAT
+                     : !local->capturedByEscaping ? CAPTURE_STACK
+                     : CAPTURE_CELL;
+
+    uint8_t* code = currentChunk()->code;
+    for (int i = 0; i < current->closureCount; i++) {
+        int count;
+        int capture = closureCaptures(current->closures[i], &count);
+        for (int j = 0; j < count; j++, capture += 3) {
+            if (code[capture] == CAPTURE_LOCAL &&
+                ((code[capture + 1] << 8) | code[capture + 2]) == slot) {
+                code[capture] = (uint8_t)kind;
+            }
+        }
+    }
+    return kind;
+}
+
+
 
-static void endCompiler() {
+static ObjFunction* endCompiler() {
     emitReturn();
+    // OP_RETURN closes whatever cells are left, so this only patches
+    for (int i = current->localCount - 1; i >= 0; i--) {
+        captureKind(i);
+    }
 
+    ObjFunction* function = current->function;
+    if (function->loopCount > 0) {
+        function->loopHeat = ALLOCATE(uint16_t, function->loopCount);
+        memset(function->loopHeat, 0, sizeof(uint16_t) * function->loopCount);
+    }
+    FREE_ARRAY(Local, current->locals, current->localCapacity);
+    FREE_ARRAY(int, current->closures, current->closureCapacity);
+    freeTable(&current->identifierConstants);
 
+    if (vm.optimizeLevel > 0 && !parser.hadError) {
+        optimizeFunction(function, vm.optimizeLevel);
+    }
 
 #ifdef DEBUG_PRINT_CODE
     if (!parser.hadError) {
-        disassembleChunk(currentChunk(), "code");
+        char name[64];      // names are views into the source, not C strings
+        snprintf(name, sizeof(name), "%.*s", function->name != NULL ? function->name->length : 8,
+                 function->name != NULL ? function->name->chars : "<script>");
+        disassembleChunk(currentChunk(), name);
     }
 #endif
 
+    current = current->enclosing;
+    return function;
+}
+
+
+
+static void beginScope() {
+    current->scopeDepth++;
+}
+
+
+
+// leaving a block discards the locals declared in it
+static void endScope() {
+    current->scopeDepth--;
+
+    while (current->localCount > 0 &&
+           current->locals[current->localCount - 1].depth > current->scopeDepth) {
+        if (captureKind(current->localCount - 1) == CAPTURE_CELL) {
+            emitByte(OP_CLOSE_UPVALUE);
+        } else {
+            emitByte(OP_POP);
+        }
+        current->localCount--;
+    }
 }
 
 
 
 static void expression();
+static void statement();
+static void declaration();
+static void lambda(bool canAssign);
+static void inlineCall(ObjFunction* function, uint8_t argCount);
 static ParseRule* getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 
@@ -205,11 +607,25 @@ static void parsePrecedence(Precedence precedence);
 
 
 // infix parser for binary operations
-static void binary() {
+static void binary(bool canAssign) {
+    (void)canAssign;
     TokenType operatorType = parser.previous.type;
     ParseRule* rule = getRule(operatorType);
     parsePrecedence((Precedence) (rule->precedence + 1));
 
+    switch (operatorType) {
+        case TOKEN_BANG_EQUAL:
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+            current->lastCompare = currentChunk()->count;   // see conditionJump()
+            break;
+        default:
+            break;
+    }
+
     switch (operatorType) {
         case TOKEN_BANG_EQUAL:    emitBytes(OP_EQUAL, OP_NOT); break;       // !(a == b)
         case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
@@ -227,8 +643,76 @@ static void binary() {
 }
 
 
+static uint8_t argumentList() {
+    uint8_t argCount = 0;
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            expression();
+            if (argCount == 255) {
+                error("Can't have more than 255 arguments.");
+            }
+            argCount++;
+        } while (match(TOKEN_COMMA));
+    }
+
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+    return argCount;
+}
+
+
+
+// infix parser for '(' -> the callee is already on the stack
+static void call(bool canAssign) {
+    (void)canAssign;
+    int callee = current->calleeSlot;
+    current->calleeSlot = -1;
+    ObjFunction* inlined = current->inlineCallee;
+    current->inlineCallee = NULL;
+
+    uint8_t argCount = argumentList();
+    if (inlined != NULL && argCount == inlined->arity) {
+        inlineCall(inlined, argCount);
+        return;
+    }
+
+    current->lastCall = currentChunk()->count;
+    current->lastCallee = callee;
+    emitBytes(OP_CALL, argCount);
+}
+
+
+
+// a and b -> b is only evaluated if a is truthy; the result is whichever ran last
+static void and_(bool canAssign) {
+    (void)canAssign;
+    int endJump = emitJump(OP_JUMP_IF_FALSE);
+
+    emitByte(OP_POP);
+    parsePrecedence(PREC_AND);
+
+    patchJump(endJump);
+}
+
+
+
+// a or b -> b is only evaluated if a is falsey
+static void or_(bool canAssign) {
+    (void)canAssign;
+    int elseJump = emitJump(OP_JUMP_IF_FALSE);
+    int endJump = emitJump(OP_JUMP);
+
+    patchJump(elseJump);
+    emitByte(OP_POP);
+
+    parsePrecedence(PREC_OR);
+    patchJump(endJump);
+}
+
+
+
 // for parsing: true, null, false literals
-static void literal() {
+static void literal(bool canAssign) {
+    (void)canAssign;
     switch (parser.previous.type) {
         case TOKEN_FALSE: emitByte(OP_FALSE); break;
         case TOKEN_NULL: emitByte(OP_NULL); break;
@@ -243,7 +727,8 @@ static void literal() {
 
 
 // compiling groupings
-static void grouping() {
+static void grouping(bool canAssign) {
+    (void)canAssign;
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
 }
@@ -251,152 +736,1512 @@ static void grouping() {
 
 
 // compiling number literals
-static void number() {
-    // convert string into float
-    double value = strtod(parser.previous.start, NULL);
-    emitConstant(NUMBER_VAL(value));
+static void number(bool canAssign) {
+    (void)canAssign;
+    // the scanner has already worked out the value; whole numbers stay exact
+    if (parser.previous.isInteger) {
+        emitConstant(INT_VAL(parser.previous.integer));
+    } else {
+        emitConstant(NUMBER_VAL(parser.previous.number));
+    }
 }
 
 
 
-// compiling unary expression
-static void unary() {
-    TokenType operatorType = parser.previous.type;
+// compiling string literals
+static void string(bool canAssign) {
+    (void)canAssign;
+    // trim the surrounding quotes; short strings are stored inline, longer
+    // ones are interned views into the source
+    const char* chars = parser.previous.start + 1;
+    int length = parser.previous.length - 2;
+    emitConstant(length <= SHORT_STRING_MAX ? shortStringValue(chars, length)
+                                            : OBJ_VAL(viewString(chars, length)));
+}
 
-    // Compile the operand.
-    parsePrecedence(PREC_UNARY);
 
-    // Emit the operator instruction
-    switch (operatorType) {
-        case TOKEN_BANG:  emitByte(OP_NOT); break;
-        case TOKEN_MINUS: emitByte(OP_NEGATE); break;
-        default: return;    // Unreachable
+
+/**
+ * Adds a variable name to the constant table and returns its index.
+ *
+ * Names are interned, so repeated references to the same global reuse the
+ * constant that was created the first time instead of growing the table.
+ */
+static int stringConstant(ObjString* string) {
+    Value index;
+    if (tableGet(&current->identifierConstants, string, &index)) {
+        return (int)AS_NUMBER(index);
     }
+
+    int constant = makeConstant(OBJ_VAL(string));
+    tableSet(&current->identifierConstants, string, NUMBER_VAL((double)constant));
+    return constant;
 }
 
 
 
+static int identifierConstant(Token* name) {
+    return stringConstant(viewString(name->start, name->length));
+}
 
-/**
- * An array of ParseRule structures that define the parsing rules for the compiler.
- */
-ParseRule rules[] = {
-    [TOKEN_LEFT_PAREN]    = {grouping, NULL,   PREC_NONE},
-    [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, 
-    [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_DOT]           = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_MINUS]         = {unary,    binary, PREC_TERM},
-    [TOKEN_PLUS]          = {NULL,     binary, PREC_TERM},
-    [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_SLASH]         = {NULL,     binary, PREC_FACTOR},
-    [TOKEN_ASTERISK]      = {NULL,     binary, PREC_FACTOR},
-    [TOKEN_BANG]          = {unary,    NULL,   PREC_NONE},
-    [TOKEN_BANG_EQUAL]    = {NULL,     binary, PREC_EQUALITY},
-    [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_EQUAL_EQUAL]   = {NULL,     binary, PREC_EQUALITY},
-    [TOKEN_GREATER]       = {NULL,     binary, PREC_COMPARISION},
-    [TOKEN_GREATER_EQUAL] = {NULL,     binary, PREC_COMPARISION},
-    [TOKEN_LESS]          = {NULL,     binary, PREC_COMPARISION},
-    [TOKEN_LESS_EQUAL]    = {NULL,     binary, PREC_COMPARISION},
-    [TOKEN_IDENTIFIER]    = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_STRING]        = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_NUMBER]        = {number,   NULL,   PREC_NONE},
-    [TOKEN_AND]           = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_FALSE]         = {literal,  NULL,   PREC_NONE},
-    [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_FUN]           = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_NULL]          = {literal,  NULL,   PREC_NONE},
-    [TOKEN_OR]            = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_SUPER]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_THIS]          = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_TRUE]          = {literal,  NULL,   PREC_NONE},
-    [TOKEN_VAR]           = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
-    [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
-};
 
 
+static bool identifiersEqual(Token* a, Token* b) {
+    if (a->length != b->length) return false;
+    return memcmp(a->start, b->start, a->length) == 0;
+}
 
 
 
 /**
- * @brief Parses expressions with the given precedence level.
+ * Resolves a name to the stack slot of a local variable.
  *
- * This function processes expressions in the source code that match or exceed
- * the specified precedence level. It is used to handle different levels of
- * operator precedence during the parsing phase of the compiler.
+ * The locals array mirrors the runtime stack, so the index of the innermost
+ * matching declaration is the slot. Walking backwards gives shadowing.
  *
- * @param precedence The precedence level to parse expressions for.
+ * @return The slot index, or -1 if the name is not a local (i.e. a global).
  */
-static void parsePrecedence(Precedence precedence) {
-    advance();
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
-    if (prefixRule == NULL) {
-        printf("NULL prefix function for token: %d\n", parser.previous.type);
-        error("Expect expression.");
-        return;
+static int resolveLocal(Compiler* compiler, Token* name) {
+    for (int i = compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &compiler->locals[i];
+        if (identifiersEqual(name, &local->name)) {
+            if (local->depth == -1) {
+                error("Can't read local variable in its own initializer.");
+            }
+            return i;
+        }
     }
 
-    prefixRule();
+    return -1;
+}
+
 
 
-    while (precedence <= getRule(parser.current.type)->precedence) {
-        advance();
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule();
+static int addUpvalue(Compiler* compiler, uint16_t index, bool isLocal) {
+    int upvalueCount = compiler->function->upvalueCount;
+    for (int i = 0; i < upvalueCount; i++) {
+        Upvalue* upvalue = &compiler->upvalues[i];
+        if (upvalue->index == index && upvalue->isLocal == isLocal) return i;
     }
 
+    if (upvalueCount == UINT8_COUNT) {
+        error("Too many closure variables in function.");
+        return 0;
+    }
+
+    compiler->upvalues[upvalueCount] = (Upvalue){.index = index, .isLocal = isLocal, .escapes = false};
+    return compiler->function->upvalueCount++;
 }
 
 
 
+/**
+ * Resolves a name to a local of an enclosing function, captured by the
+ * function of `compiler` and by every function in between.
+ *
+ * @param origin Set to the local that was found, in the compiler declaring it.
+ * @return The capture index, or -1 if no enclosing function has the local.
+ */
+static int resolveUpvalue(Compiler* compiler, Token* name, Local** origin) {
+    if (compiler->enclosing == NULL) return -1;
+
+    int local = resolveLocal(compiler->enclosing, name);
+    if (local != -1) {
+        *origin = &compiler->enclosing->locals[local];
+        (*origin)->isCaptured = true;
+        // a local function naming itself captures its slot before the closure is in it
+        if (local == compiler->selfSlot) (*origin)->isAssigned = true;
+        return addUpvalue(compiler, (uint16_t)local, true);
+    }
 
-static ParseRule* getRule(TokenType type) {
-    return &rules[type];
+    int upvalue = resolveUpvalue(compiler->enclosing, name, origin);
+    if (upvalue != -1) return addUpvalue(compiler, (uint16_t)upvalue, false);
+    return -1;
 }
 
 
 
+// emit a read or (if followed by '=') a write of the named variable
+static void namedVariable(Token name, bool canAssign) {
+    uint8_t getOp, getLongOp, setOp, setLongOp;
+    Local* local = NULL;        // the variable, if it is a local here or further out
+    int arg = resolveLocal(current, &name);
+    bool captured = false;
+    current->calleeSlot = -1;
+    current->inlineCallee = NULL;
+
+    if (arg != -1) {
+        // locals are plain stack slots -> no hash lookup at runtime
+        local = &current->locals[arg];
+        getOp = OP_GET_LOCAL;  getLongOp = OP_GET_LOCAL_LONG;
+        setOp = OP_SET_LOCAL;  setLongOp = OP_SET_LOCAL_LONG;
+    } else if ((arg = resolveUpvalue(current, &name, &local)) != -1) {
+        captured = true;
+        getOp = OP_GET_UPVALUE; getLongOp = OP_GET_UPVALUE;     // at most 256 of them
+        setOp = OP_SET_UPVALUE; setLongOp = OP_SET_UPVALUE;
+    } else {
+        arg = identifierConstant(&name);
+        getOp = OP_GET_GLOBAL; getLongOp = OP_GET_GLOBAL_LONG;
+        setOp = OP_SET_GLOBAL; setLongOp = OP_SET_GLOBAL_LONG;
+    }
 
-static void expression() {
-    parsePrecedence(PREC_ASSIGNMENT);
+    if (canAssign && match(TOKEN_EQUAL)) {
+        if (local != NULL) local->isAssigned = true;
+        expression();
+        emitIndexed(setOp, setLongOp, arg);
+        return;
+    }
+
+    emitIndexed(getOp, getLongOp, arg);
+    if (check(TOKEN_LEFT_PAREN)) {
+        // a function known here, unless the variable was assigned something
+        // else by then (OP_INLINE_GUARD checks)
+        Value function;
+        if (getOp == OP_GET_LOCAL) {
+            current->inlineCallee = local->inlined;
+        } else if (getOp == OP_GET_GLOBAL &&
+                   tableGet(&inlinable, AS_STRING(currentChunk()->constants.values[arg]), &function)) {
+            current->inlineCallee = AS_FUNCTION(function);
+        }
+    }
+    if (local == NULL) return;
+
+    // calling a local function here, or a function calling itself, doesn't
+    // let the closure out; any other use might
+    bool self = captured && current->selfSlot != -1 &&
+                local == &current->enclosing->locals[current->selfSlot];
+    if (!check(TOKEN_LEFT_PAREN) || (captured && !self)) {
+        local->escapes = true;
+    } else if (!captured) {
+        current->calleeSlot = arg;
+    }
 }
 
 
 
+static void variable(bool canAssign) {
+    namedVariable(parser.previous, canAssign);
+}
+
+
 
 /**
- * @brief Compiles the given source code into a chunk of bytecode.
- *
- * This function takes the source code as input and compiles it into a 
- * Chunk structure, which contains the bytecode representation of the 
- * source code. The compilation process involves lexical analysis, 
- * parsing, and code generation.
+ * Adds an inline cache for a property instruction on `name`.
  *
- * @param source The source code to be compiled.
- * @param chunk A pointer to the Chunk structure where the compiled 
- *              bytecode will be stored.
- * @return true if the compilation was successful, false otherwise.
+ * The name goes through the constant table too, which keeps it alive
+ * while the cache array grows.
  */
-bool compile(const char *source, Chunk* chunk) {
-    initScanner(source);
-    compilingChunk = chunk;
+static int propertyCache(Token* name) {
+    int constant = identifierConstant(name);
+    Value string = currentChunk()->constants.values[constant];
+    int cache = addInlineCache(currentChunk(), AS_STRING(string));
+    if (cache > UINT16_MAX) error("Too many property accesses in one chunk.");
+    return cache;
+}
 
-    parser.hadError = false;
-    parser.panicMode = false;
 
-    advance();
-    expression();
-    consume(TOKEN_EOF, "Expect end of expression.");
-    endCompiler();
-    
-    return !parser.hadError;
-}
\ No newline at end of file
+
+static void emitCached(uint8_t op, int cache) {
+    emitByte(op);
+    emitBytes((cache >> 8) & 0xff, cache & 0xff);
+}
+
+
+
+// bytes of code before its return a function may have and still be inlined
+#define INLINE_MAX 40
+
+// what stackEffect() says about instructions an inlined body can't have
+#define NOT_INLINABLE INT_MIN
+
+
+/**
+ * How much the instruction at `offset` changes the height of the stack,
+ * for the instructions a body to be inlined may contain.
+ *
+ * @return The change, or NOT_INLINABLE.
+ */
+static int stackEffect(Chunk* chunk, int offset) {
+    switch (chunk->code[offset]) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NULL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_GET_GLOBAL_LONG:
+        case OP_GET_ARGUMENT:
+            return 1;
+
+        case OP_SET_LOCAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_LONG:
+        case OP_SET_ARGUMENT:
+        case OP_GET_PROPERTY:
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_INLINE_GUARD:
+            return 0;
+
+        case OP_POP:
+        case OP_SET_PROPERTY:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_PRINT:
+            return -1;
+
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            return -chunk->code[offset + 1];
+        case OP_INVOKE:
+            return -chunk->code[offset + 3];
+        case OP_INLINE_RETURN:
+            return -(chunk->code[offset + 1] + 1);
+
+        default:
+            return NOT_INLINABLE;
+    }
+}
+
+
+
+// a jump lands on `target` with the stack `height` high; every other one landing there must agree
+static bool arriveAt(int* heights, int count, int target, int height) {
+    if (target >= count) return false;
+    if (heights[target] != -1 && heights[target] != height) return false;
+    heights[target] = height;
+    return true;
+}
+
+
+
+/**
+ * Works out whether calls of `function` can be replaced by its body.
+ *
+ * The body has to come down to `return <expression>;` (statements ahead of
+ * the return are fine as long as they leave nothing behind): straight-line
+ * code with no locals of its own, plus the forward jumps of `and`, `or`
+ * and calls inlined into it, which must all land where the stack is as high
+ * as where they left from. The height of the stack at every instruction is
+ * then known; inlined, a parameter is addressed by its distance from the
+ * stack top, which depends on it. A function that reads its own global
+ * (calls itself) is never inlined.
+ *
+ * @return The length of the code before its OP_RETURN, or -1.
+ */
+static int inlinableLength(ObjFunction* function) {
+    Chunk* chunk = &function->chunk;
+    if (function->upvalueCount > 0 || chunk->count > INLINE_MAX + 3) return -1;
+    if (chunk->handlerCount > 0) return -1;     // its handlers are for its own frame
+
+    int heights[INLINE_MAX + 3];        // at each jump target, -1 if no jump lands there
+    for (int i = 0; i < chunk->count; i++) heights[i] = -1;
+
+    int height = 0;
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        uint8_t* code = &chunk->code[offset];
+        if (heights[offset] != -1 && heights[offset] != height) return -1;
+
+        switch (code[0]) {
+            case OP_RETURN:
+                // the value, then at most the `return null;` every function ends in
+                if (height != 1 || offset > INLINE_MAX) return -1;
+                if (chunk->count != offset + 1 && chunk->count != offset + 3) return -1;
+                for (int i = offset + 1; i < chunk->count; i++) {
+                    if (heights[i] != -1) return -1;
+                }
+                return offset;
+
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                // parameters only, at a distance that fits the operand
+                if (code[1] == 0 || code[1] > function->arity) return -1;
+                if (height + function->arity - code[1] > UINT8_MAX) return -1;
+                break;
+
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG: {
+                int index = code[0] == OP_GET_GLOBAL ? code[1] : (code[1] << 16) | (code[2] << 8) | code[3];
+                if (AS_STRING(chunk->constants.values[index]) == function->name) return -1;
+                break;
+            }
+
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+                if (!arriveAt(heights, chunk->count, offset + 3 + ((code[1] << 8) | code[2]), height)) {
+                    return -1;
+                }
+                break;
+
+            case OP_INLINE_GUARD:
+                // a call made instead leaves its result in place of the callee and arguments
+                if (!arriveAt(heights, chunk->count, offset + 7 + ((code[5] << 8) | code[6]), height - code[1])) {
+                    return -1;
+                }
+                break;
+        }
+
+        int effect = stackEffect(chunk, offset);
+        if (effect == NOT_INLINABLE) return -1;
+        height += effect;
+    }
+    return -1;
+}
+
+
+
+// emitIndexed() for code copied from another function, which keeps its line
+static void copyIndexed(uint8_t op, uint8_t longOp, int index, int line) {
+    Chunk* chunk = currentChunk();
+    if (index <= UINT8_MAX) {
+        writeChunk(chunk, op, line);
+        writeChunk(chunk, (uint8_t)index, line);
+    } else {
+        writeChunk(chunk, longOp, line);
+        writeChunk(chunk, (index >> 16) & 0xFF, line);
+        writeChunk(chunk, (index >> 8) & 0xFF, line);
+        writeChunk(chunk, index & 0xFF, line);
+    }
+}
+
+
+
+/**
+ * Copies the first `length` bytes of `function`'s code, its body less the
+ * return, to the end of the current chunk.
+ *
+ * Constants, global names and inline caches are made again in this chunk,
+ * parameters become OP_GET_ARGUMENT / OP_SET_ARGUMENT, and jumps are moved
+ * along with the instructions they land on, which can change size. Each
+ * instruction keeps the line it had, and calls that were inlined into the
+ * body are recorded here as well.
+ */
+static void copyBody(ObjFunction* function, int length) {
+    Chunk* from = &function->chunk;
+    Chunk* to = currentChunk();
+    int moved[INLINE_MAX + 1];      // where each instruction went
+    int jumps[INLINE_MAX];          // the operands of the jumps copied...
+    int targets[INLINE_MAX];        // ... and where they landed in `from`
+    int jumpCount = 0;
+    int height = 0;
+
+    for (int offset = 0; offset < length; offset += instructionLength(from, offset)) {
+        uint8_t* code = &from->code[offset];
+        int line = getLine(from, offset);
+        moved[offset] = to->count;
+
+        switch (code[0]) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG: {
+                int index = code[0] == OP_CONSTANT ? code[1] : (code[1] << 16) | (code[2] << 8) | code[3];
+                copyIndexed(OP_CONSTANT, OP_CONSTANT_LONG, makeConstant(from->constants.values[index]), line);
+                break;
+            }
+
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG:
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG: {
+                bool get = code[0] == OP_GET_GLOBAL || code[0] == OP_GET_GLOBAL_LONG;
+                bool wide = code[0] == OP_GET_GLOBAL_LONG || code[0] == OP_SET_GLOBAL_LONG;
+                int index = wide ? (code[1] << 16) | (code[2] << 8) | code[3] : code[1];
+                int name = stringConstant(AS_STRING(from->constants.values[index]));
+                if (get) {
+                    copyIndexed(OP_GET_GLOBAL, OP_GET_GLOBAL_LONG, name, line);
+                } else {
+                    copyIndexed(OP_SET_GLOBAL, OP_SET_GLOBAL_LONG, name, line);
+                }
+                break;
+            }
+
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                writeChunk(to, code[0] == OP_GET_LOCAL ? OP_GET_ARGUMENT : OP_SET_ARGUMENT, line);
+                writeChunk(to, (uint8_t)(height + function->arity - code[1]), line);
+                break;
+
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            case OP_INVOKE: {
+                ObjString* name = from->caches[(code[1] << 8) | code[2]].name;
+                stringConstant(name);       // keeps the name alive, as propertyCache() does
+                int cache = addInlineCache(to, name);
+                if (cache > UINT16_MAX) error("Too many property accesses in one chunk.");
+                writeChunk(to, code[0], line);
+                writeChunk(to, (cache >> 8) & 0xff, line);
+                writeChunk(to, cache & 0xff, line);
+                if (code[0] == OP_INVOKE) writeChunk(to, code[3], line);
+                break;
+            }
+
+            case OP_TAIL_CALL:
+                // the return it stood for is the caller carrying on
+                writeChunk(to, OP_CALL, line);
+                writeChunk(to, code[1], line);
+                break;
+
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+                writeChunk(to, code[0], line);
+                jumps[jumpCount] = to->count;
+                targets[jumpCount++] = offset + 3 + ((code[1] << 8) | code[2]);
+                writeChunk(to, 0xff, line);
+                writeChunk(to, 0xff, line);
+                break;
+
+            case OP_INLINE_GUARD: {
+                int index = (code[2] << 16) | (code[3] << 8) | code[4];
+                int constant = makeConstant(from->constants.values[index]);
+                writeChunk(to, code[0], line);
+                writeChunk(to, code[1], line);
+                writeChunk(to, (constant >> 16) & 0xff, line);
+                writeChunk(to, (constant >> 8) & 0xff, line);
+                writeChunk(to, constant & 0xff, line);
+                jumps[jumpCount] = to->count;
+                targets[jumpCount++] = offset + 7 + ((code[5] << 8) | code[6]);
+                writeChunk(to, 0xff, line);
+                writeChunk(to, 0xff, line);
+                break;
+            }
+
+            default:
+                for (int i = 0; i < instructionLength(from, offset); i++) {
+                    writeChunk(to, code[i], line);
+                }
+                break;
+        }
+
+        height += stackEffect(from, offset);
+    }
+    moved[length] = to->count;
+
+    for (int i = 0; i < jumpCount; i++) {
+        int jump = moved[targets[i]] - jumps[i] - 2;
+        to->code[jumps[i]] = (jump >> 8) & 0xff;
+        to->code[jumps[i] + 1] = jump & 0xff;
+    }
+
+    for (int i = 0; i < from->inlinedCount; i++) {
+        InlinedCall* call = &from->inlined[i];
+        addInlinedCall(to, moved[call->start], moved[call->end], call->function, call->line);
+    }
+}
+
+
+
+/**
+ * Compiles a call of `function`, whose arguments were just compiled, by
+ * copying its body in (see inlinableLength() for which bodies can be).
+ *
+ * The callee was still read from its variable, which could hold another
+ * function by the time this runs, so the body is guarded:
+ *
+ *     OP_INLINE_GUARD  argCount function -> end   ; anything else is called
+ *     <body>                                       ; arguments on the stack
+ *     OP_INLINE_RETURN argCount
+ *   end:
+ *
+ * That saves the frame push, the arguments' window and the return.
+ */
+static void inlineCall(ObjFunction* function, uint8_t argCount) {
+    int line = parser.previous.line;
+    int constant = makeConstant(OBJ_VAL(function));
+    emitBytes(OP_INLINE_GUARD, argCount);
+    emitBytes((constant >> 16) & 0xff, (constant >> 8) & 0xff);
+    emitByte(constant & 0xff);
+    emitBytes(0xff, 0xff);
+    int skip = currentChunk()->count - 2;
+
+    int start = currentChunk()->count;
+    copyBody(function, inlinableLength(function));
+    int end = currentChunk()->count;
+    emitBytes(OP_INLINE_RETURN, argCount);
+
+    patchJump(skip);
+    addInlinedCall(currentChunk(), start, end, function, line);
+}
+
+
+
+// infix parser for '.' -> a property read, a store if followed by '=', or
+// a method call if followed by '('
+static void dot(bool canAssign) {
+    consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+    int cache = propertyCache(&parser.previous);
+
+    if (canAssign && match(TOKEN_EQUAL)) {
+        expression();
+        emitCached(OP_SET_PROPERTY, cache);
+    } else if (match(TOKEN_LEFT_PAREN)) {
+        uint8_t argCount = argumentList();
+        emitCached(OP_INVOKE, cache);
+        emitByte(argCount);
+    } else {
+        emitCached(OP_GET_PROPERTY, cache);
+    }
+}
+
+
+
+// `this` is the receiver in slot 0 of a method, captured like any other
+// local by functions nested in it; it can't be assigned to
+static void this_(bool canAssign) {
+    (void)canAssign;
+    if (currentClass == NULL) {
+        error("Can't use 'this' outside of a class.");
+        return;
+    }
+    variable(false);
+}
+
+
+
+/**
+ * `super.name` or `super.name(args)` -> a method of the superclass of the
+ * class being declared, on `this`.
+ *
+ * Which class that is gets worked out at run time from the receiver's
+ * class (see superMethod() in vm.c) and cached at the call site.
+ */
+static void super_(bool canAssign) {
+    (void)canAssign;
+    if (currentClass == NULL) {
+        error("Can't use 'super' outside of a class.");
+    } else if (current->type != TYPE_METHOD && current->type != TYPE_INITIALIZER) {
+        // the method is what identifies the class, and a nested function isn't one
+        error("Can't use 'super' in a function nested in a method.");
+    } else if (!currentClass->hasSuperclass) {
+        error("Can't use 'super' in a class with no superclass.");
+    }
+
+    consume(TOKEN_DOT, "Expect '.' after 'super'.");
+    consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+    int cache = propertyCache(&parser.previous);
+
+    emitBytes(OP_GET_LOCAL, 0);
+    if (match(TOKEN_LEFT_PAREN)) {
+        uint8_t argCount = argumentList();
+        emitCached(OP_SUPER_INVOKE, cache);
+        emitByte(argCount);
+    } else {
+        emitCached(OP_GET_SUPER, cache);
+    }
+}
+
+
+
+// compiling unary expression
+static void unary(bool canAssign) {
+    (void)canAssign;
+    TokenType operatorType = parser.previous.type;
+
+    // Compile the operand.
+    parsePrecedence(PREC_UNARY);
+
+    // Emit the operator instruction
+    switch (operatorType) {
+        case TOKEN_BANG:  emitByte(OP_NOT); break;
+        case TOKEN_MINUS: emitByte(OP_NEGATE); break;
+        default: return;    // Unreachable
+    }
+}
+
+
+
+
+/**
+ * An array of ParseRule structures that define the parsing rules for the compiler.
+ */
+ParseRule rules[] = {
+    [TOKEN_LEFT_PAREN]    = {grouping, call,   PREC_CALL},
+    [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, 
+    [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_DOT]           = {NULL,     dot,    PREC_CALL},
+    [TOKEN_MINUS]         = {unary,    binary, PREC_TERM},
+    [TOKEN_PLUS]          = {NULL,     binary, PREC_TERM},
+    [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_SLASH]         = {NULL,     binary, PREC_FACTOR},
+    [TOKEN_ASTERISK]      = {NULL,     binary, PREC_FACTOR},
+    [TOKEN_BANG]          = {unary,    NULL,   PREC_NONE},
+    [TOKEN_BANG_EQUAL]    = {NULL,     binary, PREC_EQUALITY},
+    [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_EQUAL_EQUAL]   = {NULL,     binary, PREC_EQUALITY},
+    [TOKEN_GREATER]       = {NULL,     binary, PREC_COMPARISION},
+    [TOKEN_GREATER_EQUAL] = {NULL,     binary, PREC_COMPARISION},
+    [TOKEN_LESS]          = {NULL,     binary, PREC_COMPARISION},
+    [TOKEN_LESS_EQUAL]    = {NULL,     binary, PREC_COMPARISION},
+    [TOKEN_IDENTIFIER]    = {variable, NULL,   PREC_NONE},
+    [TOKEN_STRING]        = {string,   NULL,   PREC_NONE},
+    [TOKEN_NUMBER]        = {number,   NULL,   PREC_NONE},
+    [TOKEN_AND]           = {NULL,     and_,   PREC_AND},
+    [TOKEN_CATCH]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_FALSE]         = {literal,  NULL,   PREC_NONE},
+    [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_FUN]           = {lambda,   NULL,   PREC_NONE},
+    [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_NULL]          = {literal,  NULL,   PREC_NONE},
+    [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
+    [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_SUPER]         = {super_,   NULL,   PREC_NONE},
+    [TOKEN_THIS]          = {this_,    NULL,   PREC_NONE},
+    [TOKEN_THROW]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_TRUE]          = {literal,  NULL,   PREC_NONE},
+    [TOKEN_TRY]           = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_VAR]           = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
+    [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
+};
+
+
+
+
+
+/**
+ * @brief Parses expressions with the given precedence level.
+ *
+ * This function processes expressions in the source code that match or exceed
+ * the specified precedence level. It is used to handle different levels of
+ * operator precedence during the parsing phase of the compiler.
+ *
+ * @param precedence The precedence level to parse expressions for.
+ */
+static void parsePrecedence(Precedence precedence) {
+    advance();
+    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+    if (prefixRule == NULL) {
+        printf("NULL prefix function for token: %d\n", parser.previous.type);
+        error("Expect expression.");
+        return;
+    }
+
+    // only a low-precedence context may treat a following '=' as assignment
+    bool canAssign = precedence <= PREC_ASSIGNMENT;
+    prefixRule(canAssign);
+
+
+    while (precedence <= getRule(parser.current.type)->precedence) {
+        advance();
+        ParseFn infixRule = getRule(parser.previous.type)->infix;
+        infixRule(canAssign);
+    }
+
+    if (canAssign && match(TOKEN_EQUAL)) {
+        error("Invalid assignment target.");
+    }
+
+}
+
+
+
+
+static ParseRule* getRule(TokenType type) {
+    return &rules[type];
+}
+
+
+
+
+static void expression() {
+    parsePrecedence(PREC_ASSIGNMENT);
+}
+
+
+
+static void block() {
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+        declaration();
+    }
+
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+
+
+static void addLocal(Token name) {
+    if (current->localCount == LOCALS_MAX) {
+        error("Too many local variables in function.");
+        return;
+    }
+
+    if (current->localCount + 1 > current->localCapacity) {
+        int oldCapacity = current->localCapacity;
+        current->localCapacity = GROW_CAPACITY(oldCapacity);
+        current->locals = GROW_ARRAY(Local, current->locals, oldCapacity, current->localCapacity);
+    }
+
+    Local* local = &current->locals[current->localCount++];
+    local->name = name;
+    local->depth = -1;      // declared, but not usable until its initializer ran
+    local->isCaptured = false;
+    local->isAssigned = false;
+    local->capturedByEscaping = false;
+    local->escapes = false;
+    local->closure = -1;
+    local->inlined = NULL;
+}
+
+
+
+// record a local declaration; globals are late bound and need nothing here
+static void declareVariable() {
+    if (current->scopeDepth == 0) return;
+
+    Token* name = &parser.previous;
+    for (int i = current->localCount - 1; i >= 0; i--) {
+        Local* local = &current->locals[i];
+        if (local->depth != -1 && local->depth < current->scopeDepth) {
+            break;
+        }
+
+        if (identifiersEqual(name, &local->name)) {
+            error("Already a variable with this name in this scope.");
+        }
+    }
+
+    addLocal(*name);
+}
+
+
+
+static int parseVariable(const char* errorMessage) {
+    consume(TOKEN_IDENTIFIER, errorMessage);
+
+    declareVariable();
+    if (current->scopeDepth > 0) return 0;
+
+    return identifierConstant(&parser.previous);
+}
+
+
+
+static void markInitialized() {
+    if (current->scopeDepth == 0) return;   // globals are defined by OP_DEFINE_GLOBAL
+    current->locals[current->localCount - 1].depth = current->scopeDepth;
+}
+
+
+
+static void defineVariable(int global) {
+    if (current->scopeDepth > 0) {
+        // the initializer's value is already sitting in the local's slot
+        markInitialized();
+        return;
+    }
+
+    emitIndexed(OP_DEFINE_GLOBAL, OP_DEFINE_GLOBAL_LONG, global);
+}
+
+
+
+/**
+ * Emits the OP_CLOSURE for `function`, just compiled by `compiler`.
+ *
+ * Captures of this function's own locals go out as CAPTURE_LOCAL, to be
+ * patched by captureKind() when the local's scope ends. The offset of the
+ * instruction is recorded for that.
+ *
+ * @return The offset of the instruction.
+ */
+static int emitClosure(Compiler* compiler, ObjFunction* function) {
+    int offset = currentChunk()->count;
+    emitIndexed(OP_CLOSURE, OP_CLOSURE_LONG, makeConstant(OBJ_VAL(function)));
+
+    for (int i = 0; i < function->upvalueCount; i++) {
+        Upvalue* upvalue = &compiler->upvalues[i];
+        emitByte(upvalue->isLocal ? CAPTURE_LOCAL : CAPTURE_UPVALUE);
+        emitBytes((upvalue->index >> 8) & 0xff, upvalue->index & 0xff);
+        if (upvalue->escapes) markEscaping(upvalue->index, upvalue->isLocal);
+    }
+
+    if (current->closureCount + 1 > current->closureCapacity) {
+        int oldCapacity = current->closureCapacity;
+        current->closureCapacity = GROW_CAPACITY(oldCapacity);
+        current->closures = GROW_ARRAY(int, current->closures, oldCapacity, current->closureCapacity);
+    }
+    current->closures[current->closureCount++] = offset;
+    return offset;
+}
+
+
+
+// (params) { body } -> the function of the current compiler, which it ends
+static ObjFunction* functionBody() {
+    beginScope();
+
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            current->function->arity++;
+            if (current->function->arity > 255) {
+                errorAtCurrent("Can't have more than 255 parameters.");
+            }
+            int constant = parseVariable("Expect parameter name.");
+            defineVariable(constant);
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+    block();
+
+    // no endScope(): the whole frame is discarded by OP_RETURN
+    return endCompiler();
+}
+
+
+
+/**
+ * Compiles a function's parameter list and body into a new ObjFunction.
+ *
+ * The body gets its own Compiler, so its locals start again at slot 1. The
+ * finished function is stored as a constant of the enclosing chunk; one
+ * that captured variables is wrapped in a closure when this code runs.
+ *
+ * @return The function.
+ */
+static ObjFunction* function(FunctionType type) {
+    // a local function declaration is in the local just declared
+    int selfSlot = type == TYPE_FUNCTION && current->scopeDepth > 0 ? current->localCount - 1 : -1;
+
+    Compiler compiler;
+    initCompiler(&compiler, type, NULL);
+    compiler.selfSlot = selfSlot;
+
+    ObjFunction* function = functionBody();
+    if (function->upvalueCount == 0) {
+        emitConstant(OBJ_VAL(function));
+        return function;
+    }
+
+    int closure = emitClosure(&compiler, function);
+    if (selfSlot != -1) {
+        // whether it escapes is known once the scope of its name ends
+        current->locals[selfSlot].closure = closure;
+    } else {
+        // lambdas and methods are values from the start
+        closureEscapes(closure);
+    }
+    return function;
+}
+
+
+
+// prefix parser for an anonymous function -> fn (params) { body }
+static void lambda(bool canAssign) {
+    (void)canAssign;
+    function(TYPE_LAMBDA);
+}
+
+
+
+/**
+ * Compiles one method of a class body -> `name(params) { body }`.
+ *
+ * A leading `fn` is allowed, so methods may be written like functions.
+ * The class is on the stack below the method; OP_METHOD attaches it.
+ */
+static void method() {
+    match(TOKEN_FUN);
+    consume(TOKEN_IDENTIFIER, "Expect method name.");
+    int constant = identifierConstant(&parser.previous);
+
+    FunctionType type = TYPE_METHOD;
+    if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
+        type = TYPE_INITIALIZER;
+    }
+    function(type);
+    emitIndexed(OP_METHOD, OP_METHOD_LONG, constant);
+}
+
+
+
+static void classDeclaration() {
+    consume(TOKEN_IDENTIFIER, "Expect class name.");
+    Token className = parser.previous;
+    int nameConstant = identifierConstant(&parser.previous);
+    declareVariable();
+
+    emitIndexed(OP_CLASS, OP_CLASS_LONG, nameConstant);
+    defineVariable(nameConstant);
+
+    ClassCompiler classCompiler;
+    classCompiler.enclosing = currentClass;
+    classCompiler.hasSuperclass = false;
+    currentClass = &classCompiler;
+
+    // class Name < Superclass
+    if (match(TOKEN_LESS)) {
+        consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+        variable(false);
+        if (identifiersEqual(&className, &parser.previous)) {
+            error("A class can't inherit from itself.");
+        }
+
+        namedVariable(className, false);
+        emitByte(OP_INHERIT);
+        classCompiler.hasSuperclass = true;
+    }
+
+    // the methods are attached to the class while it sits on the stack
+    namedVariable(className, false);
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+        method();
+    }
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+    emitByte(OP_POP);
+
+    currentClass = currentClass->enclosing;
+}
+
+
+
+// bodies shorter than this (in tokens) are compiled where they are declared:
+// that costs next to nothing, and only a compiled body can be inlined
+#define LAZY_MIN_TOKENS 48
+
+
+/**
+ * Declares a function whose body is compiled on its first call.
+ *
+ * Only the parameter list is parsed. The body is skipped by matching its
+ * braces token by token, so braces in strings and comments don't count,
+ * and its text is kept for compileLazy(). Only global functions declared
+ * at the top of the script are deferred: no local is in scope there for
+ * them to capture, so compiled later they resolve every name the same way.
+ *
+ * @param name The function's name.
+ * @return false if the body turned out short; the scanner is then back at
+ *         the parameter list, to compile it right away.
+ */
+static bool deferFunction(Token name) {
+    const char* start = parser.current.start;
+    int line = parser.current.line;
+    int arity = 0;
+
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            if (++arity > 255) errorAtCurrent("Can't have more than 255 parameters.");
+            consume(TOKEN_IDENTIFIER, "Expect parameter name.");
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+
+    int depth = 1;
+    int tokens = 0;
+    while (depth > 0 && !check(TOKEN_EOF)) {
+        if (check(TOKEN_LEFT_BRACE)) depth++;
+        if (check(TOKEN_RIGHT_BRACE)) depth--;
+        tokens++;
+        advance();
+    }
+    if (depth > 0) errorAtCurrent("Expect '}' after block.");
+    if (parser.hadError) return true;       // nothing will run
+
+    if (tokens < LAZY_MIN_TOKENS) {
+        initScannerAt(start, line);
+        advance();
+        parser.previous = name;             // function() names the function after it
+        return false;
+    }
+
+    ObjFunction* function = newFunction();
+    push(OBJ_VAL(function));                // naming it may collect
+    function->name = viewString(name.start, name.length);
+    writeBarrier((Obj*)function, OBJ_VAL(function->name));
+    function->arity = arity;
+    function->lazySource = start;
+    function->lazyLength = (int)(parser.previous.start + 1 - start);
+    function->lazyLine = line;
+    emitConstant(OBJ_VAL(function));
+    pop();
+
+    tableDelete(&inlinable, function->name);    // an earlier one of the same name might be
+    return true;
+}
+
+
+
+static void funDeclaration() {
+    bool noinline = parser.previous.noinline;
+    int global = parseVariable("Expect function name.");
+    markInitialized();      // a function may refer to itself (recursion)
+
+    // a global function of the script waits for its first call, unless --strict
+    if (!vm.strict && current->type == TYPE_SCRIPT && current->scopeDepth == 0 &&
+        deferFunction(parser.previous)) {
+        defineVariable(global);
+        return;
+    }
+
+    ObjFunction* body = function(TYPE_FUNCTION);
+
+    // calls compiled from here on may copy the body in, unless `// @noinline` says not to
+    bool canInline = !noinline && !parser.hadError && inlinableLength(body) != -1;
+    if (current->scopeDepth > 0) {
+        current->locals[current->localCount - 1].inlined = canInline ? body : NULL;
+    } else if (canInline) {
+        tableSet(&inlinable, body->name, OBJ_VAL(body));
+    } else {
+        tableDelete(&inlinable, body->name);     // an earlier one of the same name might be
+    }
+    defineVariable(global);
+}
+
+
+
+// var name (= initializer)? ;
+static void varDeclaration() {
+    int global = parseVariable("Expect variable name.");
+
+    if (match(TOKEN_EQUAL)) {
+        expression();
+    } else {
+        emitByte(OP_NULL);
+    }
+    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+
+    defineVariable(global);
+}
+
+
+
+// an expression evaluated for its side effect; the result is discarded
+static void expressionStatement() {
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+    emitByte(OP_POP);
+}
+
+
+
+// if (condition) statement (else statement)?
+static void ifStatement() {
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+    expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    bool fused;
+    int thenJump = conditionJump(&fused);
+    if (!fused) emitByte(OP_POP);   // discard the condition on the 'then' path
+    statement();
+
+    int elseJump = emitJump(OP_JUMP);
+
+    patchJump(thenJump);
+    if (!fused) emitByte(OP_POP);   // ... and on the 'else' path
+
+    if (match(TOKEN_ELSE)) statement();
+    patchJump(elseJump);
+}
+
+
+
+// while (condition) statement
+static void whileStatement() {
+    int loopStart = currentChunk()->count;
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+    expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    bool fused;
+    int exitJump = conditionJump(&fused);
+    if (!fused) emitByte(OP_POP);
+    statement();
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    if (!fused) emitByte(OP_POP);
+}
+
+
+
+/**
+ * Whether code[start, end) is `counter < limit` with the limit in a local
+ * or a constant (the shape a counted loop's condition compiles to).
+ */
+static bool isCountedCondition(int start, int end, int counter) {
+    uint8_t* code = currentChunk()->code;
+    return end - start == 5 &&
+           code[start] == OP_GET_LOCAL && code[start + 1] == counter &&
+           (code[start + 2] == OP_GET_LOCAL || code[start + 2] == OP_CONSTANT) &&
+           code[start + 4] == OP_LESS;
+}
+
+
+
+// whether code[start, end) is `counter = counter + 1;`
+static bool isCountedIncrement(int start, int end, int counter) {
+    Chunk* chunk = currentChunk();
+    uint8_t* code = chunk->code;
+    if (end - start != 8) return false;
+    if (code[start] != OP_GET_LOCAL || code[start + 1] != counter) return false;
+    if (code[start + 2] != OP_CONSTANT || code[start + 4] != OP_ADD) return false;
+    if (code[start + 5] != OP_SET_LOCAL || code[start + 6] != counter) return false;
+
+    Value step = chunk->constants.values[code[start + 3]];
+    return IS_INT(step) && AS_INT(step) == 1;
+}
+
+
+
+/**
+ * for (initializer; condition; increment) statement
+ *
+ * Generic loops run the increment from a block placed before the body,
+ * jumping around it. The common counted shape
+ *
+ *     for (var i = start; i < limit; i = i + 1) body
+ *
+ * (limit a local or a constant) is recognized from the code its clauses
+ * compiled to; the increment is then taken back out and the loop ends in
+ * a single OP_FOR_INCR_LT that increments, compares and jumps back.
+ */
+static void forStatement() {
+    beginScope();
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+
+    int counter = -1;       // slot of a local declared by the initializer
+    if (match(TOKEN_SEMICOLON)) {
+        // No initializer.
+    } else if (match(TOKEN_VAR)) {
+        varDeclaration();
+        counter = current->localCount - 1;
+    } else {
+        expressionStatement();
+    }
+
+    int loopStart = currentChunk()->count;
+    int exitJump = -1;
+    bool fused = false;
+    bool counted = false;
+    if (!match(TOKEN_SEMICOLON)) {
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+        counted = isCountedCondition(loopStart, currentChunk()->count, counter);
+
+        exitJump = conditionJump(&fused);
+        if (!fused) emitByte(OP_POP);
+    }
+
+    uint8_t limitOp = OP_FOR_INCR_LT;
+    uint8_t limit = 0;
+    if (counted) {
+        limitOp = currentChunk()->code[loopStart + 2] == OP_GET_LOCAL ? OP_FOR_INCR_LT
+                                                                      : OP_FOR_INCR_LT_CONST;
+        limit = currentChunk()->code[loopStart + 3];
+    }
+
+    if (!match(TOKEN_RIGHT_PAREN)) {
+        int bodyJump = emitJump(OP_JUMP);
+        int incrementStart = currentChunk()->count;
+        expression();
+        emitByte(OP_POP);
+        consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+        if (counted && isCountedIncrement(incrementStart, currentChunk()->count, counter)) {
+            truncateChunk(currentChunk(), bodyJump - 1);    // the jump and the increment
+        } else {
+            counted = false;
+            emitLoop(loopStart);
+            loopStart = incrementStart;
+            patchJump(bodyJump);
+        }
+    } else {
+        counted = false;
+    }
+
+    int bodyStart = currentChunk()->count;
+    statement();
+
+    if (counted) {
+        emitByte(limitOp);
+        emitBytes((uint8_t)counter, limit);
+        emitByte(loopNumber());
+        int offset = currentChunk()->count - bodyStart + 2;
+        if (offset > UINT16_MAX) error("Loop body too large.");
+        emitBytes((offset >> 8) & 0xff, offset & 0xff);
+    } else {
+        emitLoop(loopStart);
+    }
+
+    if (exitJump != -1) {
+        patchJump(exitJump);
+        if (!fused) emitByte(OP_POP);
+    }
+
+    endScope();
+}
+
+
+
+static void printStatement() {
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after value.");
+    emitByte(OP_PRINT);
+}
+
+
+
+static void returnStatement() {
+    if (current->type == TYPE_SCRIPT) {
+        error("Can't return from top-level code.");
+    }
+
+    if (match(TOKEN_SEMICOLON)) {
+        emitReturn();
+    } else {
+        if (current->type == TYPE_INITIALIZER) {
+            error("Can't return a value from an initializer.");
+        }
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+
+        // `return f(...)`: the call is the last thing the expression did, so
+        // it can replace this frame instead of stacking a new one on top
+        // (unless a try block here has to catch what it throws)
+        if (current->lastCall == currentChunk()->count - 2 && current->tryDepth == 0) {
+            currentChunk()->code[current->lastCall] = OP_TAIL_CALL;
+            // ... and a local function called that way outlives the frame
+            if (current->lastCallee != -1) current->locals[current->lastCallee].escapes = true;
+        }
+        emitByte(OP_RETURN);    // still needed after natives, which don't replace the frame
+    }
+}
+
+
+
+/**
+ * try { ... } catch (name) { ... }
+ *
+ * Nothing is emitted to enter the try block. Its code range goes into
+ * the chunk's exception table instead, with where the catch block starts
+ * and how many locals are in scope; the VM only reads the table once
+ * something throws (see catchException() in vm.c). The catch block
+ * starts with the exception in the slot of its variable.
+ */
+static void tryStatement() {
+    int height = current->localCount;
+    int start = currentChunk()->count;
+
+    consume(TOKEN_LEFT_BRACE, "Expect '{' after 'try'.");
+    current->tryDepth++;
+    beginScope();
+    block();
+    endScope();
+    current->tryDepth--;
+
+    int end = currentChunk()->count;
+    int exitJump = emitJump(OP_JUMP);
+
+    consume(TOKEN_CATCH, "Expect 'catch' after try block.");
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'catch'.");
+    consume(TOKEN_IDENTIFIER, "Expect exception variable name.");
+    Token name = parser.previous;
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after exception variable.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before catch block.");
+
+    // reached from wherever the try block throws, so nothing before it
+    // may be fused with what follows
+    int handler = currentChunk()->count;
+    current->jumpTarget = handler;
+    addExceptionHandler(currentChunk(), start, end, handler, height);
+
+    beginScope();
+    addLocal(name);
+    markInitialized();
+    block();
+    endScope();
+
+    patchJump(exitJump);
+}
+
+
+
+static void throwStatement() {
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after thrown value.");
+    emitByte(OP_THROW);
+}
+
+
+
+/**
+ * @brief Skips tokens until a likely statement boundary after an error.
+ *
+ * Leaves panic mode so that the next error is reported again, which keeps one
+ * syntax error from producing a cascade of follow-on messages.
+ */
+static void synchronize() {
+    parser.panicMode = false;
+
+    while (parser.current.type != TOKEN_EOF) {
+        if (parser.previous.type == TOKEN_SEMICOLON) return;
+        switch (parser.current.type) {
+            case TOKEN_CLASS:
+            case TOKEN_FUN:
+            case TOKEN_VAR:
+            case TOKEN_FOR:
+            case TOKEN_IF:
+            case TOKEN_WHILE:
+            case TOKEN_PRINT:
+            case TOKEN_RETURN:
+            case TOKEN_TRY:
+            case TOKEN_THROW:
+                return;
+
+            default:
+                ;   // Do nothing.
+        }
+
+        advance();
+    }
+}
+
+
+
+static void declaration() {
+    if (match(TOKEN_CLASS)) {
+        classDeclaration();
+    } else if (match(TOKEN_FUN)) {
+        funDeclaration();
+    } else if (match(TOKEN_VAR)) {
+        varDeclaration();
+    } else {
+        statement();
+    }
+
+    if (parser.panicMode) synchronize();
+}
+
+
+
+static void statement() {
+    if (match(TOKEN_PRINT)) {
+        printStatement();
+    } else if (match(TOKEN_IF)) {
+        ifStatement();
+    } else if (match(TOKEN_WHILE)) {
+        whileStatement();
+    } else if (match(TOKEN_FOR)) {
+        forStatement();
+    } else if (match(TOKEN_RETURN)) {
+        returnStatement();
+    } else if (match(TOKEN_TRY)) {
+        tryStatement();
+    } else if (match(TOKEN_THROW)) {
+        throwStatement();
+    } else if (match(TOKEN_LEFT_BRACE)) {
+        beginScope();
+        block();
+        endScope();
+    } else {
+        expressionStatement();
+    }
+}
+
+
+
+
+/**
+ * @brief Compiles the given source code into a function.
+ *
+ * This function takes the source code as input and compiles it into the
+ * body of an implicit top-level function, which contains the bytecode
+ * representation of the source code. The compilation process involves
+ * lexical analysis, parsing, and code generation.
+ *
+ * @param source The source code to be compiled.
+ * @return The top-level function, or NULL if there was a compile error.
+ */
+ObjFunction* compile(const char *source) {
+    initScanner(source);
+    Compiler compiler;
+    initCompiler(&compiler, TYPE_SCRIPT, NULL);
+
+    parser.hadError = false;
+    parser.panicMode = false;
+    currentClass = NULL;
+    // kept after compiling, for the bodies compileLazy() compiles later on
+    freeTable(&inlinable);
+
+    advance();
+
+    while (!match(TOKEN_EOF)) {
+        declaration();
+    }
+
+    ObjFunction* function = endCompiler();
+    return parser.hadError ? NULL : function;
+}
+
+
+
+/**
+ * Compiles the body of a function that deferFunction() declared.
+ *
+ * Compile errors are reported just as they would have been up front, only
+ * later. Calls in the body are inlined as they would have been in code
+ * compiled at the end of the script.
+ *
+ * @return false if the body has an error; it is left empty, never to run.
+ */
+bool compileLazy(ObjFunction* function) {
+    const char* source = function->lazySource;
+    initScannerAt(source, function->lazyLine);
+    parser.hadError = false;
+    parser.panicMode = false;
+    currentClass = NULL;
+    advance();
+
+    Compiler compiler;
+    initCompiler(&compiler, TYPE_FUNCTION, function);
+    function->arity = 0;        // counted again from the parameters
+    functionBody();
+
+    if (function->ownsSource) free((char*)source);
+    function->lazySource = NULL;
+    function->ownsSource = false;
+    if (!parser.hadError) return true;
+
+    FREE_ARRAY(uint16_t, function->loopHeat, function->loopCount);
+    function->loopHeat = NULL;
+    function->loopCount = 0;
+    freeChunk(&function->chunk);
+    function->oldConstants = 0;
+    return false;
+}
+
+
+
+// the functions being compiled aren't reachable from the VM yet, and the
+// ones calls get inlined from are kept for compiling lazy bodies
+void markCompilerRoots() {
+    Compiler* compiler = current;
+    while (compiler != NULL) {
+        markObject((Obj*)compiler->function);
+        compiler = compiler->enclosing;
+    }
+    markTable(&inlinable);
+}
+
+
+
+void freeCompiler() {
+    freeTable(&inlinable);
+}
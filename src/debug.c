@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "include/debug.h"
+#include "include/object.h"
 #include "include/value.h"
 
 /**
@@ -14,6 +15,12 @@ void disassembleChunk(Chunk* chunk, const char* name) {
     for (int offset = 0; offset < chunk->count;) {
         offset = disassembleInstruction(chunk, offset);
     }
+
+    for (int i = 0; i < chunk->handlerCount; i++) {
+        ExceptionHandler* handler = &chunk->handlers[i];
+        printf("try %04d..%04d -> catch %04d, height %d\n",
+               handler->start, handler->end, handler->handler, handler->height);
+    }
 }
 
 /**
@@ -28,26 +35,166 @@ void disassembleChunk(Chunk* chunk, const char* name) {
  * @return The new offset after the instruction has been disassembled.
  */
 static int constantInstruction(const char* name, Chunk* chunk, int offset) {
-    if (chunk->code[offset] == OP_CONSTANT) {
-        uint8_t constant = chunk->code[offset + 1];  // One-byte index
-        printf("%-16s %4d '", name, constant);
-        printValue(chunk->constants.values[constant]);
-        printf("'\n");
-        return offset + 2;  // OP_CONSTANT takes 2 bytes
-    } 
-    
-    else if (chunk->code[offset] == OP_CONSTANT_LONG) {
-        uint32_t constant = chunk->code[offset + 1] 
-                          | (chunk->code[offset + 2] << 8) 
-                          | (chunk->code[offset + 3] << 16);  // Three-byte index
-        printf("%-16s %4d '", name, constant);
-        printValue(chunk->constants.values[constant]);
-        printf("'\n");
-        return offset + 4;  // OP_CONSTANT_LONG takes 4 bytes
+    uint8_t constant = chunk->code[offset + 1];  // One-byte index
+    printf("%-16s %4d '", name, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 2;  // opcode + 1-byte index
+}
+
+
+
+/**
+ * @brief Disassembles the `_LONG` form of a constant instruction.
+ *
+ * The 24-bit index is stored high byte first, matching `emitIndexed()` in the
+ * compiler and `readLongIndex()` in the VM.
+ */
+static int longConstantInstruction(const char* name, Chunk* chunk, int offset) {
+    uint32_t constant = (chunk->code[offset + 1] << 16)
+                      | (chunk->code[offset + 2] << 8)
+                      | chunk->code[offset + 3];  // Three-byte index
+    printf("%-16s %4d '", name, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 4;  // opcode + 3-byte index
+}
+
+
+
+// instructions whose operand is a stack slot rather than a constant
+static int byteInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t slot = chunk->code[offset + 1];
+    printf("%-16s %4d\n", name, slot);
+    return offset + 2;
+}
+
+
+
+static int longByteInstruction(const char* name, Chunk* chunk, int offset) {
+    uint32_t slot = (chunk->code[offset + 1] << 16)
+                  | (chunk->code[offset + 2] << 8)
+                  | chunk->code[offset + 3];
+    printf("%-16s %4d\n", name, slot);
+    return offset + 4;
+}
+
+
+
+// jumps carry a 16-bit offset; sign is +1 for forward jumps
+static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset) {
+    uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
+    jump |= chunk->code[offset + 2];
+    printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+    return offset + 3;
+}
+
+
+
+// counter slot, limit (slot or constant), loop number and a backward jump
+static int forInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t slot = chunk->code[offset + 1];
+    uint8_t limit = chunk->code[offset + 2];
+    uint8_t loop = chunk->code[offset + 3];
+    uint16_t jump = (uint16_t)(chunk->code[offset + 4] << 8);
+    jump |= chunk->code[offset + 5];
+    printf("%-16s %4d %4d -> %d (loop %d)\n", name, slot, limit, offset + 6 - jump, loop);
+    return offset + 6;
+}
+
+
+
+// the property name comes from the instruction's inline cache
+static int propertyInstruction(const char* name, Chunk* chunk, int offset) {
+    uint16_t cache = (uint16_t)(chunk->code[offset + 1] << 8);
+    cache |= chunk->code[offset + 2];
+    ObjString* property = chunk->caches[cache].name;
+    printf("%-16s %4d '%.*s'\n", name, cache, property->length, property->chars);
+    return offset + 3;
+}
+
+
+
+// inline cache (with the method name) and argument count
+static int invokeInstruction(const char* name, Chunk* chunk, int offset) {
+    uint16_t cache = (uint16_t)(chunk->code[offset + 1] << 8);
+    cache |= chunk->code[offset + 2];
+    uint8_t argCount = chunk->code[offset + 3];
+    ObjString* method = chunk->caches[cache].name;
+    printf("%-16s (%d args) %4d '%.*s'\n", name, argCount, cache, method->length, method->chars);
+    return offset + 4;
+}
+
+
+
+// loop number and a backward jump
+static int loopInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t loop = chunk->code[offset + 1];
+    uint16_t jump = (uint16_t)(chunk->code[offset + 2] << 8);
+    jump |= chunk->code[offset + 3];
+    printf("%-16s %4d -> %d (loop %d)\n", name, offset, offset + 4 - jump, loop);
+    return offset + 4;
+}
+
+
+
+/**
+ * Disassembles a superinstruction written by the optimizer.
+ *
+ * It keeps the layout of the sequence it replaced, so its operands sit
+ * where that sequence had them and the final byte is the original operator.
+ */
+static int binaryInstruction(const char* name, Chunk* chunk, int offset) {
+    static const char* operators[] = {
+        [OP_GREATER] = ">", [OP_LESS] = "<",
+        [OP_ADD] = "+", [OP_SUBTRACT] = "-", [OP_MULTIPLY] = "*",
+    };
+    uint8_t slot = chunk->code[offset + 1];
+    uint8_t operand = chunk->code[offset + 3];
+    printf("%-16s %4d %4d '%s'\n", name, slot, operand, operators[chunk->code[offset + 4]]);
+    return offset + 5;
+}
+
+
+
+// the function constant, then one line per captured variable
+static int closureInstruction(const char* name, Chunk* chunk, int offset) {
+    static const char* kinds[] = {
+        [CAPTURE_LOCAL] = "local", [CAPTURE_FLAT] = "flat", [CAPTURE_STACK] = "stack",
+        [CAPTURE_CELL] = "cell", [CAPTURE_UPVALUE] = "upvalue",
+    };
+
+    uint32_t constant = chunk->code[offset + 1];
+    int next;
+    if (chunk->code[offset] == OP_CLOSURE) {
+        next = constantInstruction(name, chunk, offset);
+    } else {
+        constant = (constant << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+        next = longConstantInstruction(name, chunk, offset);
+    }
+
+    ObjFunction* function = AS_FUNCTION(chunk->constants.values[constant]);
+    for (int i = 0; i < function->upvalueCount; i++, next += 3) {
+        int index = (chunk->code[next + 1] << 8) | chunk->code[next + 2];
+        printf("%04d      |                     %s %d\n", next, kinds[chunk->code[next]], index);
     }
+    return next;
+}
+
 
-    printf("Unknown constant instruction!\n");
-    return offset + 1;  // Move forward to avoid infinite loop
+
+// argument count, the function whose body follows, and where a call made instead returns
+static int guardInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t argCount = chunk->code[offset + 1];
+    uint32_t constant = (chunk->code[offset + 2] << 16)
+                      | (chunk->code[offset + 3] << 8)
+                      | chunk->code[offset + 4];
+    uint16_t jump = (uint16_t)(chunk->code[offset + 5] << 8);
+    jump |= chunk->code[offset + 6];
+    printf("%-16s (%d args) %4d '", name, argCount, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("' -> %d\n", offset + 7 + jump);
+    return offset + 7;
 }
 
 
@@ -86,7 +233,7 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return constantInstruction("OP_CONSTANT", chunk, offset);
 
         case OP_CONSTANT_LONG:
-            return constantInstruction("OP_CONSTANT_LONG", chunk, offset);
+            return longConstantInstruction("OP_CONSTANT_LONG", chunk, offset);
 
         case OP_NULL:
             return simpleInstruction("OP_NULL", offset);
@@ -97,6 +244,60 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         case OP_FALSE:
             return simpleInstruction("OP_FALSE", offset);
 
+        case OP_POP:
+            return simpleInstruction("OP_POP", offset);
+
+        case OP_GET_LOCAL:
+            return byteInstruction("OP_GET_LOCAL", chunk, offset);
+
+        case OP_GET_LOCAL_LONG:
+            return longByteInstruction("OP_GET_LOCAL_LONG", chunk, offset);
+
+        case OP_SET_LOCAL:
+            return byteInstruction("OP_SET_LOCAL", chunk, offset);
+
+        case OP_SET_LOCAL_LONG:
+            return longByteInstruction("OP_SET_LOCAL_LONG", chunk, offset);
+
+        case OP_GET_GLOBAL:
+            return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+
+        case OP_GET_GLOBAL_LONG:
+            return longConstantInstruction("OP_GET_GLOBAL_LONG", chunk, offset);
+
+        case OP_DEFINE_GLOBAL:
+            return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+
+        case OP_DEFINE_GLOBAL_LONG:
+            return longConstantInstruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
+
+        case OP_SET_GLOBAL:
+            return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+
+        case OP_SET_GLOBAL_LONG:
+            return longConstantInstruction("OP_SET_GLOBAL_LONG", chunk, offset);
+
+        case OP_GET_UPVALUE:
+            return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+
+        case OP_SET_UPVALUE:
+            return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+
+        case OP_GET_ARGUMENT:
+            return byteInstruction("OP_GET_ARGUMENT", chunk, offset);
+
+        case OP_SET_ARGUMENT:
+            return byteInstruction("OP_SET_ARGUMENT", chunk, offset);
+
+        case OP_GET_PROPERTY:
+            return propertyInstruction("OP_GET_PROPERTY", chunk, offset);
+
+        case OP_SET_PROPERTY:
+            return propertyInstruction("OP_SET_PROPERTY", chunk, offset);
+
+        case OP_GET_SUPER:
+            return propertyInstruction("OP_GET_SUPER", chunk, offset);
+
         case OP_EQUAL:
             return simpleInstruction("OP_EQUAL", offset);
         
@@ -124,9 +325,102 @@ int disassembleInstruction(Chunk* chunk, int offset) {
         case OP_NEGATE:
             return simpleInstruction("OP_NEGATE", offset);
 
+        case OP_PRINT:
+            return simpleInstruction("OP_PRINT", offset);
+
+        case OP_JUMP:
+            return jumpInstruction("OP_JUMP", 1, chunk, offset);
+
+        case OP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+
+        case OP_JUMP_IF_LESS:
+            return jumpInstruction("OP_JUMP_IF_LESS", 1, chunk, offset);
+
+        case OP_JUMP_IF_NOT_LESS:
+            return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+
+        case OP_JUMP_IF_GREATER:
+            return jumpInstruction("OP_JUMP_IF_GREATER", 1, chunk, offset);
+
+        case OP_JUMP_IF_NOT_GREATER:
+            return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+
+        case OP_JUMP_IF_EQUAL:
+            return jumpInstruction("OP_JUMP_IF_EQUAL", 1, chunk, offset);
+
+        case OP_JUMP_IF_NOT_EQUAL:
+            return jumpInstruction("OP_JUMP_IF_NOT_EQUAL", 1, chunk, offset);
+
+        case OP_LOOP:
+            return loopInstruction("OP_LOOP", chunk, offset);
+
+        case OP_FOR_INCR_LT:
+            return forInstruction("OP_FOR_INCR_LT", chunk, offset);
+
+        case OP_FOR_INCR_LT_CONST:
+            return forInstruction("OP_FOR_INCR_LT_CONST", chunk, offset);
+
+        case OP_CALL:
+            return byteInstruction("OP_CALL", chunk, offset);
+
+        case OP_TAIL_CALL:
+            return byteInstruction("OP_TAIL_CALL", chunk, offset);
+
+        case OP_INVOKE:
+            return invokeInstruction("OP_INVOKE", chunk, offset);
+
+        case OP_INLINE_GUARD:
+            return guardInstruction("OP_INLINE_GUARD", chunk, offset);
+
+        case OP_INLINE_RETURN:
+            return byteInstruction("OP_INLINE_RETURN", chunk, offset);
+
+        case OP_SUPER_INVOKE:
+            return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
+
+        case OP_CLOSURE:
+            return closureInstruction("OP_CLOSURE", chunk, offset);
+
+        case OP_CLOSURE_LONG:
+            return closureInstruction("OP_CLOSURE_LONG", chunk, offset);
+
+        case OP_CLOSE_UPVALUE:
+            return simpleInstruction("OP_CLOSE_UPVALUE", offset);
+
         case OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
 
+        case OP_INHERIT:
+            return simpleInstruction("OP_INHERIT", offset);
+
+        case OP_THROW:
+            return simpleInstruction("OP_THROW", offset);
+
+        case OP_CLASS:
+            return constantInstruction("OP_CLASS", chunk, offset);
+
+        case OP_CLASS_LONG:
+            return longConstantInstruction("OP_CLASS_LONG", chunk, offset);
+
+        case OP_METHOD:
+            return constantInstruction("OP_METHOD", chunk, offset);
+
+        case OP_METHOD_LONG:
+            return longConstantInstruction("OP_METHOD_LONG", chunk, offset);
+
+        case OP_LOCALS_BINARY:
+            return binaryInstruction("OP_LOCALS_BINARY", chunk, offset);
+
+        case OP_LOCAL_CONSTANT_BINARY:
+            return binaryInstruction("OP_LOCAL_CONSTANT_BINARY", chunk, offset);
+
+        case OP_SET_LOCAL_POP:
+            return byteInstruction("OP_SET_LOCAL_POP", chunk, offset) + 1;
+
+        case OP_SET_GLOBAL_POP:
+            return constantInstruction("OP_SET_GLOBAL_POP", chunk, offset) + 1;
+
         default:
             return simpleInstruction("Unknown opcode", offset);
     }
@@ -0,0 +1,2356 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/ir.h"
+#include "include/memory.h"
+
+// a repeat of an expression shorter than this (in instructions) is cheaper
+// to compute again than to keep in a temporary
+#define CSE_MIN_LENGTH 3
+
+
+typedef enum {
+    NODE_UNKNOWN,       // a value the graph doesn't see into: a parameter, a call's result, ...
+    NODE_CONSTANT,
+    NODE_PHI,
+    NODE_UNARY,         // OP_NOT, OP_NEGATE
+    NODE_BINARY,        // OP_EQUAL .. OP_DIVIDE
+} NodeKind;
+
+
+// what constant propagation knows about a node, from most to least
+typedef enum {
+    LATTICE_NONE,       // not known to be computed at all (yet)
+    LATTICE_CONSTANT,   // always `value`
+    LATTICE_NUMBER,     // always an int or a double
+    LATTICE_ANY,
+} Lattice;
+
+
+typedef struct {
+    NodeKind kind;
+    uint8_t op;             // the operator's opcode
+    int a, b;               // its operands, -1 if none
+    int* inputs;            // a phi's, one per way into its block
+    int block;
+    int forward;            // a redundant phi: the node it always equals, else -1
+
+    Lattice lattice;
+    Value value;            // a constant's, and what LATTICE_CONSTANT settled on
+
+    // an operator's code, as the rewrite finds it
+    int start, end;         // -1 if it doesn't run as one piece
+    int length;             // instructions in there
+    bool pure;              // nothing happens in there but computing the value
+    bool removable;         // ... and nothing in there can fail
+
+    int number;             // value number (-O2)
+    int temp;               // slot a later use reads it from, -1
+} Node;
+
+
+// one way out of a block: the block and the index of the successor
+typedef struct {
+    int block;
+    int edge;
+} Edge;
+
+
+typedef struct {
+    int start, end;         // code [start, end)
+    int last;               // offset of its last instruction
+
+    int succs[2];           // [0] falls through or is the only way, [1] is where a branch jumps
+    int succCount;
+    bool succLive[2];       // constant propagation found the way can be taken
+    Edge* preds;
+    int predCount;
+    int predCapacity;
+
+    int rpo;                // position in reverse postorder, -1 if nothing reaches it
+    bool executable;
+    bool header;            // a backward edge comes in
+
+    int height;             // stack height on entry
+    int* entry;             // the node in each slot on entry
+    int exitHeight;
+    int* exit;
+    int jumpExitHeight;
+    int* jumpExit;          // OP_INLINE_GUARD: the slots when it takes its jump
+
+    int branch;             // the node deciding a conditional way out, -1
+    bool jumpIfFalsey;      // ... jump when it's falsey rather than truthy
+
+    int firstNode, nodeEnd; // the nodes computed in it, phis first
+    bool* liveIn;           // slots read before being written
+    int idom;               // immediate dominator (-O2)
+} Block;
+
+
+typedef enum {
+    EDIT_AFTER,             // insert: ends the instruction ahead of `start`; jumps land past it
+    EDIT_BEFORE,            // insert: runs on entering `start` from ahead of it, so forward
+                            // jumps land on it and backward ones past it
+    EDIT_REPLACE,           // replace [start, end)
+} EditKind;
+
+
+typedef struct {
+    EditKind kind;
+    int start, end;
+    int order;              // inserts at one offset run in the order they were made
+    int copyStart, copyEnd; // old code to emit (renumbered) ahead of `bytes`, -1 if none
+    uint8_t* bytes;
+    int length;
+    int capacity;
+    int jump;               // offset in `bytes` of a forward jump, -1 if none
+    int target;             // ... and the old offset it lands on
+} Edit;
+
+
+// an entry of the stack as the rewrite walks a block
+typedef struct {
+    int node;
+    int start, end;         // the code that pushed it, -1 if not all in this block
+    int length;
+    bool pure;
+    bool removable;
+} StackEntry;
+
+
+typedef struct {
+    int header;
+    bool* body;
+    int size;
+} Loop;
+
+
+typedef struct {
+    ObjFunction* function;
+    Chunk* chunk;
+    int level;
+
+    Node* nodes;
+    int nodeCount;
+    int nodeCapacity;
+
+    Block* blocks;
+    int blockCount;
+    int* blockAt;           // code offset -> block starting there, -1
+    int* order;             // reachable blocks in reverse postorder
+    int orderCount;
+
+    // per code offset
+    int* nodeAt;            // the node an instruction pushes, or branches on
+    int* heightAt;          // stack height ahead of it
+    bool* deadStores;       // an OP_SET_LOCAL(_LONG) nothing reads
+
+    bool* escaped;          // slots a closure captures by reference
+    int maxSlot;            // highest slot an operand names
+    int maxShortSlot;       // ... that a one-byte operand names
+    int maxHeight;
+
+    Edit* edits;
+    int editCount;
+    int editCapacity;
+    int editOrder;
+
+    Loop* loops;
+    int loopCount;
+
+    int temps;              // temporary slots handed out
+    int maxTemps;
+} IR;
+
+
+static void* allocate(size_t size) {
+    void* memory = calloc(1, size > 0 ? size : 1);
+    if (memory == NULL) exit(1);
+    return memory;
+}
+
+#define NEW_ARRAY(type, count) ((type*)allocate(sizeof(type) * (size_t)(count)))
+
+
+
+static int readShort(uint8_t* code) {
+    return (code[0] << 8) | code[1];
+}
+
+
+
+static int readLong(uint8_t* code) {
+    return (code[0] << 16) | (code[1] << 8) | code[2];
+}
+
+
+
+// the slot an OP_GET_LOCAL / OP_SET_LOCAL (or _LONG) names
+static int localSlot(uint8_t* code) {
+    return code[0] == OP_GET_LOCAL || code[0] == OP_SET_LOCAL ? code[1] : readLong(code + 1);
+}
+
+
+
+static bool isCapturedLocal(uint8_t kind) {
+    return kind == CAPTURE_LOCAL || kind == CAPTURE_FLAT || kind == CAPTURE_STACK ||
+           kind == CAPTURE_CELL;
+}
+
+
+
+// offset of the first capture of the OP_CLOSURE(_LONG) at `offset`
+static int firstCapture(Chunk* chunk, int offset) {
+    return offset + (chunk->code[offset] == OP_CLOSURE ? 2 : 4);
+}
+
+
+
+/**
+ * How many values an instruction pops, and then pushes.
+ *
+ * @return false for the superinstructions, which only the hot-loop
+ *         optimizer writes and the pass never sees.
+ */
+static bool stackEffect(Chunk* chunk, int offset, int* pops, int* pushes) {
+    uint8_t* code = &chunk->code[offset];
+    *pops = 0;
+    *pushes = 0;
+
+    switch (code[0]) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NULL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_LOCAL_LONG:
+        case OP_GET_GLOBAL:
+        case OP_GET_GLOBAL_LONG:
+        case OP_GET_UPVALUE:
+        case OP_GET_ARGUMENT:
+        case OP_CLOSURE:
+        case OP_CLOSURE_LONG:
+        case OP_CLASS:
+        case OP_CLASS_LONG:
+            *pushes = 1;
+            return true;
+
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_LONG:
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_LONG:
+        case OP_SET_UPVALUE:
+        case OP_SET_ARGUMENT:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+        case OP_FOR_INCR_LT:
+        case OP_FOR_INCR_LT_CONST:
+        case OP_INLINE_GUARD:
+            return true;
+
+        case OP_GET_PROPERTY:
+        case OP_GET_SUPER:
+        case OP_NOT:
+        case OP_NEGATE:
+            *pops = 1;
+            *pushes = 1;
+            return true;
+
+        case OP_POP:
+        case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_PRINT:
+        case OP_CLOSE_UPVALUE:
+        case OP_METHOD:
+        case OP_METHOD_LONG:
+        case OP_RETURN:
+            *pops = 1;
+            return true;
+
+        case OP_SET_PROPERTY:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+            *pops = 2;
+            *pushes = 1;
+            return true;
+
+        case OP_INHERIT:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_EQUAL:
+            *pops = 2;
+            return true;
+
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            *pops = code[1] + 1;
+            *pushes = 1;
+            return true;
+
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE:
+            *pops = code[3] + 1;
+            *pushes = 1;
+            return true;
+
+        case OP_INLINE_RETURN:
+            // the result, the arguments and the callee -> the result
+            *pops = code[1] + 2;
+            *pushes = 1;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+
+// where the jump at `offset` lands, -1 if it isn't one
+static int jumpTarget(Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    switch (code[0]) {
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_EQUAL:
+            return offset + 3 + readShort(code + 1);
+        case OP_LOOP:
+            return offset + 4 - readShort(code + 2);
+        case OP_FOR_INCR_LT:
+        case OP_FOR_INCR_LT_CONST:
+            return offset + 6 - readShort(code + 4);
+        case OP_INLINE_GUARD:
+            return offset + 7 + readShort(code + 5);
+        default:
+            return -1;
+    }
+}
+
+
+
+static bool endsBlock(uint8_t instruction) {
+    return instruction == OP_RETURN || (instruction >= OP_JUMP && instruction <= OP_FOR_INCR_LT_CONST) ||
+           instruction == OP_INLINE_GUARD;
+}
+
+
+
+// the comparison a fused compare-and-branch makes
+static uint8_t comparisonOf(uint8_t instruction) {
+    switch (instruction) {
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:
+            return OP_LESS;
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:
+            return OP_GREATER;
+        default:
+            return OP_EQUAL;
+    }
+}
+
+
+
+static int newNode(IR* ir, NodeKind kind, int block) {
+    if (ir->nodeCapacity < ir->nodeCount + 1) {
+        ir->nodeCapacity = GROW_CAPACITY(ir->nodeCapacity);
+        ir->nodes = (Node*)realloc(ir->nodes, sizeof(Node) * ir->nodeCapacity);
+        if (ir->nodes == NULL) exit(1);
+    }
+
+    Node* node = &ir->nodes[ir->nodeCount];
+    memset(node, 0, sizeof(Node));
+    node->kind = kind;
+    node->a = -1;
+    node->b = -1;
+    node->block = block;
+    node->forward = -1;
+    node->lattice = LATTICE_NONE;
+    node->value = NULL_VAL;
+    node->start = -1;
+    node->end = -1;
+    node->number = ir->nodeCount;
+    node->temp = -1;
+    return ir->nodeCount++;
+}
+
+
+
+static int newConstant(IR* ir, Value value, int block) {
+    int node = newNode(ir, NODE_CONSTANT, block);
+    ir->nodes[node].value = value;
+    return node;
+}
+
+
+
+static int newOperator(IR* ir, uint8_t op, int a, int b, int block) {
+    int node = newNode(ir, b == -1 ? NODE_UNARY : NODE_BINARY, block);
+    ir->nodes[node].op = op;
+    ir->nodes[node].a = a;
+    ir->nodes[node].b = b;
+    return node;
+}
+
+
+
+static int resolve(IR* ir, int node) {
+    while (ir->nodes[node].forward != -1) node = ir->nodes[node].forward;
+    return node;
+}
+
+
+
+static void addPred(Block* block, int from, int edge) {
+    if (block->predCapacity < block->predCount + 1) {
+        block->predCapacity = GROW_CAPACITY(block->predCapacity);
+        block->preds = (Edge*)realloc(block->preds, sizeof(Edge) * block->predCapacity);
+        if (block->preds == NULL) exit(1);
+    }
+    block->preds[block->predCount++] = (Edge){from, edge};
+}
+
+
+
+/**
+ * Splits the code into basic blocks and orders the ones the entry reaches.
+ *
+ * A block starts at offset 0, at every jump target and after every
+ * instruction that doesn't simply fall through to the next one.
+ */
+static bool findBlocks(IR* ir) {
+    Chunk* chunk = ir->chunk;
+    int count = chunk->count;
+    bool* leaders = NEW_ARRAY(bool, count + 1);
+    bool ok = true;
+    leaders[0] = true;
+
+    for (int offset = 0; offset < count && ok; offset += instructionLength(chunk, offset)) {
+        int pops, pushes;
+        if (!stackEffect(chunk, offset, &pops, &pushes)) ok = false;
+
+        int target = jumpTarget(chunk, offset);
+        if (target < -1 || target >= count) ok = false;
+        else if (target != -1) leaders[target] = true;
+
+        if (endsBlock(chunk->code[offset])) leaders[offset + instructionLength(chunk, offset)] = true;
+    }
+    if (!ok) {
+        free(leaders);
+        return false;
+    }
+
+    ir->blockAt = NEW_ARRAY(int, count + 1);
+    for (int offset = 0; offset < count; offset++) {
+        if (leaders[offset]) ir->blockCount++;
+        ir->blockAt[offset] = -1;
+    }
+    ir->blockAt[count] = -1;
+
+    ir->blocks = NEW_ARRAY(Block, ir->blockCount);
+    int current = -1;
+    for (int offset = 0; offset < count; offset += instructionLength(chunk, offset)) {
+        if (leaders[offset]) {
+            if (current >= 0) ir->blocks[current].end = offset;
+            Block* block = &ir->blocks[++current];
+            block->start = offset;
+            block->rpo = -1;
+            block->branch = -1;
+            block->idom = -1;
+            ir->blockAt[offset] = current;
+        }
+        ir->blocks[current].last = offset;
+    }
+    ir->blocks[current].end = count;
+    free(leaders);
+
+    for (int i = 0; i < ir->blockCount; i++) {
+        Block* block = &ir->blocks[i];
+        uint8_t instruction = chunk->code[block->last];
+        int target = jumpTarget(chunk, block->last);
+
+        if (instruction == OP_RETURN) continue;
+        if (instruction == OP_JUMP || instruction == OP_LOOP) {
+            block->succs[block->succCount++] = ir->blockAt[target];
+            continue;
+        }
+
+        // falls through, maybe to where nothing follows; only dead code does
+        if (block->end == count) {
+            block->succCount = -1;
+            continue;
+        }
+        block->succs[block->succCount++] = ir->blockAt[block->end];
+        if (target != -1) block->succs[block->succCount++] = ir->blockAt[target];
+    }
+
+    // reverse postorder, depth-first from the entry
+    int* stack = NEW_ARRAY(int, ir->blockCount);
+    int* next = NEW_ARRAY(int, ir->blockCount);      // the successor to visit next
+    int* postorder = NEW_ARRAY(int, ir->blockCount);
+    bool* seen = NEW_ARRAY(bool, ir->blockCount);
+    int depth = 0;
+    int done = 0;
+
+    stack[depth++] = 0;
+    seen[0] = true;
+    while (depth > 0) {
+        Block* block = &ir->blocks[stack[depth - 1]];
+        if (block->succCount < 0) ok = false;
+
+        if (block->succCount > 0 && next[stack[depth - 1]] < block->succCount) {
+            int succ = block->succs[next[stack[depth - 1]]++];
+            if (!seen[succ]) {
+                seen[succ] = true;
+                stack[depth++] = succ;
+            }
+            continue;
+        }
+        postorder[done++] = stack[--depth];
+    }
+
+    ir->order = NEW_ARRAY(int, done);
+    ir->orderCount = done;
+    for (int i = 0; i < done; i++) {
+        ir->order[i] = postorder[done - 1 - i];
+        ir->blocks[ir->order[i]].rpo = i;
+    }
+
+    for (int i = 0; i < done; i++) {
+        Block* block = &ir->blocks[ir->order[i]];
+        for (int edge = 0; edge < block->succCount; edge++) {
+            addPred(&ir->blocks[block->succs[edge]], ir->order[i], edge);
+        }
+    }
+
+    free(stack);
+    free(next);
+    free(postorder);
+    free(seen);
+    return ok;
+}
+
+
+
+// which slots closures capture, and the highest slots the code names
+static void scanSlots(IR* ir) {
+    Chunk* chunk = ir->chunk;
+    ir->maxSlot = ir->function->arity;
+    ir->maxShortSlot = ir->function->arity;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+            uint8_t* code = &chunk->code[offset];
+            int slot = -1;
+            switch (code[0]) {
+                case OP_GET_LOCAL:
+                case OP_SET_LOCAL:
+                case OP_FOR_INCR_LT:
+                    if (code[0] == OP_FOR_INCR_LT && code[2] > ir->maxShortSlot) ir->maxShortSlot = code[2];
+                    // fallthrough
+                case OP_FOR_INCR_LT_CONST:
+                    if (code[1] > ir->maxShortSlot) ir->maxShortSlot = code[1];
+                    slot = ir->maxShortSlot;
+                    break;
+
+                case OP_GET_LOCAL_LONG:
+                case OP_SET_LOCAL_LONG:
+                    slot = localSlot(code);
+                    break;
+
+                case OP_CLOSURE:
+                case OP_CLOSURE_LONG: {
+                    int end = offset + instructionLength(chunk, offset);
+                    for (int capture = firstCapture(chunk, offset); capture < end; capture += 3) {
+                        uint8_t kind = chunk->code[capture];
+                        int index = readShort(&chunk->code[capture + 1]);
+                        if (!isCapturedLocal(kind)) continue;
+                        if (index > ir->maxSlot) ir->maxSlot = index;
+                        // a flat capture copies a variable nobody assigns
+                        if (pass == 1 && kind != CAPTURE_FLAT) ir->escaped[index] = true;
+                    }
+                    break;
+                }
+            }
+            if (slot > ir->maxSlot) ir->maxSlot = slot;
+        }
+        if (pass == 0) ir->escaped = NEW_ARRAY(bool, ir->maxSlot + 1);
+    }
+
+    // every one-byte slot operand must still fit once temporaries push the locals up
+    ir->maxTemps = UINT8_MAX - ir->maxShortSlot;
+}
+
+
+
+static int* edgeState(IR* ir, Edge edge, int* height) {
+    Block* from = &ir->blocks[edge.block];
+    if (edge.edge == 1 && from->jumpExit != NULL) {
+        *height = from->jumpExitHeight;
+        return from->jumpExit;
+    }
+    *height = from->exitHeight;
+    return from->exit;
+}
+
+
+
+static int* copySlots(int* slots, int count) {
+    int* copy = NEW_ARRAY(int, count + 1);
+    memcpy(copy, slots, sizeof(int) * count);
+    return copy;
+}
+
+
+
+/**
+ * Runs a block over the stack symbolically, making a node of each value.
+ *
+ * `stack` holds the nodes in the block's slots on entry and is left with
+ * those on exit. A read of a slot a closure captures by reference is a new
+ * unknown: a call can change such a slot behind the code's back.
+ */
+static bool simulate(IR* ir, int index, int* stack) {
+    Chunk* chunk = ir->chunk;
+    Block* block = &ir->blocks[index];
+    int height = block->height;
+
+#define NEED(n) do { if (height < (n)) return false; } while (false)
+
+    for (int offset = block->start; offset < block->end; offset += instructionLength(chunk, offset)) {
+        uint8_t* code = &chunk->code[offset];
+        int pushed = -1;
+        ir->heightAt[offset] = height;
+
+        switch (code[0]) {
+            case OP_CONSTANT:
+                pushed = newConstant(ir, chunk->constants.values[code[1]], index);
+                break;
+            case OP_CONSTANT_LONG:
+                pushed = newConstant(ir, chunk->constants.values[readLong(code + 1)], index);
+                break;
+            case OP_NULL:  pushed = newConstant(ir, NULL_VAL, index); break;
+            case OP_TRUE:  pushed = newConstant(ir, BOOL_VAL(true), index); break;
+            case OP_FALSE: pushed = newConstant(ir, BOOL_VAL(false), index); break;
+
+            case OP_GET_LOCAL:
+            case OP_GET_LOCAL_LONG: {
+                int slot = localSlot(code);
+                if (slot >= height) return false;
+                pushed = ir->escaped[slot] ? newNode(ir, NODE_UNKNOWN, index) : stack[slot];
+                break;
+            }
+
+            case OP_SET_LOCAL:
+            case OP_SET_LOCAL_LONG: {
+                int slot = localSlot(code);
+                if (slot >= height) return false;
+                stack[slot] = stack[height - 1];
+                break;
+            }
+
+            case OP_GET_ARGUMENT:
+                NEED(code[1] + 1);
+                pushed = stack[height - 1 - code[1]];
+                break;
+
+            case OP_SET_ARGUMENT:
+                NEED(code[1] + 1);
+                stack[height - 1 - code[1]] = stack[height - 1];
+                break;
+
+            case OP_NOT:
+            case OP_NEGATE:
+                NEED(1);
+                height--;
+                pushed = newOperator(ir, code[0], stack[height], -1, index);
+                break;
+
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+                NEED(2);
+                height -= 2;
+                pushed = newOperator(ir, code[0], stack[height], stack[height + 1], index);
+                break;
+
+            case OP_SET_PROPERTY:
+                // [instance, value] -> [value]
+                NEED(2);
+                pushed = stack[height - 1];
+                height -= 2;
+                break;
+
+            case OP_INLINE_RETURN:
+                NEED(code[1] + 2);
+                pushed = stack[height - 1];
+                height -= code[1] + 2;
+                break;
+
+            case OP_JUMP_IF_FALSE:
+                NEED(1);
+                block->branch = stack[height - 1];      // stays on the stack
+                block->jumpIfFalsey = true;
+                break;
+
+            case OP_JUMP_IF_LESS:
+            case OP_JUMP_IF_NOT_LESS:
+            case OP_JUMP_IF_GREATER:
+            case OP_JUMP_IF_NOT_GREATER:
+            case OP_JUMP_IF_EQUAL:
+            case OP_JUMP_IF_NOT_EQUAL:
+                NEED(2);
+                height -= 2;
+                block->branch = newOperator(ir, comparisonOf(code[0]), stack[height], stack[height + 1], index);
+                block->jumpIfFalsey = code[0] == OP_JUMP_IF_NOT_LESS || code[0] == OP_JUMP_IF_NOT_GREATER ||
+                                      code[0] == OP_JUMP_IF_NOT_EQUAL;
+                ir->nodeAt[offset] = block->branch;
+                break;
+
+            case OP_FOR_INCR_LT:
+            case OP_FOR_INCR_LT_CONST: {
+                // what `i = i + 1` and `i < limit` would make of it
+                int counter = code[1];
+                if (counter >= height || (code[0] == OP_FOR_INCR_LT && code[2] >= height)) return false;
+
+                int one = newConstant(ir, INT_VAL(1), index);
+                int current = ir->escaped[counter] ? newNode(ir, NODE_UNKNOWN, index) : stack[counter];
+                stack[counter] = newOperator(ir, OP_ADD, current, one, index);
+
+                int limit;
+                if (code[0] == OP_FOR_INCR_LT_CONST) {
+                    limit = newConstant(ir, chunk->constants.values[code[2]], index);
+                } else {
+                    limit = ir->escaped[code[2]] ? newNode(ir, NODE_UNKNOWN, index) : stack[code[2]];
+                }
+                block->branch = newOperator(ir, OP_LESS, stack[counter], limit, index);
+                block->jumpIfFalsey = false;
+                ir->nodeAt[offset] = block->branch;
+                break;
+            }
+
+            case OP_INLINE_GUARD: {
+                // a callee that isn't the inlined one is called, and lands past the body
+                int argCount = code[1];
+                NEED(argCount + 1);
+                block->jumpExitHeight = height - argCount;
+                block->jumpExit = copySlots(stack, block->jumpExitHeight);
+                block->jumpExit[block->jumpExitHeight - 1] = newNode(ir, NODE_UNKNOWN, index);
+                break;
+            }
+
+            default: {
+                int pops, pushes;
+                if (!stackEffect(chunk, offset, &pops, &pushes)) return false;
+                NEED(pops);
+                height -= pops;
+                if (pushes > 0) pushed = newNode(ir, NODE_UNKNOWN, index);
+                break;
+            }
+        }
+
+        if (pushed != -1) {
+            stack[height++] = pushed;
+            ir->nodeAt[offset] = pushed;
+        }
+        if (height > ir->maxHeight) ir->maxHeight = height;
+    }
+
+#undef NEED
+
+    block->exitHeight = height;
+    block->exit = copySlots(stack, height);
+    return true;
+}
+
+
+
+/**
+ * Builds the SSA graph, block by block in reverse postorder.
+ *
+ * Where ways in disagree on a slot, the block gets a phi for it. A loop
+ * header is reached before its backward edges, so it gets a phi for every
+ * slot, filled in once the whole graph is there; the phis that turn out
+ * to merge a value with itself are then forwarded to that value.
+ */
+static bool buildGraph(IR* ir) {
+    Chunk* chunk = ir->chunk;
+    int arity = ir->function->arity;
+    int capacity = chunk->count + arity + 2;
+    int* stack = NEW_ARRAY(int, capacity);
+    int* initial = NEW_ARRAY(int, arity + 1);
+    bool ok = true;
+
+    ir->nodeAt = NEW_ARRAY(int, chunk->count + 1);
+    ir->heightAt = NEW_ARRAY(int, chunk->count + 1);
+    for (int offset = 0; offset <= chunk->count; offset++) ir->nodeAt[offset] = -1;
+    ir->maxHeight = arity + 1;
+
+    for (int i = 0; i < ir->orderCount && ok; i++) {
+        int index = ir->order[i];
+        Block* block = &ir->blocks[index];
+        block->firstNode = ir->nodeCount;
+
+        // the entry block has one more way in: the call itself
+        int ways = block->predCount + (index == 0);
+        int height = -1;
+        if (index == 0) {
+            for (int slot = 0; slot <= arity; slot++) initial[slot] = newNode(ir, NODE_UNKNOWN, 0);
+            height = arity + 1;
+        }
+        for (int way = 0; way < block->predCount; way++) {
+            Edge edge = block->preds[way];
+            if (ir->blocks[edge.block].rpo >= block->rpo) {
+                block->header = true;
+                continue;
+            }
+            int from;
+            edgeState(ir, edge, &from);
+            if (height == -1) height = from;
+            if (from != height) ok = false;
+        }
+        if (height == -1 || !ok) {
+            ok = false;
+            break;
+        }
+
+        block->height = height;
+        block->entry = NEW_ARRAY(int, height + 1);
+        for (int slot = 0; slot < height; slot++) {
+            int first = -1;
+            bool same = true;
+            for (int way = 0; way < ways && !block->header; way++) {
+                int from;
+                int value = way == block->predCount ? initial[slot] : edgeState(ir, block->preds[way], &from)[slot];
+                if (first == -1) first = value;
+                if (value != first) same = false;
+            }
+            if (!block->header && same) {
+                block->entry[slot] = first;
+                continue;
+            }
+
+            int phi = newNode(ir, NODE_PHI, index);
+            ir->nodes[phi].inputs = NEW_ARRAY(int, ways);
+            block->entry[slot] = phi;
+            for (int way = 0; way < ways && !block->header; way++) {
+                int from;
+                ir->nodes[phi].inputs[way] = way == block->predCount
+                                                 ? initial[slot]
+                                                 : edgeState(ir, block->preds[way], &from)[slot];
+            }
+        }
+
+        memcpy(stack, block->entry, sizeof(int) * height);
+        if (!simulate(ir, index, stack)) ok = false;
+        block->nodeEnd = ir->nodeCount;
+    }
+
+    // the phis of loop headers, now that every way in is known
+    for (int i = 0; i < ir->orderCount && ok; i++) {
+        int index = ir->order[i];
+        Block* block = &ir->blocks[index];
+        if (!block->header) continue;
+
+        for (int way = 0; way < block->predCount + (index == 0); way++) {
+            int height = block->height;
+            int* slots = way == block->predCount ? initial : edgeState(ir, block->preds[way], &height);
+            if (height != block->height) {
+                ok = false;
+                break;
+            }
+            for (int slot = 0; slot < block->height; slot++) {
+                ir->nodes[block->entry[slot]].inputs[way] = slots[slot];
+            }
+        }
+    }
+    free(stack);
+    free(initial);
+    if (!ok) return false;
+
+    // a phi of one value (and itself) is that value
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 0; i < ir->nodeCount; i++) {
+            Node* node = &ir->nodes[i];
+            if (node->kind != NODE_PHI || node->forward != -1) continue;
+
+            Block* block = &ir->blocks[node->block];
+            int ways = block->predCount + (node->block == 0);
+            int same = -1;
+            bool trivial = true;
+            for (int way = 0; way < ways; way++) {
+                int input = resolve(ir, node->inputs[way]);
+                if (input == i || input == same) continue;
+                if (same != -1) {
+                    trivial = false;
+                    break;
+                }
+                same = input;
+            }
+            if (trivial && same != -1) {
+                node->forward = same;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    // point everything past the forwarded phis
+    for (int i = 0; i < ir->nodeCount; i++) {
+        Node* node = &ir->nodes[i];
+        if (node->a != -1) node->a = resolve(ir, node->a);
+        if (node->b != -1) node->b = resolve(ir, node->b);
+        if (node->kind == NODE_PHI) {
+            int ways = ir->blocks[node->block].predCount + (node->block == 0);
+            for (int way = 0; way < ways; way++) node->inputs[way] = resolve(ir, node->inputs[way]);
+        }
+    }
+    for (int offset = 0; offset < chunk->count; offset++) {
+        if (ir->nodeAt[offset] != -1) ir->nodeAt[offset] = resolve(ir, ir->nodeAt[offset]);
+    }
+    for (int i = 0; i < ir->orderCount; i++) {
+        Block* block = &ir->blocks[ir->order[i]];
+        for (int slot = 0; slot < block->height; slot++) block->entry[slot] = resolve(ir, block->entry[slot]);
+        if (block->branch != -1) block->branch = resolve(ir, block->branch);
+    }
+    return true;
+}
+
+
+
+static bool isFalsey(Value value) {
+    return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+
+
+// the same value, down to the bits of a double (0.0 and -0.0 fold differently)
+static bool sameConstant(Value a, Value b) {
+    if (a.type != b.type) return false;
+    if (IS_NUMBER(a)) return memcmp(&a.as.number, &b.as.number, sizeof(double)) == 0;
+    return valuesEqual(a, b);
+}
+
+
+
+static bool isNumeric(Node* node) {
+    return node->lattice == LATTICE_NUMBER ||
+           (node->lattice == LATTICE_CONSTANT && IS_ANY_NUMBER(node->value));
+}
+
+
+
+/**
+ * Computes an operator on constants, exactly as the VM would.
+ *
+ * @return false where the VM would raise an error, and for string
+ *         concatenation, which is left to run time.
+ */
+static bool fold(uint8_t op, Value a, Value b, Value* result) {
+    switch (op) {
+        case OP_NOT:
+            *result = BOOL_VAL(isFalsey(a));
+            return true;
+        case OP_EQUAL:
+            *result = BOOL_VAL(valuesEqual(a, b));
+            return true;
+        case OP_NEGATE:
+            if (IS_INT(a) && AS_INT(a) != INT64_MIN) {
+                *result = INT_VAL(-AS_INT(a));
+                return true;
+            }
+            if (!IS_ANY_NUMBER(a)) return false;
+            *result = NUMBER_VAL(-AS_FLOAT(a));
+            return true;
+        default:
+            break;
+    }
+
+    if (!IS_ANY_NUMBER(a) || !IS_ANY_NUMBER(b)) return false;
+    bool ints = IS_INT(a) && IS_INT(b);
+    int64_t exact;
+
+    switch (op) {
+        case OP_LESS:
+            *result = BOOL_VAL(ints ? AS_INT(a) < AS_INT(b) : AS_FLOAT(a) < AS_FLOAT(b));
+            return true;
+        case OP_GREATER:
+            *result = BOOL_VAL(ints ? AS_INT(a) > AS_INT(b) : AS_FLOAT(a) > AS_FLOAT(b));
+            return true;
+        case OP_ADD:
+            *result = ints && !__builtin_add_overflow(AS_INT(a), AS_INT(b), &exact)
+                          ? INT_VAL(exact) : NUMBER_VAL(AS_FLOAT(a) + AS_FLOAT(b));
+            return true;
+        case OP_SUBTRACT:
+            *result = ints && !__builtin_sub_overflow(AS_INT(a), AS_INT(b), &exact)
+                          ? INT_VAL(exact) : NUMBER_VAL(AS_FLOAT(a) - AS_FLOAT(b));
+            return true;
+        case OP_MULTIPLY:
+            *result = ints && !__builtin_mul_overflow(AS_INT(a), AS_INT(b), &exact)
+                          ? INT_VAL(exact) : NUMBER_VAL(AS_FLOAT(a) * AS_FLOAT(b));
+            return true;
+        case OP_DIVIDE:
+            *result = NUMBER_VAL(AS_FLOAT(a) / AS_FLOAT(b));
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+
+static void evaluateOperator(IR* ir, Node* node, Lattice* lattice, Value* value) {
+    Node* a = &ir->nodes[node->a];
+    Node* b = node->b != -1 ? &ir->nodes[node->b] : NULL;
+
+    if (a->lattice == LATTICE_NONE || (b != NULL && b->lattice == LATTICE_NONE)) {
+        *lattice = LATTICE_NONE;
+        return;
+    }
+    if (a->lattice == LATTICE_CONSTANT && (b == NULL || b->lattice == LATTICE_CONSTANT) &&
+        fold(node->op, a->value, b != NULL ? b->value : NULL_VAL, value)) {
+        *lattice = LATTICE_CONSTANT;
+        return;
+    }
+
+    switch (node->op) {
+        case OP_NEGATE:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+            // these fail on anything else
+            *lattice = LATTICE_NUMBER;
+            return;
+        case OP_ADD:
+            *lattice = isNumeric(a) && isNumeric(b) ? LATTICE_NUMBER : LATTICE_ANY;
+            return;
+        case OP_NOT:
+            // a number is never falsey
+            if (isNumeric(a)) {
+                *lattice = LATTICE_CONSTANT;
+                *value = BOOL_VAL(false);
+                return;
+            }
+            *lattice = LATTICE_ANY;
+            return;
+        default:
+            *lattice = LATTICE_ANY;
+            return;
+    }
+}
+
+
+
+static void meet(Lattice* lattice, Value* value, Node* input) {
+    if (input->lattice == LATTICE_NONE || *lattice == LATTICE_ANY) return;
+    if (*lattice == LATTICE_NONE) {
+        *lattice = input->lattice;
+        *value = input->value;
+        return;
+    }
+    if (*lattice == LATTICE_CONSTANT && input->lattice == LATTICE_CONSTANT &&
+        sameConstant(*value, input->value)) {
+        return;
+    }
+
+    bool numeric = (*lattice == LATTICE_NUMBER || IS_ANY_NUMBER(*value)) && isNumeric(input);
+    *lattice = numeric ? LATTICE_NUMBER : LATTICE_ANY;
+}
+
+
+
+// whether the `way`th way into a block has been found to be taken
+static bool wayLive(IR* ir, Block* block, int index, int way) {
+    if (way == block->predCount) return index == 0;     // the call
+    Edge edge = block->preds[way];
+    return ir->blocks[edge.block].succLive[edge.edge];
+}
+
+
+
+// whether the block can leave by its `edge`th way, given what's known of its branch
+static bool canLeave(IR* ir, Block* block, int edge) {
+    if (block->branch == -1) return true;
+
+    Node* branch = &ir->nodes[block->branch];
+    bool falsey;
+    switch (branch->lattice) {
+        case LATTICE_NONE:     return false;
+        case LATTICE_ANY:      return true;
+        case LATTICE_NUMBER:   falsey = false; break;
+        case LATTICE_CONSTANT: falsey = isFalsey(branch->value); break;
+        default:               return true;
+    }
+    bool jumps = falsey == block->jumpIfFalsey;
+    return edge == 1 ? jumps : !jumps;
+}
+
+
+
+/**
+ * Sparse conditional constant propagation.
+ *
+ * Only ways out of executable blocks that their branch can actually take
+ * become executable, and phis only meet the inputs of executable ways, so
+ * a value that is constant unless some branch goes a way it never does is
+ * found constant. Every node only ever moves down the lattice, so sweeping
+ * the blocks until nothing changes terminates.
+ */
+static void propagate(IR* ir) {
+    ir->blocks[0].executable = true;
+
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 0; i < ir->orderCount; i++) {
+            int index = ir->order[i];
+            Block* block = &ir->blocks[index];
+            if (!block->executable) continue;
+
+            for (int n = block->firstNode; n < block->nodeEnd; n++) {
+                Node* node = &ir->nodes[n];
+                if (node->forward != -1) continue;
+
+                Lattice lattice = LATTICE_ANY;
+                Value value = NULL_VAL;
+                switch (node->kind) {
+                    case NODE_UNKNOWN:
+                        break;
+                    case NODE_CONSTANT:
+                        lattice = LATTICE_CONSTANT;
+                        value = node->value;
+                        break;
+                    case NODE_PHI:
+                        lattice = LATTICE_NONE;
+                        for (int way = 0; way < block->predCount + (index == 0); way++) {
+                            if (wayLive(ir, block, index, way)) {
+                                meet(&lattice, &value, &ir->nodes[node->inputs[way]]);
+                            }
+                        }
+                        break;
+                    case NODE_UNARY:
+                    case NODE_BINARY:
+                        evaluateOperator(ir, node, &lattice, &value);
+                        break;
+                }
+
+                if (lattice != node->lattice ||
+                    (lattice == LATTICE_CONSTANT && !sameConstant(value, node->value))) {
+                    node->lattice = lattice;
+                    if (lattice == LATTICE_CONSTANT) node->value = value;
+                    changed = true;
+                }
+            }
+
+            for (int edge = 0; edge < block->succCount; edge++) {
+                if (!block->succLive[edge] && canLeave(ir, block, edge)) {
+                    block->succLive[edge] = true;
+                    ir->blocks[block->succs[edge]].executable = true;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+}
+
+
+
+/**
+ * Takes the slots live after an instruction back to those live ahead of it.
+ *
+ * What an instruction pops it reads, unless it only discards it; what it
+ * pushes is a new value, whatever the slot held before. If `deadStores`
+ * is given, an assignment to a local that nothing reads is flagged there.
+ */
+static void transfer(IR* ir, int offset, bool* live, bool* deadStores) {
+    Chunk* chunk = ir->chunk;
+    uint8_t* code = &chunk->code[offset];
+    int height = ir->heightAt[offset];
+    int pops, pushes;
+    stackEffect(chunk, offset, &pops, &pushes);
+
+    for (int slot = height - pops; slot < height - pops + pushes; slot++) live[slot] = false;
+    if (code[0] != OP_POP && code[0] != OP_CLOSE_UPVALUE) {
+        for (int slot = height - pops; slot < height; slot++) live[slot] = true;
+    }
+
+    switch (code[0]) {
+        case OP_GET_LOCAL:
+        case OP_GET_LOCAL_LONG:
+            live[localSlot(code)] = true;
+            break;
+
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_LONG: {
+            int slot = localSlot(code);
+            if (deadStores != NULL) deadStores[offset] = !live[slot] && !ir->escaped[slot];
+            live[slot] = false;
+            break;
+        }
+
+        case OP_GET_ARGUMENT:
+            live[height - 1 - code[1]] = true;
+            break;
+
+        case OP_FOR_INCR_LT:
+            live[code[2]] = true;
+            // fallthrough
+        case OP_FOR_INCR_LT_CONST:
+            live[code[1]] = true;
+            break;
+
+        case OP_INLINE_GUARD:
+            // the call it makes of any other callee
+            for (int slot = height - 1 - code[1]; slot < height; slot++) live[slot] = true;
+            break;
+
+        case OP_CLOSURE:
+        case OP_CLOSURE_LONG: {
+            int end = offset + instructionLength(chunk, offset);
+            for (int capture = firstCapture(chunk, offset); capture < end; capture += 3) {
+                if (isCapturedLocal(chunk->code[capture])) live[readShort(&chunk->code[capture + 1])] = true;
+            }
+            break;
+        }
+    }
+}
+
+
+
+// runs `transfer` backward over a block, from the slots live at its end
+static void transferBlock(IR* ir, Block* block, bool* live, int* offsets, bool* deadStores) {
+    Chunk* chunk = ir->chunk;
+    int count = 0;
+    for (int offset = block->start; offset < block->end; offset += instructionLength(chunk, offset)) {
+        offsets[count++] = offset;
+    }
+    while (count > 0) transfer(ir, offsets[--count], live, deadStores);
+}
+
+
+
+/**
+ * Finds, by backward dataflow over the executable blocks, which local
+ * stores are dead: nothing reads the slot before it's written again or
+ * popped. Slots a closure captures by reference are always live.
+ */
+static void findDeadStores(IR* ir) {
+    int slots = ir->maxHeight + 1;
+    bool* live = NEW_ARRAY(bool, slots);
+    int* offsets = NEW_ARRAY(int, ir->chunk->count + 1);
+    ir->deadStores = NEW_ARRAY(bool, ir->chunk->count + 1);
+
+    for (int i = 0; i < ir->orderCount; i++) {
+        ir->blocks[ir->order[i]].liveIn = NEW_ARRAY(bool, slots);
+    }
+
+    for (;;) {
+        bool changed = false;
+        for (int i = ir->orderCount - 1; i >= 0; i--) {
+            Block* block = &ir->blocks[ir->order[i]];
+            if (!block->executable) continue;
+
+            memset(live, 0, sizeof(bool) * slots);
+            for (int edge = 0; edge < block->succCount; edge++) {
+                if (!block->succLive[edge]) continue;
+                bool* next = ir->blocks[block->succs[edge]].liveIn;
+                for (int slot = 0; slot < slots; slot++) live[slot] |= next[slot];
+            }
+
+            transferBlock(ir, block, live, offsets, NULL);
+            if (memcmp(live, block->liveIn, sizeof(bool) * slots) != 0) {
+                memcpy(block->liveIn, live, sizeof(bool) * slots);
+                changed = true;
+            }
+        }
+        if (!changed) break;
+    }
+
+    for (int i = 0; i < ir->orderCount; i++) {
+        Block* block = &ir->blocks[ir->order[i]];
+        if (!block->executable) continue;
+
+        memset(live, 0, sizeof(bool) * slots);
+        for (int edge = 0; edge < block->succCount; edge++) {
+            if (!block->succLive[edge]) continue;
+            bool* next = ir->blocks[block->succs[edge]].liveIn;
+            for (int slot = 0; slot < slots; slot++) live[slot] |= next[slot];
+        }
+        transferBlock(ir, block, live, offsets, ir->deadStores);
+    }
+
+    free(live);
+    free(offsets);
+}
+
+
+
+static void editByte(Edit* edit, uint8_t byte) {
+    if (edit->capacity < edit->length + 1) {
+        edit->capacity = GROW_CAPACITY(edit->capacity);
+        edit->bytes = (uint8_t*)realloc(edit->bytes, edit->capacity);
+        if (edit->bytes == NULL) exit(1);
+    }
+    edit->bytes[edit->length++] = byte;
+}
+
+
+
+// whether replacing [start, end) fits with the edits made so far
+static bool canReplace(IR* ir, int start, int end) {
+    for (int i = 0; i < ir->editCount; i++) {
+        Edit* edit = &ir->edits[i];
+        if (edit->kind != EDIT_REPLACE) continue;
+        if (edit->end <= start || edit->start >= end) continue;             // apart
+        if (start <= edit->start && edit->end <= end) continue;             // inside
+        return false;
+    }
+    return true;
+}
+
+
+
+// whether an insert sits strictly inside [start, end)
+static bool insertWithin(IR* ir, int start, int end) {
+    for (int i = 0; i < ir->editCount; i++) {
+        Edit* edit = &ir->edits[i];
+        if (edit->kind != EDIT_REPLACE && edit->start > start && edit->start < end) return true;
+    }
+    return false;
+}
+
+
+
+// whether some replaced range takes in all of [start, end)
+static bool isReplaced(IR* ir, int start, int end) {
+    for (int i = 0; i < ir->editCount; i++) {
+        Edit* edit = &ir->edits[i];
+        if (edit->kind == EDIT_REPLACE && edit->start <= start && end <= edit->end) return true;
+    }
+    return false;
+}
+
+
+
+/**
+ * Records an edit. Replacing a range drops the edits made inside it
+ * earlier, and is refused (NULL) if it overlaps one only in part.
+ */
+static Edit* addEdit(IR* ir, EditKind kind, int start, int end) {
+    if (kind == EDIT_REPLACE) {
+        if (!canReplace(ir, start, end)) return NULL;
+
+        int kept = 0;
+        for (int i = 0; i < ir->editCount; i++) {
+            Edit* edit = &ir->edits[i];
+            bool inside = edit->kind == EDIT_REPLACE ? start <= edit->start && edit->end <= end
+                                                     : start < edit->start && edit->start < end;
+            if (inside) {
+                free(edit->bytes);
+                continue;
+            }
+            ir->edits[kept++] = *edit;
+        }
+        ir->editCount = kept;
+    }
+
+    if (ir->editCapacity < ir->editCount + 1) {
+        ir->editCapacity = GROW_CAPACITY(ir->editCapacity);
+        ir->edits = (Edit*)realloc(ir->edits, sizeof(Edit) * ir->editCapacity);
+        if (ir->edits == NULL) exit(1);
+    }
+
+    Edit* edit = &ir->edits[ir->editCount++];
+    memset(edit, 0, sizeof(Edit));
+    edit->kind = kind;
+    edit->start = start;
+    edit->end = end;
+    edit->order = ir->editOrder++;
+    edit->copyStart = -1;
+    edit->copyEnd = -1;
+    edit->jump = -1;
+    return edit;
+}
+
+
+
+static void deleteCode(IR* ir, int start, int end) {
+    addEdit(ir, EDIT_REPLACE, start, end);
+}
+
+
+
+static bool isFoldable(Value value) {
+    return IS_INT(value) || IS_NUMBER(value) || IS_BOOL(value) || IS_NULL(value);
+}
+
+
+
+// appends the instruction pushing `value`, reusing a constant the chunk already has
+static void pushConstant(IR* ir, Edit* edit, Value value) {
+    if (IS_NULL(value)) {
+        editByte(edit, OP_NULL);
+        return;
+    }
+    if (IS_BOOL(value)) {
+        editByte(edit, AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+        return;
+    }
+
+    ValueArray* constants = &ir->chunk->constants;
+    int index = -1;
+    for (int i = 0; i < constants->count && index == -1; i++) {
+        if (sameConstant(constants->values[i], value)) index = i;
+    }
+    if (index == -1) index = addConstant(ir->chunk, value);
+
+    if (index <= UINT8_MAX) {
+        editByte(edit, OP_CONSTANT);
+        editByte(edit, (uint8_t)index);
+    } else {
+        editByte(edit, OP_CONSTANT_LONG);
+        editByte(edit, (uint8_t)(index >> 16));
+        editByte(edit, (uint8_t)(index >> 8));
+        editByte(edit, (uint8_t)index);
+    }
+}
+
+
+
+// a jump to the old offset `target`, relocated when the edits are applied
+static void jumpTo(Edit* edit, int target) {
+    edit->jump = edit->length;
+    edit->target = target;
+    editByte(edit, OP_JUMP);
+    editByte(edit, 0);
+    editByte(edit, 0);
+}
+
+
+
+static bool canFail(IR* ir, Node* node) {
+    switch (node->op) {
+        case OP_NOT:
+        case OP_EQUAL:
+            return false;
+        case OP_NEGATE:
+            return !isNumeric(&ir->nodes[node->a]);
+        default:
+            // adding strings can't fail either, but it allocates
+            return !isNumeric(&ir->nodes[node->a]) || !isNumeric(&ir->nodes[node->b]);
+    }
+}
+
+
+
+/**
+ * The stack entry an operator leaves, from those of its operands.
+ *
+ * The operator and its operands' code form one range if the operands were
+ * pushed right ahead of it; the range is recorded on the operator's node.
+ * A pure range whose value is constant folds to a single push.
+ */
+static StackEntry applyOperator(IR* ir, int offset, int next, StackEntry* a, StackEntry* b) {
+    int index = ir->nodeAt[offset];
+    Node* node = &ir->nodes[index];
+    StackEntry result = {index, -1, -1, 0, false, false};
+
+    bool contiguous = b == NULL ? a->start != -1 && a->end == offset
+                                : a->start != -1 && b->start != -1 && a->end == b->start && b->end == offset;
+    if (contiguous) {
+        result.start = a->start;
+        result.end = next;
+        result.length = a->length + (b != NULL ? b->length : 0) + 1;
+        result.pure = a->pure && (b == NULL || b->pure);
+        result.removable = result.pure && a->removable && (b == NULL || b->removable) && !canFail(ir, node);
+    }
+
+    node->start = result.start;
+    node->end = result.end;
+    node->length = result.length;
+    node->pure = result.pure;
+    node->removable = result.removable;
+
+    if (result.pure && result.length > 1 && node->lattice == LATTICE_CONSTANT && isFoldable(node->value)) {
+        Edit* edit = addEdit(ir, EDIT_REPLACE, result.start, result.end);
+        if (edit != NULL) pushConstant(ir, edit, node->value);
+    }
+    return result;
+}
+
+
+
+/**
+ * Walks an executable block with a stack of entries, making the level 1
+ * edits: folds, settled branches, values pushed only to be popped, and
+ * dead stores.
+ */
+static void rewriteBlock(IR* ir, Block* block, StackEntry* stack) {
+    Chunk* chunk = ir->chunk;
+    int height = block->height;
+    for (int slot = 0; slot < height; slot++) {
+        stack[slot] = (StackEntry){block->entry[slot], -1, -1, 0, false, false};
+    }
+
+    // a conditional jump whose branch only ever goes one way
+    bool settled = block->succCount == 2 && block->succLive[0] != block->succLive[1];
+
+    for (int offset = block->start; offset < block->end;) {
+        uint8_t* code = &chunk->code[offset];
+        int next = offset + instructionLength(chunk, offset);
+
+        switch (code[0]) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+            case OP_NULL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_GET_LOCAL:
+            case OP_GET_LOCAL_LONG:
+            case OP_GET_ARGUMENT:
+                stack[height++] = (StackEntry){ir->nodeAt[offset], offset, next, 1, true, true};
+                break;
+
+            case OP_NOT:
+            case OP_NEGATE: {
+                StackEntry operand = stack[--height];
+                stack[height] = applyOperator(ir, offset, next, &operand, NULL);
+                height++;
+                break;
+            }
+
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE: {
+                StackEntry b = stack[--height];
+                StackEntry a = stack[--height];
+                stack[height] = applyOperator(ir, offset, next, &a, &b);
+                height++;
+                break;
+            }
+
+            case OP_SET_LOCAL:
+            case OP_SET_LOCAL_LONG:
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG:
+            case OP_SET_UPVALUE:
+            case OP_SET_ARGUMENT: {
+                StackEntry* value = &stack[height - 1];
+                if (ir->deadStores[offset] && next < block->end && chunk->code[next] == OP_POP) {
+                    if (value->removable && value->end == offset) deleteCode(ir, value->start, next + 1);
+                    else deleteCode(ir, offset, next);
+                }
+                value->end = next;
+                value->length++;
+                value->pure = false;
+                value->removable = false;
+                break;
+            }
+
+            case OP_POP: {
+                StackEntry value = stack[--height];
+                if (value.removable && value.end == offset) deleteCode(ir, value.start, next);
+                break;
+            }
+
+            case OP_JUMP_IF_FALSE:
+                if (settled) {
+                    Edit* edit = addEdit(ir, EDIT_REPLACE, offset, next);
+                    if (edit != NULL && block->succLive[1]) jumpTo(edit, jumpTarget(chunk, offset));
+                }
+                break;
+
+            case OP_JUMP_IF_LESS:
+            case OP_JUMP_IF_NOT_LESS:
+            case OP_JUMP_IF_GREATER:
+            case OP_JUMP_IF_NOT_GREATER:
+            case OP_JUMP_IF_EQUAL:
+            case OP_JUMP_IF_NOT_EQUAL: {
+                StackEntry b = stack[--height];
+                StackEntry a = stack[--height];
+                if (!settled) break;
+
+                Edit* edit;
+                if (a.removable && b.removable && a.end == b.start && b.end == offset) {
+                    edit = addEdit(ir, EDIT_REPLACE, a.start, next);
+                } else {
+                    edit = addEdit(ir, EDIT_REPLACE, offset, next);
+                    if (edit != NULL) {
+                        editByte(edit, OP_POP);
+                        editByte(edit, OP_POP);
+                    }
+                }
+                if (edit != NULL && block->succLive[1]) jumpTo(edit, jumpTarget(chunk, offset));
+                break;
+            }
+
+            default: {
+                int pops, pushes;
+                stackEffect(chunk, offset, &pops, &pushes);
+                height -= pops;
+                for (int i = 0; i < pushes; i++) {
+                    stack[height++] = (StackEntry){ir->nodeAt[offset], -1, -1, 0, false, false};
+                }
+                break;
+            }
+        }
+        offset = next;
+    }
+}
+
+
+
+static int intersect(IR* ir, int a, int b) {
+    while (a != b) {
+        while (ir->blocks[a].rpo > ir->blocks[b].rpo) a = ir->blocks[a].idom;
+        while (ir->blocks[b].rpo > ir->blocks[a].rpo) b = ir->blocks[b].idom;
+    }
+    return a;
+}
+
+
+
+// the dominator tree of the executable blocks (Cooper, Harvey and Kennedy)
+static void findDominators(IR* ir) {
+    ir->blocks[0].idom = 0;
+
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 1; i < ir->orderCount; i++) {
+            int index = ir->order[i];
+            Block* block = &ir->blocks[index];
+            if (!block->executable) continue;
+
+            int idom = -1;
+            for (int way = 0; way < block->predCount; way++) {
+                int from = block->preds[way].block;
+                if (!wayLive(ir, block, index, way) || ir->blocks[from].idom == -1) continue;
+                idom = idom == -1 ? from : intersect(ir, from, idom);
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    } while (changed);
+}
+
+
+
+static bool dominates(IR* ir, int a, int b) {
+    while (ir->blocks[b].rpo > ir->blocks[a].rpo) b = ir->blocks[b].idom;
+    return a == b;
+}
+
+
+
+/**
+ * Finds the natural loops: a way from a block back to one that dominates
+ * it makes that one a header, and the loop is whatever reaches the way
+ * without passing through the header.
+ */
+static void findLoops(IR* ir) {
+    int* work = NEW_ARRAY(int, ir->blockCount);
+
+    for (int i = 0; i < ir->orderCount; i++) {
+        int index = ir->order[i];
+        Block* block = &ir->blocks[index];
+        if (!block->executable) continue;
+
+        for (int edge = 0; edge < block->succCount; edge++) {
+            int header = block->succs[edge];
+            if (!block->succLive[edge] || !dominates(ir, header, index)) continue;
+
+            Loop* loop = NULL;
+            for (int l = 0; l < ir->loopCount; l++) {
+                if (ir->loops[l].header == header) loop = &ir->loops[l];
+            }
+            if (loop == NULL) {
+                ir->loops = (Loop*)realloc(ir->loops, sizeof(Loop) * (ir->loopCount + 1));
+                if (ir->loops == NULL) exit(1);
+                loop = &ir->loops[ir->loopCount++];
+                loop->header = header;
+                loop->body = NEW_ARRAY(bool, ir->blockCount);
+                loop->body[header] = true;
+                loop->size = 1;
+            }
+
+            int count = 0;
+            if (!loop->body[index]) {
+                loop->body[index] = true;
+                loop->size++;
+                work[count++] = index;
+            }
+            while (count > 0) {
+                Block* member = &ir->blocks[work[--count]];
+                for (int way = 0; way < member->predCount; way++) {
+                    int from = member->preds[way].block;
+                    if (!wayLive(ir, member, work[count], way) || loop->body[from]) continue;
+                    loop->body[from] = true;
+                    loop->size++;
+                    work[count++] = from;
+                }
+            }
+        }
+    }
+    free(work);
+}
+
+
+
+/**
+ * Whether code inserted at the start of the header runs exactly on
+ * entering the loop: every way in from outside comes from ahead of the
+ * header (falling or jumping forward onto it) and every way round from
+ * inside comes from behind it (jumping back past the inserted code).
+ */
+static bool hasPreheader(IR* ir, Loop* loop) {
+    Block* header = &ir->blocks[loop->header];
+    for (int way = 0; way < header->predCount; way++) {
+        if (!wayLive(ir, header, loop->header, way)) continue;
+        int from = header->preds[way].block;
+        if (loop->body[from] != (ir->blocks[from].start >= header->start)) return false;
+    }
+    return true;
+}
+
+
+
+/**
+ * Whether an operator's code computes the same value anywhere in the loop,
+ * and computes it on entry too: every local it reads holds, on entering
+ * the header, the value the read sees, and that value comes from outside.
+ */
+static bool isInvariant(IR* ir, Node* node, Loop* loop) {
+    Chunk* chunk = ir->chunk;
+    Block* header = &ir->blocks[loop->header];
+
+    for (int offset = node->start; offset < node->end; offset += instructionLength(chunk, offset)) {
+        uint8_t* code = &chunk->code[offset];
+        switch (code[0]) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+            case OP_NULL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_NOT:
+            case OP_NEGATE:
+                break;
+
+            case OP_GET_LOCAL:
+            case OP_GET_LOCAL_LONG: {
+                int slot = localSlot(code);
+                int value = ir->nodeAt[offset];
+                if (slot >= header->height || header->entry[slot] != value) return false;
+                if (loop->body[ir->nodes[value].block]) return false;
+                break;
+            }
+
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
+
+static int newTemp(IR* ir) {
+    if (ir->temps >= ir->maxTemps) return -1;
+    return ir->function->arity + 1 + ir->temps++;
+}
+
+
+
+static int compareRanges(const void* a, const void* b) {
+    const Node* x = *(Node* const*)a;
+    const Node* y = *(Node* const*)b;
+    if (x->start != y->start) return x->start - y->start;
+    return y->end - x->end;
+}
+
+
+
+/**
+ * Loop-invariant code motion.
+ *
+ * An invariant expression that can't fail (so it's safe to compute even
+ * when the loop body wouldn't have) is computed ahead of the outermost
+ * loop it's invariant in, into a temporary, and read from there inside.
+ * Where invariant expressions nest, the outermost one moves.
+ */
+static void hoistInvariants(IR* ir) {
+    findLoops(ir);
+    if (ir->loopCount == 0) return;
+
+    Node** candidates = NEW_ARRAY(Node*, ir->nodeCount);
+    int count = 0;
+    for (int i = 0; i < ir->nodeCount; i++) {
+        Node* node = &ir->nodes[i];
+        if ((node->kind != NODE_UNARY && node->kind != NODE_BINARY) || node->start == -1) continue;
+        if (!node->removable || node->length < 2 || node->lattice == LATTICE_CONSTANT) continue;
+        if (!ir->blocks[node->block].executable) continue;
+        candidates[count++] = node;
+    }
+    qsort(candidates, count, sizeof(Node*), compareRanges);
+
+    int taken = -1;         // end of the last range moved
+    for (int i = 0; i < count; i++) {
+        Node* node = candidates[i];
+        if (node->start < taken) continue;
+        if (!canReplace(ir, node->start, node->end) || isReplaced(ir, node->start, node->end) ||
+            insertWithin(ir, node->start, node->end)) {
+            continue;
+        }
+
+        Loop* best = NULL;
+        for (int l = 0; l < ir->loopCount; l++) {
+            Loop* loop = &ir->loops[l];
+            if (!loop->body[node->block] || (best != NULL && best->size >= loop->size)) continue;
+            if (hasPreheader(ir, loop) && isInvariant(ir, node, loop)) best = loop;
+        }
+        if (best == NULL) continue;
+
+        int temp = newTemp(ir);
+        if (temp == -1) break;
+
+        Edit* edit = addEdit(ir, EDIT_BEFORE, ir->blocks[best->header].start, ir->blocks[best->header].start);
+        edit->copyStart = node->start;
+        edit->copyEnd = node->end;
+        editByte(edit, OP_SET_LOCAL);
+        editByte(edit, (uint8_t)temp);
+        editByte(edit, OP_POP);
+
+        edit = addEdit(ir, EDIT_REPLACE, node->start, node->end);
+        editByte(edit, OP_GET_LOCAL);
+        editByte(edit, (uint8_t)temp);
+        taken = node->end;
+    }
+    free(candidates);
+}
+
+
+
+// a key for the values an operator (or a constant) computes
+typedef struct {
+    int op;
+    int64_t a;
+    int64_t b;
+    int node;               // the first node found with it, -1 for an empty entry
+} ValueKey;
+
+
+typedef struct {
+    ValueKey* entries;
+    int capacity;           // a power of two
+    // entries made, for undoing on leaving a subtree of the dominator tree
+    int* log;
+    int logCount;
+} ValueTable;
+
+
+
+static bool valueKey(IR* ir, Node* node, ValueKey* key) {
+    if (node->lattice == LATTICE_CONSTANT) {
+        if (!isFoldable(node->value)) return false;
+        key->op = 256 + node->value.type;
+        key->a = 0;
+        key->b = 0;
+        if (IS_NUMBER(node->value)) memcpy(&key->a, &node->value.as.number, sizeof(double));
+        else if (IS_INT(node->value)) key->a = AS_INT(node->value);
+        else if (IS_BOOL(node->value)) key->a = AS_BOOL(node->value);
+        return true;
+    }
+    if (node->kind != NODE_UNARY && node->kind != NODE_BINARY) return false;
+
+    key->op = node->op;
+    key->a = ir->nodes[node->a].number;
+    key->b = node->b != -1 ? ir->nodes[node->b].number : -1;
+    return true;
+}
+
+
+
+static int findKey(ValueTable* table, ValueKey* key) {
+    uint64_t hash = (uint64_t)key->op * 0x9E3779B97F4A7C15u ^ (uint64_t)key->a * 0xC2B2AE3D27D4EB4Fu ^
+                    (uint64_t)key->b * 0x165667B19E3779F9u;
+    int index = (int)((hash ^ (hash >> 29)) & (uint64_t)(table->capacity - 1));
+    for (;;) {
+        ValueKey* entry = &table->entries[index];
+        if (entry->node == -1 ||
+            (entry->op == key->op && entry->a == key->a && entry->b == key->b)) {
+            return index;
+        }
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+
+
+/**
+ * Keeps the value of `source` for `use`, which the walk found computes the
+ * same value where `source` has already run: `source` stores it in a
+ * temporary on the way, and `use`'s code becomes a read of that.
+ */
+static void reuseValue(IR* ir, Node* source, Node* use) {
+    if (use->start == -1 || !use->pure || use->length < CSE_MIN_LENGTH) return;
+    if (use->lattice == LATTICE_CONSTANT) return;
+    if (source->start == -1 || isReplaced(ir, source->end - 1, source->end)) return;
+    if (isReplaced(ir, use->start, use->end) || !canReplace(ir, use->start, use->end) ||
+        insertWithin(ir, use->start, use->end)) {
+        return;
+    }
+
+    if (source->temp == -1) {
+        source->temp = newTemp(ir);
+        if (source->temp == -1) return;
+        Edit* edit = addEdit(ir, EDIT_AFTER, source->end, source->end);
+        editByte(edit, OP_SET_LOCAL);
+        editByte(edit, (uint8_t)source->temp);
+    }
+
+    Edit* edit = addEdit(ir, EDIT_REPLACE, use->start, use->end);
+    editByte(edit, OP_GET_LOCAL);
+    editByte(edit, (uint8_t)source->temp);
+}
+
+
+
+/**
+ * Common-subexpression elimination by dominator-tree value numbering.
+ *
+ * Walking the dominator tree depth first, each operator is looked up by
+ * its opcode and the value numbers of its operands among those computed in
+ * the blocks above it (and earlier in its own); a match computes the same
+ * value, already at hand.
+ */
+static void eliminateCommon(IR* ir) {
+    int* firstChild = NEW_ARRAY(int, ir->blockCount);
+    int* sibling = NEW_ARRAY(int, ir->blockCount);
+    for (int i = 0; i < ir->blockCount; i++) firstChild[i] = -1;
+    for (int i = ir->orderCount - 1; i > 0; i--) {
+        int index = ir->order[i];
+        Block* block = &ir->blocks[index];
+        if (!block->executable || block->idom == -1) continue;
+        sibling[index] = firstChild[block->idom];
+        firstChild[block->idom] = index;
+    }
+
+    ValueTable table;
+    table.capacity = 16;
+    while (table.capacity < 2 * ir->nodeCount) table.capacity *= 2;
+    table.entries = NEW_ARRAY(ValueKey, table.capacity);
+    for (int i = 0; i < table.capacity; i++) table.entries[i].node = -1;
+    table.log = NEW_ARRAY(int, ir->nodeCount + 1);
+    table.logCount = 0;
+
+    // depth first; a negative entry -(mark + 1) means leaving a block
+    int* work = NEW_ARRAY(int, 2 * ir->blockCount + 1);
+    int count = 0;
+    work[count++] = 0;
+
+    while (count > 0) {
+        int item = work[--count];
+        if (item < 0) {
+            int mark = -item - 1;
+            while (table.logCount > mark) table.entries[table.log[--table.logCount]].node = -1;
+            continue;
+        }
+
+        work[count++] = -table.logCount - 1;
+        Block* block = &ir->blocks[item];
+        for (int n = block->firstNode; n < block->nodeEnd; n++) {
+            Node* node = &ir->nodes[n];
+            ValueKey key;
+            if (node->forward != -1 || !valueKey(ir, node, &key)) continue;
+
+            int slot = findKey(&table, &key);
+            ValueKey* entry = &table.entries[slot];
+            if (entry->node == -1) {
+                *entry = key;
+                entry->node = n;
+                table.log[table.logCount++] = slot;
+                continue;
+            }
+
+            node->number = entry->node;
+            if (node->kind == NODE_UNARY || node->kind == NODE_BINARY) {
+                reuseValue(ir, &ir->nodes[entry->node], node);
+            }
+        }
+
+        for (int child = firstChild[item]; child != -1; child = sibling[child]) work[count++] = child;
+    }
+
+    free(work);
+    free(table.entries);
+    free(table.log);
+    free(firstChild);
+    free(sibling);
+
+    // a store whose every reader went with a larger range that was reused
+    int kept = 0;
+    for (int i = 0; i < ir->editCount; i++) {
+        Edit* edit = &ir->edits[i];
+        bool read = edit->kind != EDIT_AFTER;
+        for (int j = 0; j < ir->editCount && !read; j++) {
+            Edit* other = &ir->edits[j];
+            read = other->kind == EDIT_REPLACE && other->length == 2 && other->bytes[0] == OP_GET_LOCAL &&
+                   other->bytes[1] == edit->bytes[1];
+        }
+        if (!read) {
+            free(edit->bytes);
+            continue;
+        }
+        ir->edits[kept++] = *edit;
+    }
+    ir->editCount = kept;
+}
+
+
+
+static int compareEdits(const void* a, const void* b) {
+    const Edit* x = (const Edit*)a;
+    const Edit* y = (const Edit*)b;
+    if (x->start != y->start) return x->start - y->start;
+    if (x->kind != y->kind) return (int)x->kind - (int)y->kind;
+    return x->order - y->order;
+}
+
+
+
+static int editLength(Edit* edit) {
+    int length = edit->length;
+    if (edit->copyStart != -1) length += edit->copyEnd - edit->copyStart;
+    return length;
+}
+
+
+
+// locals move up past the temporaries; the callee and parameters stay put
+static int renumber(IR* ir, int slot) {
+    return slot > ir->function->arity ? slot + ir->temps : slot;
+}
+
+
+
+static void writeShort(Chunk* out, int value, int line) {
+    writeChunk(out, (uint8_t)((value >> 8) & 0xff), line);
+    writeChunk(out, (uint8_t)(value & 0xff), line);
+}
+
+
+
+/**
+ * Copies the instruction at `offset` into `out`, with its slots renumbered
+ * and its jump moved to where its target went.
+ *
+ * @return false if a jump no longer fits its 16-bit offset.
+ */
+static bool emitInstruction(IR* ir, Chunk* out, int offset, int line, int* forward, int* backward) {
+    Chunk* chunk = ir->chunk;
+    uint8_t* code = &chunk->code[offset];
+    int length = instructionLength(chunk, offset);
+    int at = out->count;
+
+    switch (code[0]) {
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+            writeChunk(out, code[0], line);
+            writeChunk(out, (uint8_t)renumber(ir, code[1]), line);
+            return true;
+
+        case OP_GET_LOCAL_LONG:
+        case OP_SET_LOCAL_LONG: {
+            int slot = renumber(ir, localSlot(code));
+            writeChunk(out, code[0], line);
+            writeChunk(out, (uint8_t)(slot >> 16), line);
+            writeShort(out, slot, line);
+            return true;
+        }
+
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_EQUAL: {
+            int distance = forward[jumpTarget(chunk, offset)] - (at + 3);
+            if (distance < 0 || distance > UINT16_MAX) return false;
+            writeChunk(out, code[0], line);
+            writeShort(out, distance, line);
+            return true;
+        }
+
+        case OP_LOOP: {
+            int distance = at + 4 - backward[jumpTarget(chunk, offset)];
+            if (distance < 0 || distance > UINT16_MAX) return false;
+            writeChunk(out, code[0], line);
+            writeChunk(out, code[1], line);
+            writeShort(out, distance, line);
+            return true;
+        }
+
+        case OP_FOR_INCR_LT:
+        case OP_FOR_INCR_LT_CONST: {
+            int distance = at + 6 - backward[jumpTarget(chunk, offset)];
+            if (distance < 0 || distance > UINT16_MAX) return false;
+            writeChunk(out, code[0], line);
+            writeChunk(out, (uint8_t)renumber(ir, code[1]), line);
+            writeChunk(out, code[0] == OP_FOR_INCR_LT ? (uint8_t)renumber(ir, code[2]) : code[2], line);
+            writeChunk(out, code[3], line);
+            writeShort(out, distance, line);
+            return true;
+        }
+
+        case OP_INLINE_GUARD: {
+            int distance = forward[jumpTarget(chunk, offset)] - (at + 7);
+            if (distance < 0 || distance > UINT16_MAX) return false;
+            for (int i = 0; i < 5; i++) writeChunk(out, code[i], line);
+            writeShort(out, distance, line);
+            return true;
+        }
+
+        case OP_CLOSURE:
+        case OP_CLOSURE_LONG: {
+            int capture = firstCapture(chunk, offset);
+            for (int i = offset; i < capture; i++) writeChunk(out, chunk->code[i], line);
+            for (; capture < offset + length; capture += 3) {
+                uint8_t kind = chunk->code[capture];
+                int index = readShort(&chunk->code[capture + 1]);
+                writeChunk(out, kind, line);
+                writeShort(out, isCapturedLocal(kind) ? renumber(ir, index) : index, line);
+            }
+            return true;
+        }
+
+        default:
+            for (int i = 0; i < length; i++) writeChunk(out, code[i], line);
+            return true;
+    }
+}
+
+
+
+static bool emitEdit(IR* ir, Chunk* out, Edit* edit, int* forward, int* backward) {
+    Chunk* chunk = ir->chunk;
+    int line = getLine(chunk, edit->start < chunk->count ? edit->start : chunk->count - 1);
+
+    if (edit->copyStart != -1) {
+        for (int offset = edit->copyStart; offset < edit->copyEnd; offset += instructionLength(chunk, offset)) {
+            emitInstruction(ir, out, offset, line, forward, backward);
+        }
+    }
+
+    int at = out->count;
+    for (int i = 0; i < edit->length; i++) writeChunk(out, edit->bytes[i], line);
+    if (edit->jump != -1) {
+        int distance = forward[edit->target] - (at + edit->jump + 3);
+        if (distance < 0 || distance > UINT16_MAX) return false;
+        out->code[at + edit->jump + 1] = (uint8_t)((distance >> 8) & 0xff);
+        out->code[at + edit->jump + 2] = (uint8_t)(distance & 0xff);
+    }
+    return true;
+}
+
+
+
+/**
+ * Rebuilds the function's code with the edits in.
+ *
+ * A first pass lays the new code out: for every old offset, where a
+ * forward jump to it lands now and where a backward one does (past what
+ * was inserted on the way in). The second writes it into a fresh code
+ * array and line table, which replace the old ones only if every jump
+ * still fits.
+ */
+static void applyEdits(IR* ir) {
+    Chunk* chunk = ir->chunk;
+    int count = chunk->count;
+    qsort(ir->edits, ir->editCount, sizeof(Edit), compareEdits);
+
+    int* forward = NEW_ARRAY(int, count + 1);
+    int* backward = NEW_ARRAY(int, count + 1);
+    int position = 0;
+    int e = 0;
+    for (int offset = 0;;) {
+        while (e < ir->editCount && ir->edits[e].start == offset && ir->edits[e].kind == EDIT_AFTER) {
+            position += editLength(&ir->edits[e++]);
+        }
+        forward[offset] = position;
+        while (e < ir->editCount && ir->edits[e].start == offset && ir->edits[e].kind == EDIT_BEFORE) {
+            position += editLength(&ir->edits[e++]);
+        }
+        backward[offset] = position;
+        if (offset == count) break;
+
+        if (e < ir->editCount && ir->edits[e].start == offset) {
+            Edit* edit = &ir->edits[e++];
+            position += editLength(edit);
+            for (int inner = offset + 1; inner < edit->end; inner++) {
+                forward[inner] = position;
+                backward[inner] = position;
+            }
+            offset = edit->end;
+            continue;
+        }
+        int length = instructionLength(chunk, offset);
+        for (int inner = offset + 1; inner < offset + length; inner++) {
+            forward[inner] = position + length;
+            backward[inner] = position + length;
+        }
+        position += length;
+        offset += length;
+    }
+
+    Chunk out;
+    initChunk(&out);
+    bool ok = true;
+    e = 0;
+    for (int offset = 0; ok;) {
+        while (ok && e < ir->editCount && ir->edits[e].start == offset && ir->edits[e].kind != EDIT_REPLACE) {
+            ok = emitEdit(ir, &out, &ir->edits[e++], forward, backward);
+        }
+        if (offset == count || !ok) break;
+
+        if (e < ir->editCount && ir->edits[e].start == offset) {
+            Edit* edit = &ir->edits[e++];
+            ok = emitEdit(ir, &out, edit, forward, backward);
+            offset = edit->end;
+            continue;
+        }
+        ok = emitInstruction(ir, &out, offset, getLine(chunk, offset), forward, backward);
+        offset += instructionLength(chunk, offset);
+    }
+
+    if (ok && out.count > 0) {
+        FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+        FREE_ARRAY(LineEntry, chunk->lines, chunk->lineCapacity);
+        chunk->code = out.code;
+        chunk->count = out.count;
+        chunk->capacity = out.capacity;
+        chunk->lines = out.lines;
+        chunk->lineCount = out.lineCount;
+        chunk->lineCapacity = out.lineCapacity;
+
+        for (int i = 0; i < chunk->inlinedCount; i++) {
+            chunk->inlined[i].start = forward[chunk->inlined[i].start];
+            chunk->inlined[i].end = forward[chunk->inlined[i].end];
+        }
+    } else {
+        FREE_ARRAY(uint8_t, out.code, out.capacity);
+        FREE_ARRAY(LineEntry, out.lines, out.lineCapacity);
+    }
+
+    free(forward);
+    free(backward);
+}
+
+
+
+static void freeIR(IR* ir) {
+    for (int i = 0; i < ir->nodeCount; i++) free(ir->nodes[i].inputs);
+    for (int i = 0; i < ir->blockCount; i++) {
+        Block* block = &ir->blocks[i];
+        free(block->preds);
+        free(block->entry);
+        free(block->exit);
+        free(block->jumpExit);
+        free(block->liveIn);
+    }
+    for (int i = 0; i < ir->editCount; i++) free(ir->edits[i].bytes);
+    for (int i = 0; i < ir->loopCount; i++) free(ir->loops[i].body);
+
+    free(ir->nodes);
+    free(ir->blocks);
+    free(ir->blockAt);
+    free(ir->order);
+    free(ir->nodeAt);
+    free(ir->heightAt);
+    free(ir->deadStores);
+    free(ir->escaped);
+    free(ir->edits);
+    free(ir->loops);
+}
+
+
+
+void optimizeFunction(ObjFunction* function, int level) {
+    // a catch block is entered from wherever its try block throws, an
+    // edge the graph doesn't have
+    if (function->chunk.handlerCount > 0) return;
+
+    IR ir;
+    memset(&ir, 0, sizeof(IR));
+    ir.function = function;
+    ir.chunk = &function->chunk;
+    ir.level = level;
+
+    scanSlots(&ir);
+    if (!findBlocks(&ir) || !buildGraph(&ir)) {
+        freeIR(&ir);
+        return;
+    }
+
+    propagate(&ir);
+    findDeadStores(&ir);
+
+    for (int i = 0; i < ir.blockCount; i++) {
+        if (!ir.blocks[i].executable) deleteCode(&ir, ir.blocks[i].start, ir.blocks[i].end);
+    }
+    StackEntry* stack = NEW_ARRAY(StackEntry, ir.maxHeight + 1);
+    for (int i = 0; i < ir.orderCount; i++) {
+        Block* block = &ir.blocks[ir.order[i]];
+        if (block->executable) rewriteBlock(&ir, block, stack);
+    }
+    free(stack);
+
+    if (level >= 2) {
+        findDominators(&ir);
+        hoistInvariants(&ir);
+        eliminateCommon(&ir);
+    }
+
+    if (ir.temps > 0) {
+        // the temporaries' slots, right above the parameters
+        Edit* prologue = addEdit(&ir, EDIT_BEFORE, 0, 0);
+        prologue->order = -1;
+        for (int i = 0; i < ir.temps; i++) editByte(prologue, OP_NULL);
+    }
+    if (ir.editCount > 0) applyEdits(&ir);
+    freeIR(&ir);
+}
@@ -1,11 +1,18 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "include/vm.h"
 #include "include/common.h"
+#include "include/marker.h"
 #include "include/chunk.h"
 #include "include/debug.h"
+#include "include/ir.h"
+#include "include/memory.h"
 
 
 /**
@@ -37,6 +44,7 @@ static void repl() {
         }
 
         interpret(line);
+        releaseSource(line);    // the next line overwrites the buffer
     }
 }
 
@@ -87,31 +95,113 @@ static char* readFile(const char* path) {
 
 
 
-static void runFile(const char* path) {
-    char* source = readFile(path);
-    InterpretResult result = interpret(source);
-    free(source);
+/**
+ * @brief Maps a script into memory instead of reading it.
+ *
+ * The scanner needs a terminating '\0'. Bytes past the end of the file in
+ * its last page read as zeros, so that works unless the size is an exact
+ * multiple of the page size (or zero); those files are read normally.
+ *
+ * @param path The path to the script.
+ * @param mappedSize Set to the mapping's size, or 0 if the file was read
+ *                   into a malloc()ed buffer instead.
+ * @return The script's text.
+ */
+static const char* mapFile(const char* path, size_t* mappedSize) {
+    *mappedSize = 0;
 
-    // handle edge cases
-    if (result == INTERPRET_COMPILE_ERROR) exit(65);
-    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return readFile(path);      // let readFile() report the error
+
+    struct stat info;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (fstat(fd, &info) != 0 || info.st_size == 0 || (size_t)info.st_size % page == 0) {
+        close(fd);
+        return readFile(path);
+    }
+
+    void* text = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) return readFile(path);
+
+    *mappedSize = (size_t)info.st_size;
+    return text;
+}
+
+
+
+static void unmapFile(const char* text, size_t mappedSize) {
+    if (mappedSize == 0) free((char*)text);
+    else munmap((void*)text, mappedSize);
+}
+
+
+
+static void usage() {
+    fprintf(stderr, "Usage: mavix [--gc-stats] [--gc-max-pause-us N] [--gc-threads N] [-O0|-O1|-O2] [--strict] [path]\n");
+    exit(64);
 }
 
 
 
 int main(int argc, const char* argv[]) {
-    initVM();
+    const char* path = NULL;
+    bool gcStats = false;
+    long maxPauseUs = 0;        // 0 keeps major collections stop-the-world
+    long gcThreads = 1;
+    int optimizeLevel = 0;      // bytecode as the compiler emits it
+    bool strict = false;        // function bodies compile on their first call
 
     // handling command-line args
-    if (argc == 1) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gc-stats") == 0) {
+            gcStats = true;
+        } else if (strcmp(argv[i], "--gc-max-pause-us") == 0) {
+            if (++i == argc) usage();
+            char* end;
+            maxPauseUs = strtol(argv[i], &end, 10);
+            if (*end != '\0' || maxPauseUs <= 0) usage();
+        } else if (strcmp(argv[i], "--gc-threads") == 0) {
+            if (++i == argc) usage();
+            char* end;
+            gcThreads = strtol(argv[i], &end, 10);
+            if (*end != '\0' || gcThreads < 1 || gcThreads > MARK_THREADS_MAX) usage();
+        } else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' &&
+                   argv[i][2] <= '0' + OPTIMIZE_MAX && argv[i][3] == '\0') {
+            optimizeLevel = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--strict") == 0) {
+            strict = true;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage();
+        } else {
+            path = argv[i];
+        }
+    }
+
+    initVM();
+    vm.gc.maxPause = maxPauseUs / 1e6;
+    vm.gc.markThreads = (int)gcThreads;
+    vm.optimizeLevel = optimizeLevel;
+    vm.strict = strict;
+
+    InterpretResult result = INTERPRET_OK;
+    const char* source = NULL;
+    size_t mappedSize = 0;
+    if (path == NULL) {
         repl();                 // activated REPL
-    } else if (argc == 2) {
-        runFile(argv[1]);       // scans the code
     } else {
-        fprintf(stderr, "Usage: mavix [path]\n");
-        exit(64);
+        // string constants point into the script, so it stays loaded
+        // until the VM is gone
+        source = mapFile(path, &mappedSize);
+        result = interpret(source);
     }
-    
+
+    if (gcStats) printGCStats();
     freeVM();
+    if (source != NULL) unmapFile(source, mappedSize);
+
+    // handle edge cases
+    if (result == INTERPRET_COMPILE_ERROR) exit(65);
+    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
     return 0;
 }
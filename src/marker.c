@@ -0,0 +1,300 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "include/marker.h"
+#include "include/memory.h"
+
+// slots per work-stealing deque (a power of two); work beyond this spills
+// into the owner's private overflow stack
+#define DEQUE_SIZE 4096
+
+
+/**
+ * A Chase-Lev work-stealing deque of gray objects.
+ *
+ * The owning thread pushes and pops at `bottom`; other threads steal from
+ * `top`. The buffer has a fixed size, so it never has to be swapped out
+ * from under a thief.
+ */
+typedef struct {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    _Atomic(Obj*) buffer[DEQUE_SIZE];
+} Deque;
+
+
+typedef struct {
+    Deque deque;
+
+    // gray objects that didn't fit in the deque (only the owner sees these)
+    Obj** overflow;
+    int overflowCount;
+    int overflowCapacity;
+
+    pthread_t thread;
+    unsigned int seed;          // for picking steal victims
+} Marker;
+
+
+static Marker* markers = NULL;
+static int markerCount = 0;     // marking threads, the collecting one included
+
+// parking and waking the helper threads
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static unsigned long generation = 0;    // bumped once per marking phase
+static int busy = 0;                    // helpers still marking this phase
+static bool stopping = false;
+
+// the current phase
+static atomic_int idle;                 // markers that found no work anywhere
+static bool minorPhase;
+
+
+static void push(Marker* self, Obj* object) {
+    Deque* deque = &self->deque;
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+    if (bottom - top >= DEQUE_SIZE) {
+        if (self->overflowCapacity < self->overflowCount + 1) {
+            self->overflowCapacity = GROW_CAPACITY(self->overflowCapacity);
+            self->overflow = (Obj**)realloc(self->overflow, sizeof(Obj*) * self->overflowCapacity);
+            if (self->overflow == NULL) exit(1);
+        }
+        self->overflow[self->overflowCount++] = object;
+        return;
+    }
+
+    atomic_store_explicit(&deque->buffer[bottom & (DEQUE_SIZE - 1)], object, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+
+// owner side: take the most recently pushed object, or NULL
+static Obj* pop(Marker* self) {
+    Deque* deque = &self->deque;
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        // already empty
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    Obj* object = atomic_load_explicit(&deque->buffer[bottom & (DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (top == bottom) {
+        // the last one -> race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            object = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return object;
+}
+
+
+// thief side: take the oldest object, or NULL if empty or we lost a race
+static Obj* steal(Deque* deque) {
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return NULL;
+
+    Obj* object = atomic_load_explicit(&deque->buffer[top & (DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return object;
+}
+
+
+// next object for the owner: its deque first, then its overflow stack
+static Obj* take(Marker* self) {
+    Obj* object = pop(self);
+    if (object != NULL || self->overflowCount == 0) return object;
+
+    // move a batch back into the deque, where the others can steal it
+    int batch = self->overflowCount < DEQUE_SIZE / 2 ? self->overflowCount : DEQUE_SIZE / 2;
+    for (int i = 0; i < batch; i++) {
+        push(self, self->overflow[--self->overflowCount]);
+    }
+    return pop(self);
+}
+
+
+static Obj* stealFromOthers(Marker* self) {
+    for (int attempt = 0; attempt < 2 * markerCount; attempt++) {
+        Marker* victim = &markers[rand_r(&self->seed) % markerCount];
+        if (victim == self) continue;
+
+        Obj* object = steal(&victim->deque);
+        if (object != NULL) return object;
+    }
+    return NULL;
+}
+
+
+static bool workVisible() {
+    for (int i = 0; i < markerCount; i++) {
+        Deque* deque = &markers[i].deque;
+        if (atomic_load_explicit(&deque->top, memory_order_acquire) <
+            atomic_load_explicit(&deque->bottom, memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Marks an object reached by a marker and queues it on that marker's deque.
+ *
+ * The mark bit is claimed with an atomic exchange, so when two markers
+ * reach the same object only one of them traces it.
+ */
+static void markVisitor(Obj* object, void* context) {
+    if (minorPhase && object->isOld) return;
+    if (__atomic_load_n(&object->isMarked, __ATOMIC_RELAXED)) return;
+    if (__atomic_exchange_n(&object->isMarked, true, __ATOMIC_RELAXED)) return;
+
+    push((Marker*)context, object);
+}
+
+
+/**
+ * Marks until no marker has work left.
+ *
+ * A marker that can neither take nor steal anything counts itself idle and
+ * waits; if work shows up in some deque it goes back to stealing. Once all
+ * of them are idle every deque is empty and nobody can push more, so the
+ * phase is over.
+ */
+static void drain(Marker* self) {
+    for (;;) {
+        Obj* object;
+        while ((object = take(self)) != NULL) {
+            visitReferences(object, markVisitor, self);
+        }
+
+        object = stealFromOthers(self);
+        if (object != NULL) {
+            visitReferences(object, markVisitor, self);
+            continue;
+        }
+
+        atomic_fetch_add(&idle, 1);
+        for (;;) {
+            if (atomic_load(&idle) == markerCount) return;
+            if (workVisible()) {
+                atomic_fetch_sub(&idle, 1);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+
+static void* markerMain(void* arg) {
+    Marker* self = (Marker*)arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (generation == seen && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+
+        drain(self);
+
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) pthread_cond_signal(&finished);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+
+static void startMarkers(int threads) {
+    markers = (Marker*)aligned_alloc(64, sizeof(Marker) * threads);
+    if (markers == NULL) exit(1);
+
+    stopping = false;
+    markerCount = 1;        // the collecting thread is marker 0
+    for (int i = 0; i < threads; i++) {
+        Marker* marker = &markers[i];
+        atomic_init(&marker->deque.top, 0);
+        atomic_init(&marker->deque.bottom, 0);
+        marker->overflow = NULL;
+        marker->overflowCount = 0;
+        marker->overflowCapacity = 0;
+        marker->seed = (unsigned int)i * 2654435761u + 1;
+
+        if (i == 0) continue;
+        // if the system won't give us more threads, make do with fewer
+        if (pthread_create(&marker->thread, NULL, markerMain, marker) != 0) break;
+        markerCount++;
+    }
+}
+
+
+void stopMarkers() {
+    if (markers == NULL) return;
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 1; i < markerCount; i++) {
+        pthread_join(markers[i].thread, NULL);
+    }
+    for (int i = 0; i < markerCount; i++) {
+        free(markers[i].overflow);
+    }
+
+    free(markers);
+    markers = NULL;
+    markerCount = 0;
+}
+
+
+void markParallel(Obj** grays, int count, int threads, bool minor) {
+    if (threads > MARK_THREADS_MAX) threads = MARK_THREADS_MAX;
+    if (markers == NULL) startMarkers(threads);
+
+    minorPhase = minor;
+
+    // deal the roots out round-robin so every marker starts with some work
+    for (int i = 0; i < count; i++) {
+        push(&markers[i % markerCount], grays[i]);
+    }
+    atomic_store(&idle, 0);
+
+    pthread_mutex_lock(&lock);
+    busy = markerCount - 1;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    drain(&markers[0]);
+
+    pthread_mutex_lock(&lock);
+    while (busy > 0) pthread_cond_wait(&finished, &lock);
+    pthread_mutex_unlock(&lock);
+}
@@ -1,7 +1,62 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "include/compiler.h"
+#include "include/marker.h"
 #include "include/memory.h"
+#include "include/vm.h"
+
+// defaults for the generational collector
+#define NURSERY_SIZE        ((size_t)1024 * 1024)
+#define MIN_NURSERY_SIZE    ((size_t)16 * 1024)
+#define FIRST_MAJOR_GC      ((size_t)8 * 1024 * 1024)
+#define GC_HEAP_GROW_FACTOR 2
+#define PROMOTION_AGE       2
+
+// incremental major collections: slice often, and look at the clock only
+// every so many objects
+#define GC_STEP_SIZE        ((size_t)16 * 1024)
+#define SLICE_CHECK         64
+
+// below this many gray objects, waking the marking threads isn't worth it
+#define PARALLEL_MIN_GRAY   256
+
+
+/**
+ * Whether allocation has reached the point where the collector should run.
+ *
+ * The nursery can't be collected in the middle of an incremental mark (a
+ * minor collection would clear the marks the major one relies on), so
+ * while marking only slices are due. Sweeping touches only the old
+ * generation, so minor collections carry on alongside it.
+ */
+static inline bool collectionDue() {
+    switch (vm.gc.phase) {
+        case GC_IDLE:     return vm.gc.nurseryAllocated > vm.gc.nurserySize;
+        case GC_MARKING:  return vm.gc.stepAllocated > vm.gc.stepSize;
+        case GC_SWEEPING: return vm.gc.stepAllocated > vm.gc.stepSize ||
+                                 vm.gc.nurseryAllocated > vm.gc.nurserySize;
+    }
+    return false;
+}
+
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+    vm.bytesAllocated += newSize - oldSize;     // wraps correctly when shrinking
+
+    if (newSize > oldSize) {
+#ifdef DEBUG_STRESS_GC
+        collectGarbage();
+#endif
+        vm.gc.nurseryAllocated += newSize - oldSize;
+        vm.gc.stepAllocated += newSize - oldSize;
+        if (collectionDue()) collectGarbage();
+    }
+
     // if the new size is 0, free the memory
     if (newSize == 0) {
         free(pointer);
@@ -11,4 +66,862 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
     void* result = realloc(pointer, newSize);
     if (result == NULL) exit(1);    // If the result is NULL, exit the program
     return result;
-}
\ No newline at end of file
+}
+
+
+void* reserveGuarded(size_t* size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    for (size_t bytes = *size; bytes >= page; bytes /= 2) {
+        bytes = (bytes + page - 1) & ~(page - 1);   // round up to whole pages
+        void* base = mmap(NULL, bytes + page, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) continue;
+
+        // the page just past the end is the guard
+        if (mprotect((char*)base + bytes, page, PROT_NONE) != 0) {
+            munmap(base, bytes + page);
+            return NULL;
+        }
+
+        *size = bytes;
+        return base;
+    }
+
+    return NULL;
+}
+
+
+void releaseGuarded(void* base, size_t size) {
+    if (base == NULL) return;
+    munmap(base, size + (size_t)sysconf(_SC_PAGESIZE));
+}
+
+
+// release a single object according to its type
+static void freeObject(Obj* object) {
+    switch (object->type) {
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            freeChunk(&function->chunk);
+            FREE_ARRAY(uint16_t, function->loopHeat, function->loopCount);
+            if (function->ownsSource) free((char*)function->lazySource);
+            FREE(ObjFunction, object);
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            reallocate(object, sizeof(ObjClosure) + sizeof(Capture) * closure->captureCount, 0);
+            break;
+        }
+        case OBJ_UPVALUE:
+            FREE(ObjUpvalue, object);
+            break;
+        case OBJ_NATIVE:
+            FREE(ObjNative, object);
+            break;
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*)object;
+            switch (string->storage) {
+                case STRING_INLINE:
+                    // header and characters go in one call
+                    reallocate(object, sizeof(ObjString) + string->length + 1, 0);
+                    break;
+                case STRING_VIEW:
+                    FREE(ObjString, object);    // the characters belong to the source
+                    break;
+                case STRING_COPY:
+                    FREE_ARRAY(char, (char*)string->chars, string->length + 1);
+                    FREE(ObjString, object);
+                    break;
+            }
+            break;
+        }
+        case OBJ_ROPE: {
+            // the buffer goes with the last rope sharing it
+            StringBuffer* buffer = ((ObjRope*)object)->buffer;
+            if (--buffer->ropes == 0) {
+                FREE_ARRAY(char, buffer->chars, buffer->capacity);
+                FREE(StringBuffer, buffer);
+            }
+            FREE(ObjRope, object);
+            break;
+        }
+        case OBJ_SHAPE:
+            freeTable(&((ObjShape*)object)->transitions);
+            FREE(ObjShape, object);
+            break;
+        case OBJ_CLASS:
+            freeTable(&((ObjClass*)object)->methods);
+            FREE(ObjClass, object);
+            break;
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+            FREE(ObjInstance, object);
+            break;
+        }
+        case OBJ_BOUND_METHOD:
+            FREE(ObjBoundMethod, object);
+            break;
+    }
+}
+
+
+/**
+ * Frees an object the collector found unreachable.
+ *
+ * The intern table holds strings weakly, so a dead string is dropped from it
+ * first. Doing this per dead string keeps the cost of a collection
+ * proportional to the garbage rather than to the size of the table.
+ */
+static void freeDead(Obj* object) {
+    if (object->type == OBJ_STRING) {
+        tableDelete(&vm.strings, (ObjString*)object);
+    }
+    freeObject(object);
+}
+
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+
+void initGC(GC* gc) {
+    gc->nurserySize = NURSERY_SIZE;
+    gc->nurseryAllocated = 0;
+    gc->nextGC = FIRST_MAJOR_GC;
+    gc->promotionAge = PROMOTION_AGE;
+    gc->minor = false;
+
+    gc->maxPause = 0;
+    gc->stepSize = GC_STEP_SIZE;
+    gc->stepAllocated = 0;
+    gc->markThreads = 1;
+    gc->phase = GC_IDLE;
+    gc->sweeping = NULL;
+    gc->globalsCursor = 0;
+    gc->globalsCapacity = 0;
+    gc->youngGlobals = NULL;
+    gc->youngGlobalCount = 0;
+    gc->youngGlobalCapacity = 0;
+
+    gc->remembered = NULL;
+    gc->rememberedCount = 0;
+    gc->rememberedCapacity = 0;
+
+    gc->grayStack = NULL;
+    gc->grayCount = 0;
+    gc->grayCapacity = 0;
+
+    gc->stats = (GCStats){0};
+}
+
+
+// the collector's own arrays use plain malloc so they never re-enter the GC
+void freeGC(GC* gc) {
+    stopMarkers();
+    free(gc->remembered);
+    free(gc->grayStack);
+    free(gc->youngGlobals);
+    free(gc->stats.pauses);
+    initGC(gc);
+}
+
+
+/**
+ * Marks an object as reachable and queues it for tracing.
+ *
+ * A minor collection treats every old object as live without looking at
+ * it, which is what keeps minor pauses proportional to the young generation.
+ */
+void markObject(Obj* object) {
+    if (object == NULL) return;
+    if (object->isMarked) return;
+    if (vm.gc.minor && object->isOld) return;
+
+    object->isMarked = true;
+
+    if (vm.gc.grayCapacity < vm.gc.grayCount + 1) {
+        vm.gc.grayCapacity = GROW_CAPACITY(vm.gc.grayCapacity);
+        vm.gc.grayStack = (Obj**)realloc(vm.gc.grayStack, sizeof(Obj*) * vm.gc.grayCapacity);
+        if (vm.gc.grayStack == NULL) exit(1);
+    }
+
+    vm.gc.grayStack[vm.gc.grayCount++] = object;
+}
+
+
+void markValue(Value value) {
+    if (IS_OBJ(value)) markObject(AS_OBJ(value));
+}
+
+
+void markBarrier(Value value) {
+    if (vm.gc.phase == GC_MARKING) markValue(value);
+}
+
+
+void globalsBarrier(Value value) {
+    if (!IS_OBJ(value)) return;
+
+    if (!AS_OBJ(value)->isOld) {
+        if (vm.gc.youngGlobalCapacity < vm.gc.youngGlobalCount + 1) {
+            vm.gc.youngGlobalCapacity = GROW_CAPACITY(vm.gc.youngGlobalCapacity);
+            vm.gc.youngGlobals = (Value*)realloc(vm.gc.youngGlobals, sizeof(Value) * vm.gc.youngGlobalCapacity);
+            if (vm.gc.youngGlobals == NULL) exit(1);
+        }
+        vm.gc.youngGlobals[vm.gc.youngGlobalCount++] = value;
+    }
+    markBarrier(value);
+}
+
+
+/**
+ * While old objects are being swept in slices, an unmarked one may still be
+ * sitting in the intern table. Marking it keeps the sweeper from freeing it.
+ * If the sweeper already passed it the mark is stale, which only keeps a
+ * string alive for one extra major cycle.
+ */
+void reviveObject(Obj* object) {
+    if (vm.gc.phase == GC_SWEEPING && object->isOld) object->isMarked = true;
+}
+
+
+void rememberObject(Obj* owner) {
+    if (vm.gc.rememberedCapacity < vm.gc.rememberedCount + 1) {
+        vm.gc.rememberedCapacity = GROW_CAPACITY(vm.gc.rememberedCapacity);
+        vm.gc.remembered = (Obj**)realloc(vm.gc.remembered, sizeof(Obj*) * vm.gc.rememberedCapacity);
+        if (vm.gc.remembered == NULL) exit(1);
+    }
+
+    owner->isRemembered = true;
+    vm.gc.remembered[vm.gc.rememberedCount++] = owner;
+}
+
+
+static void visitValue(Value value, ObjVisitor visit, void* context) {
+    if (IS_OBJ(value)) visit(AS_OBJ(value), context);
+}
+
+
+static void visitArray(ValueArray* array, ObjVisitor visit, void* context) {
+    for (int i = 0; i < array->count; i++) {
+        visitValue(array->values[i], visit, context);
+    }
+}
+
+
+static void visitTable(Table* table, ObjVisitor visit, void* context) {
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->key == NULL) continue;
+        visit((Obj*)entry->key, context);
+        visitValue(entry->value, visit, context);
+    }
+}
+
+
+// names and shapes remembered by a chunk's property instructions
+static void visitCaches(Chunk* chunk, ObjVisitor visit, void* context) {
+    for (int i = 0; i < chunk->cacheCount; i++) {
+        InlineCache* cache = &chunk->caches[i];
+        visit((Obj*)cache->name, context);
+        for (int j = 0; j < cache->count; j++) {
+            visit((Obj*)cache->entries[j].shape, context);
+            if (cache->entries[j].transition != NULL) {
+                visit((Obj*)cache->entries[j].transition, context);
+            }
+            if (cache->entries[j].method != NULL) {
+                visit((Obj*)cache->entries[j].method, context);
+            }
+        }
+    }
+}
+
+
+/**
+ * Calls `visit` for every object directly referenced by `object`.
+ *
+ * This is the single place that knows the layout of each object type; the
+ * markers and the remembered-set maintenance are all built on it.
+ */
+void visitReferences(Obj* object, ObjVisitor visit, void* context) {
+    switch (object->type) {
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            if (function->name != NULL) visit((Obj*)function->name, context);
+            visitArray(&function->chunk.constants, visit, context);
+            visitCaches(&function->chunk, visit, context);
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            visit((Obj*)closure->function, context);
+            for (int i = 0; i < closure->captureCount; i++) {
+                if (closure->captures[i].cell != NULL) visit((Obj*)closure->captures[i].cell, context);
+                visitValue(closure->captures[i].value, visit, context);
+            }
+            break;
+        }
+        case OBJ_UPVALUE:
+            // an open upvalue's value is on the stack, which is a root anyway
+            visitValue(((ObjUpvalue*)object)->closed, visit, context);
+            break;
+        case OBJ_SHAPE: {
+            ObjShape* shape = (ObjShape*)object;
+            if (shape->parent != NULL) visit((Obj*)shape->parent, context);
+            if (shape->name != NULL) visit((Obj*)shape->name, context);
+            visitTable(&shape->transitions, visit, context);
+            break;
+        }
+        case OBJ_CLASS: {
+            ObjClass* klass = (ObjClass*)object;
+            visit((Obj*)klass->name, context);
+            visitTable(&klass->methods, visit, context);
+            visit((Obj*)klass->shape, context);
+            if (klass->superclass != NULL) visit((Obj*)klass->superclass, context);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            visit((Obj*)instance->klass, context);
+            visit((Obj*)instance->shape, context);
+            for (int i = 0; i < instance->shape->fieldCount; i++) {
+                visitValue(instance->fields[i], visit, context);
+            }
+            break;
+        }
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            visitValue(bound->receiver, visit, context);
+            visit((Obj*)bound->method, context);
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+        case OBJ_ROPE:
+            break;      // no outgoing references
+    }
+}
+
+
+/**
+ * Like `visitReferences()`, but skips references known to be old.
+ *
+ * Used for remembered objects. A constant pool only ever grows and objects
+ * never become young again, so a function keeps a "card" boundary: the
+ * prefix of its constants that is entirely old. Without it a function that
+ * is still being compiled would have its whole pool rescanned on every
+ * minor collection.
+ */
+static void visitYoungReferences(Obj* object, ObjVisitor visit, void* context) {
+    if (object->type != OBJ_FUNCTION) {
+        visitReferences(object, visit, context);
+        return;
+    }
+
+    ObjFunction* function = (ObjFunction*)object;
+    if (function->name != NULL) visit((Obj*)function->name, context);
+
+    ValueArray* constants = &function->chunk.constants;
+    for (int i = function->oldConstants; i < constants->count; i++) {
+        visitValue(constants->values[i], visit, context);
+    }
+    visitCaches(&function->chunk, visit, context);
+}
+
+
+// move a function's card boundary past constants that have been promoted
+static void advanceOldConstants(ObjFunction* function) {
+    ValueArray* constants = &function->chunk.constants;
+    while (function->oldConstants < constants->count) {
+        Value value = constants->values[function->oldConstants];
+        if (IS_OBJ(value) && !AS_OBJ(value)->isOld) break;
+        function->oldConstants++;
+    }
+}
+
+
+static void markVisitor(Obj* object, void* context) {
+    (void)context;
+    markObject(object);
+}
+
+
+static void youngVisitor(Obj* object, void* context) {
+    if (!object->isOld) *(bool*)context = true;
+}
+
+
+static bool referencesYoung(Obj* object) {
+    if (object->type == OBJ_FUNCTION) advanceOldConstants((ObjFunction*)object);
+
+    bool found = false;
+    visitYoungReferences(object, youngVisitor, &found);
+    return found;
+}
+
+
+// roots written without a barrier -> rescanned when an incremental mark ends
+static void markUnbarrieredRoots() {
+    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+        markValue(*slot);
+    }
+
+    for (int i = 0; i < vm.frameCount; i++) {
+        markObject((Obj*)vm.frames[i].function);
+        markObject((Obj*)vm.frames[i].closure);
+    }
+    for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+        markObject((Obj*)upvalue);
+    }
+    markObject((Obj*)vm.initString);
+
+    markCompilerRoots();
+}
+
+
+/**
+ * Marks the young objects recorded by `globalsBarrier()`.
+ *
+ * They are treated as live even if the global has since been overwritten,
+ * which keeps each one around until it is promoted or dropped from the
+ * list -> a little floating garbage instead of a table scan per minor GC.
+ */
+static void markYoungGlobals() {
+    for (int i = 0; i < vm.gc.youngGlobalCount; i++) {
+        markValue(vm.gc.youngGlobals[i]);
+    }
+}
+
+
+// after a sweep, forget the recorded globals that have been promoted
+static void pruneYoungGlobals() {
+    int kept = 0;
+    for (int i = 0; i < vm.gc.youngGlobalCount; i++) {
+        if (!AS_OBJ(vm.gc.youngGlobals[i])->isOld) {
+            vm.gc.youngGlobals[kept++] = vm.gc.youngGlobals[i];
+        }
+    }
+    vm.gc.youngGlobalCount = kept;
+}
+
+
+static void markRoots() {
+    markUnbarrieredRoots();
+    markYoungGlobals();
+    if (!vm.gc.minor) markTable(&vm.globals);
+}
+
+
+// drain the gray stack -> every reachable object ends up marked
+static void traceReferences() {
+    if (vm.gc.markThreads > 1 && vm.gc.grayCount >= PARALLEL_MIN_GRAY) {
+        markParallel(vm.gc.grayStack, vm.gc.grayCount, vm.gc.markThreads, vm.gc.minor);
+        vm.gc.grayCount = 0;
+        return;
+    }
+
+    while (vm.gc.grayCount > 0) {
+        Obj* object = vm.gc.grayStack[--vm.gc.grayCount];
+        visitReferences(object, markVisitor, NULL);
+    }
+}
+
+
+// minor collections: old objects written since they were promoted act as roots
+static void traceRemembered() {
+    for (int i = 0; i < vm.gc.rememberedCount; i++) {
+        visitYoungReferences(vm.gc.remembered[i], markVisitor, NULL);
+    }
+}
+
+
+// major collections trace everything, so the remembered set starts over
+static void forgetRemembered() {
+    for (int i = 0; i < vm.gc.rememberedCount; i++) {
+        vm.gc.remembered[i]->isRemembered = false;
+    }
+    vm.gc.rememberedCount = 0;
+}
+
+
+/**
+ * Keeps only the old objects that still point into the young generation.
+ *
+ * Candidates are the objects already remembered plus everything promoted in
+ * this collection (`promoted` up to `promotedEnd` on the old list): a freshly
+ * promoted object may still reference objects too young to be promoted.
+ */
+static void rebuildRemembered(Obj* promoted, Obj* promotedEnd) {
+    int kept = 0;
+    for (int i = 0; i < vm.gc.rememberedCount; i++) {
+        Obj* object = vm.gc.remembered[i];
+        if (vm.objects != NULL && referencesYoung(object)) {
+            vm.gc.remembered[kept++] = object;
+        } else {
+            object->isRemembered = false;
+        }
+    }
+    vm.gc.rememberedCount = kept;
+
+    if (vm.objects == NULL) return;     // nothing young left to point at
+
+    for (Obj* object = promoted; object != promotedEnd; object = object->next) {
+        if (!object->isRemembered && referencesYoung(object)) {
+            rememberObject(object);
+        }
+    }
+}
+
+
+// free unmarked old objects (major collections only)
+static void sweepOld() {
+    Obj* previous = NULL;
+    Obj* object = vm.oldObjects;
+    while (object != NULL) {
+        Obj* next = object->next;
+        if (object->isMarked) {
+            object->isMarked = false;
+            previous = object;
+        } else {
+            if (previous != NULL) previous->next = next;
+            else vm.oldObjects = next;
+            freeDead(object);
+        }
+        object = next;
+    }
+}
+
+
+// free unmarked young objects, age the survivors and promote the oldest
+static void sweepYoung() {
+    Obj* previous = NULL;
+    Obj* object = vm.objects;
+    while (object != NULL) {
+        Obj* next = object->next;
+        if (object->isMarked) {
+            object->isMarked = false;
+            if (++object->age >= vm.gc.promotionAge) {
+                if (previous != NULL) previous->next = next;
+                else vm.objects = next;
+
+                object->isOld = true;
+                object->next = vm.oldObjects;
+                vm.oldObjects = object;
+                vm.gc.stats.objectsPromoted++;
+            } else {
+                previous = object;
+            }
+        } else {
+            if (previous != NULL) previous->next = next;
+            else vm.objects = next;
+            freeDead(object);
+        }
+        object = next;
+    }
+}
+
+
+static void recordPause(double pause) {
+    GCStats* stats = &vm.gc.stats;
+    if (pause > stats->maxPause) stats->maxPause = pause;
+
+    if (stats->pauseCapacity < stats->pauseCount + 1) {
+        stats->pauseCapacity = GROW_CAPACITY(stats->pauseCapacity);
+        stats->pauses = (double*)realloc(stats->pauses, sizeof(double) * stats->pauseCapacity);
+        if (stats->pauses == NULL) exit(1);
+    }
+    stats->pauses[stats->pauseCount++] = pause;
+}
+
+
+static void collect(bool minor) {
+    double start = now();
+    size_t before = vm.bytesAllocated;
+    if (before > vm.gc.stats.peakBytes) vm.gc.stats.peakBytes = before;
+
+    vm.gc.minor = minor;
+    Obj* oldHead = vm.oldObjects;   // objects promoted now get pushed in front of it
+
+    if (!minor) forgetRemembered();
+    markRoots();
+    if (minor) traceRemembered();
+    traceReferences();
+    vm.gc.stats.markTotal += now() - start;
+
+    // sweep the old generation first: promotions below land on it unmarked
+    if (!minor) sweepOld();
+    sweepYoung();
+
+    pruneYoungGlobals();
+    if (minor) {
+        rebuildRemembered(vm.oldObjects, oldHead);
+    } else {
+        rebuildRemembered(vm.oldObjects, NULL);
+        vm.gc.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+        if (vm.gc.nextGC < FIRST_MAJOR_GC) vm.gc.nextGC = FIRST_MAJOR_GC;
+    }
+
+    vm.gc.minor = false;
+    vm.gc.nurseryAllocated = 0;
+
+    double pause = now() - start;
+
+    // under a pause target, size the nursery so minor pauses fit in it too
+    if (minor && vm.gc.maxPause > 0) {
+        if (pause > vm.gc.maxPause && vm.gc.nurserySize > MIN_NURSERY_SIZE) {
+            vm.gc.nurserySize /= 2;
+        } else if (pause < vm.gc.maxPause / 2 && vm.gc.nurserySize < NURSERY_SIZE) {
+            vm.gc.nurserySize *= 2;
+        }
+    }
+
+    GCStats* stats = &vm.gc.stats;
+    if (minor) {
+        stats->minorCollections++;
+        stats->minorPauseTotal += pause;
+    } else {
+        stats->majorCollections++;
+        stats->majorPauseTotal += pause;
+    }
+    recordPause(pause);
+    stats->bytesFreed += before - vm.bytesAllocated;
+}
+
+
+/**
+ * Starts an incremental major collection.
+ *
+ * Only the small roots are marked here. The globals table can be large, so
+ * it is scanned in slices like the gray worklist (stores into it are
+ * shaded by `globalsBarrier()` meanwhile). Minor collections are suspended
+ * until marking ends; the remembered set keeps growing through the write
+ * barrier meanwhile and is pruned at the end.
+ */
+static void beginIncremental() {
+    vm.gc.minor = false;
+    vm.gc.phase = GC_MARKING;
+    vm.gc.stats.incrementalCycles++;
+
+    markUnbarrieredRoots();
+    markYoungGlobals();
+    vm.gc.globalsCursor = 0;
+    vm.gc.globalsCapacity = vm.globals.capacity;
+}
+
+
+static bool markingComplete() {
+    return vm.gc.grayCount == 0 &&
+           vm.gc.globalsCapacity == vm.globals.capacity &&
+           vm.gc.globalsCursor >= vm.globals.capacity;
+}
+
+
+/**
+ * Traces gray objects, then the next globals, until there is nothing left
+ * or `deadline` passes.
+ *
+ * The globals scan restarts if the table has been rehashed since it began,
+ * as entries may have moved behind the cursor.
+ */
+static void markSlice(double deadline) {
+    int work = 0;
+    for (;;) {
+        if (vm.gc.grayCount > 0) {
+            Obj* object = vm.gc.grayStack[--vm.gc.grayCount];
+            visitReferences(object, markVisitor, NULL);
+        } else {
+            if (vm.gc.globalsCapacity != vm.globals.capacity) {
+                vm.gc.globalsCapacity = vm.globals.capacity;
+                vm.gc.globalsCursor = 0;
+            }
+            if (vm.gc.globalsCursor >= vm.globals.capacity) return;
+
+            Entry* entry = &vm.globals.entries[vm.gc.globalsCursor++];
+            markObject((Obj*)entry->key);
+            markValue(entry->value);
+        }
+        if (++work % SLICE_CHECK == 0 && now() >= deadline) return;
+    }
+}
+
+
+/**
+ * Ends the mark phase of an incremental collection.
+ *
+ * The stack and the compiler are rescanned because the mutator writes them
+ * without a barrier. The young generation is swept right away, as in a
+ * minor collection; the old generation is detached onto `sweeping` and
+ * swept in slices.
+ */
+static void finishMarking() {
+    double start = now();
+    markUnbarrieredRoots();
+    markYoungGlobals();
+    traceReferences();
+    vm.gc.stats.markTotal += now() - start;
+
+    // drop dead remembered objects before the young objects they point at go
+    int kept = 0;
+    for (int i = 0; i < vm.gc.rememberedCount; i++) {
+        Obj* object = vm.gc.remembered[i];
+        if (object->isMarked) {
+            vm.gc.remembered[kept++] = object;
+        } else {
+            object->isRemembered = false;
+        }
+    }
+    vm.gc.rememberedCount = kept;
+
+    vm.gc.sweeping = vm.oldObjects;
+    vm.oldObjects = NULL;
+    sweepYoung();       // promotions land on the emptied old list
+    pruneYoungGlobals();
+    rebuildRemembered(vm.oldObjects, NULL);
+    vm.gc.nurseryAllocated = 0;
+
+    vm.gc.phase = GC_SWEEPING;
+}
+
+
+// free white objects from `sweeping` until it is empty or `deadline` passes
+static void sweepSlice(double deadline) {
+    int work = 0;
+    while (vm.gc.sweeping != NULL) {
+        Obj* object = vm.gc.sweeping;
+        vm.gc.sweeping = object->next;
+
+        if (object->isMarked) {
+            object->isMarked = false;
+            object->next = vm.oldObjects;
+            vm.oldObjects = object;
+        } else {
+            freeDead(object);
+        }
+        if (++work % SLICE_CHECK == 0 && now() >= deadline) return;
+    }
+
+    vm.gc.phase = GC_IDLE;
+    vm.gc.stats.majorCollections++;
+    vm.gc.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    if (vm.gc.nextGC < FIRST_MAJOR_GC) vm.gc.nextGC = FIRST_MAJOR_GC;
+}
+
+
+// run one bounded slice of the incremental cycle in progress
+static void incrementalStep() {
+    double start = now();
+    size_t before = vm.bytesAllocated;
+    if (before > vm.gc.stats.peakBytes) vm.gc.stats.peakBytes = before;
+
+    double deadline = start + vm.gc.maxPause;
+    if (vm.gc.phase == GC_MARKING) {
+        // the final remark gets a slice of its own
+        if (markingComplete()) finishMarking();
+        else markSlice(deadline);
+    } else {
+        sweepSlice(deadline);
+    }
+
+    vm.gc.stepAllocated = 0;
+
+    double pause = now() - start;
+    vm.gc.stats.majorPauseTotal += pause;
+    recordPause(pause);
+    vm.gc.stats.bytesFreed += before - vm.bytesAllocated;
+}
+
+
+void collectGarbage() {
+    if (vm.gc.phase == GC_MARKING) {
+        incrementalStep();
+    } else if (vm.gc.phase == GC_SWEEPING) {
+        // whichever is due; the other one runs on a later allocation
+        if (vm.gc.stepAllocated > vm.gc.stepSize) incrementalStep();
+        else collect(true);
+    } else if (vm.bytesAllocated <= vm.gc.nextGC) {
+        collect(true);
+    } else if (vm.gc.maxPause > 0) {
+        double start = now();
+        beginIncremental();
+        vm.gc.stepAllocated = 0;
+
+        double pause = now() - start;
+        vm.gc.stats.majorPauseTotal += pause;
+        recordPause(pause);
+    } else {
+        collect(false);
+    }
+}
+
+
+void collectGarbageFull() {
+    // run out an incremental cycle without a deadline
+    if (vm.gc.phase == GC_MARKING) {
+        while (!markingComplete()) markSlice(now() + 1.0);
+        finishMarking();
+    }
+    if (vm.gc.phase == GC_SWEEPING) {
+        while (vm.gc.phase != GC_IDLE) sweepSlice(now() + 1.0);
+    }
+    collect(false);
+}
+
+
+static int comparePauses(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+void printGCStats() {
+    GCStats* stats = &vm.gc.stats;
+    fprintf(stderr, "gc: %d minor (%.3f ms total), %d major (%.3f ms total), max pause %.3f ms\n",
+            stats->minorCollections, stats->minorPauseTotal * 1000,
+            stats->majorCollections, stats->majorPauseTotal * 1000,
+            stats->maxPause * 1000);
+    fprintf(stderr, "gc: %zu bytes freed, %zu objects promoted, peak heap %zu bytes, live %zu bytes\n",
+            stats->bytesFreed, stats->objectsPromoted, stats->peakBytes, vm.bytesAllocated);
+
+    fprintf(stderr, "gc: %.3f ms marking in stop-the-world phases, %d marking thread%s\n",
+            stats->markTotal * 1000, vm.gc.markThreads, vm.gc.markThreads == 1 ? "" : "s");
+
+    if (stats->pauseCount == 0) return;
+
+    double* sorted = (double*)malloc(sizeof(double) * stats->pauseCount);
+    if (sorted == NULL) exit(1);
+    memcpy(sorted, stats->pauses, sizeof(double) * stats->pauseCount);
+    qsort(sorted, stats->pauseCount, sizeof(double), comparePauses);
+
+    int last = stats->pauseCount - 1;
+    fprintf(stderr, "gc: %d pauses (%d incremental cycles), p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+            stats->pauseCount, stats->incrementalCycles,
+            sorted[last * 50 / 100] * 1e6, sorted[last * 90 / 100] * 1e6,
+            sorted[last * 99 / 100] * 1e6, sorted[last] * 1e6);
+    free(sorted);
+}
+
+
+static void freeList(Obj* object) {
+    while (object != NULL) {
+        Obj* next = object->next;
+        freeObject(object);
+        object = next;
+    }
+}
+
+
+void freeObjects() {
+    freeList(vm.objects);
+    freeList(vm.oldObjects);
+    freeList(vm.gc.sweeping);
+    vm.objects = NULL;
+    vm.oldObjects = NULL;
+    vm.gc.sweeping = NULL;
+}
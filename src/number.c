@@ -0,0 +1,556 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/number.h"
+
+// whole numbers below this are exact and printed without Grisu
+#define EXACT_INTEGER_LIMIT 9007199254740992.0     // 2^53
+
+
+/**
+ * Shortest round-trip formatting with Grisu2 (Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", 2010).
+ *
+ * A double and the midpoints to its neighbours are scaled by a cached
+ * power of ten into a range where 64-bit integer arithmetic suffices, and
+ * digits are generated until the result lies strictly between the
+ * midpoints. The output always reads back as the same double; in rare
+ * cases it is a digit longer than the shortest possible.
+ */
+
+// a floating-point number f * 2^e with a 64-bit significand
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+
+// normalized 10^k for k = -348, -340, ..., 340
+static const DiyFp cachedPowers[] = {
+    {0xfa8fd5a0081c0288ull, -1220}, {0xbaaee17fa23ebf76ull, -1193}, {0x8b16fb203055ac76ull, -1166},
+    {0xcf42894a5dce35eaull, -1140}, {0x9a6bb0aa55653b2dull, -1113}, {0xe61acf033d1a45dfull, -1087},
+    {0xab70fe17c79ac6caull, -1060}, {0xff77b1fcbebcdc4full, -1034}, {0xbe5691ef416bd60cull, -1007},
+    {0x8dd01fad907ffc3cull,  -980}, {0xd3515c2831559a83ull,  -954}, {0x9d71ac8fada6c9b5ull,  -927},
+    {0xea9c227723ee8bcbull,  -901}, {0xaecc49914078536dull,  -874}, {0x823c12795db6ce57ull,  -847},
+    {0xc21094364dfb5637ull,  -821}, {0x9096ea6f3848984full,  -794}, {0xd77485cb25823ac7ull,  -768},
+    {0xa086cfcd97bf97f4ull,  -741}, {0xef340a98172aace5ull,  -715}, {0xb23867fb2a35b28eull,  -688},
+    {0x84c8d4dfd2c63f3bull,  -661}, {0xc5dd44271ad3cdbaull,  -635}, {0x936b9fcebb25c996ull,  -608},
+    {0xdbac6c247d62a584ull,  -582}, {0xa3ab66580d5fdaf6ull,  -555}, {0xf3e2f893dec3f126ull,  -529},
+    {0xb5b5ada8aaff80b8ull,  -502}, {0x87625f056c7c4a8bull,  -475}, {0xc9bcff6034c13053ull,  -449},
+    {0x964e858c91ba2655ull,  -422}, {0xdff9772470297ebdull,  -396}, {0xa6dfbd9fb8e5b88full,  -369},
+    {0xf8a95fcf88747d94ull,  -343}, {0xb94470938fa89bcfull,  -316}, {0x8a08f0f8bf0f156bull,  -289},
+    {0xcdb02555653131b6ull,  -263}, {0x993fe2c6d07b7facull,  -236}, {0xe45c10c42a2b3b06ull,  -210},
+    {0xaa242499697392d3ull,  -183}, {0xfd87b5f28300ca0eull,  -157}, {0xbce5086492111aebull,  -130},
+    {0x8cbccc096f5088ccull,  -103}, {0xd1b71758e219652cull,   -77}, {0x9c40000000000000ull,   -50},
+    {0xe8d4a51000000000ull,   -24}, {0xad78ebc5ac620000ull,     3}, {0x813f3978f8940984ull,    30},
+    {0xc097ce7bc90715b3ull,    56}, {0x8f7e32ce7bea5c70ull,    83}, {0xd5d238a4abe98068ull,   109},
+    {0x9f4f2726179a2245ull,   136}, {0xed63a231d4c4fb27ull,   162}, {0xb0de65388cc8ada8ull,   189},
+    {0x83c7088e1aab65dbull,   216}, {0xc45d1df942711d9aull,   242}, {0x924d692ca61be758ull,   269},
+    {0xda01ee641a708deaull,   295}, {0xa26da3999aef774aull,   322}, {0xf209787bb47d6b85ull,   348},
+    {0xb454e4a179dd1877ull,   375}, {0x865b86925b9bc5c2ull,   402}, {0xc83553c5c8965d3dull,   428},
+    {0x952ab45cfa97a0b3ull,   455}, {0xde469fbd99a05fe3ull,   481}, {0xa59bc234db398c25ull,   508},
+    {0xf6c69a72a3989f5cull,   534}, {0xb7dcbf5354e9beceull,   561}, {0x88fcf317f22241e2ull,   588},
+    {0xcc20ce9bd35c78a5ull,   614}, {0x98165af37b2153dfull,   641}, {0xe2a0b5dc971f303aull,   667},
+    {0xa8d9d1535ce3b396ull,   694}, {0xfb9b7cd9a4a7443cull,   720}, {0xbb764c4ca7a44410ull,   747},
+    {0x8bab8eefb6409c1aull,   774}, {0xd01fef10a657842cull,   800}, {0x9b10a4e5e9913129ull,   827},
+    {0xe7109bfba19c0c9dull,   853}, {0xac2820d9623bf429ull,   880}, {0x80444b5e7aa7cf85ull,   907},
+    {0xbf21e44003acdd2dull,   933}, {0x8e679c2f5e44ff8full,   960}, {0xd433179d9c8cb841ull,   986},
+    {0x9e19db92b4e31ba9ull,  1013}, {0xeb96bf6ebadf77d9ull,  1039}, {0xaf87023b9bf0ee6bull,  1066},
+};
+
+static const uint64_t powersOf10[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+};
+
+
+static DiyFp diyFromDouble(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t significand = bits & 0x000FFFFFFFFFFFFFull;
+    int biasedExponent = (int)((bits >> 52) & 0x7FF);
+
+    DiyFp result;
+    if (biasedExponent != 0) {
+        result.f = significand | 0x0010000000000000ull;    // the hidden bit
+        result.e = biasedExponent - 1075;
+    } else {
+        result.f = significand;                             // subnormal
+        result.e = -1074;
+    }
+    return result;
+}
+
+
+static DiyFp normalize(DiyFp x) {
+    while ((x.f & 0x8000000000000000ull) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+
+// x * y, keeping the upper (rounded) half of the 128-bit product
+static DiyFp multiply(DiyFp x, DiyFp y) {
+    unsigned __int128 product = (unsigned __int128)x.f * y.f;
+    DiyFp result;
+    result.f = (uint64_t)(product >> 64) + (((uint64_t)product >> 63) & 1);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+
+// the midpoints between `value` and its neighbours, on a common exponent
+static void boundaries(double value, DiyFp* minus, DiyFp* plus) {
+    DiyFp v = diyFromDouble(value);
+
+    DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+    upper = normalize(upper);
+
+    // at a power of two the gap below is half the gap above
+    DiyFp lower;
+    if (v.f == 0x0010000000000000ull) {
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
+    } else {
+        lower.f = (v.f << 1) - 1;
+        lower.e = v.e - 1;
+    }
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus = upper;
+}
+
+
+// a cached 10^-k that brings a number with binary exponent `e` into range
+static DiyFp cachedPower(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;     // log10(2)
+    int kk = (int)dk;
+    if (dk - kk > 0.0) kk++;
+
+    int index = (kk >> 3) + 1;
+    *k = -(-348 + index * 8);
+    return cachedPowers[index];
+}
+
+
+static int countDigits(uint32_t n) {
+    int count = 1;
+    while (n >= 10) {
+        n /= 10;
+        count++;
+    }
+    return count;
+}
+
+
+// nudge the last digit towards the exact value while that stays in range
+static void roundWeed(char* buffer, int length, uint64_t delta, uint64_t rest,
+                      uint64_t tenKappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= tenKappa &&
+           (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance)) {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+
+// emit digits of `plus` until they are within `delta` of it
+static int generateDigits(DiyFp w, DiyFp plus, uint64_t delta, char* buffer, int* k) {
+    DiyFp one = {1ull << -plus.e, plus.e};
+    uint64_t distance = plus.f - w.f;
+    uint32_t integral = (uint32_t)(plus.f >> -one.e);
+    uint64_t fraction = plus.f & (one.f - 1);
+
+    int kappa = countDigits(integral);
+    int length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)powersOf10[kappa - 1];
+        uint32_t digit = integral / divisor;
+        integral %= divisor;
+        if (digit != 0 || length != 0) buffer[length++] = (char)('0' + digit);
+        kappa--;
+
+        uint64_t rest = ((uint64_t)integral << -one.e) + fraction;
+        if (rest <= delta) {
+            *k += kappa;
+            roundWeed(buffer, length, delta, rest, powersOf10[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+
+    for (;;) {
+        fraction *= 10;
+        delta *= 10;
+        uint32_t digit = (uint32_t)(fraction >> -one.e);
+        if (digit != 0 || length != 0) buffer[length++] = (char)('0' + digit);
+        fraction &= one.f - 1;
+        kappa--;
+
+        if (fraction < delta) {
+            *k += kappa;
+            int index = -kappa;
+            roundWeed(buffer, length, delta, fraction, one.f,
+                      index < 20 ? distance * powersOf10[index] : 0);
+            return length;
+        }
+    }
+}
+
+
+// digits of a positive, finite `value` such that value ~= digits * 10^k
+static int grisu2(double value, char* digits, int* k) {
+    DiyFp minus, plus;
+    boundaries(value, &minus, &plus);
+
+    DiyFp power = cachedPower(plus.e, k);
+    DiyFp w = multiply(normalize(diyFromDouble(value)), power);
+    DiyFp upper = multiply(plus, power);
+    DiyFp lower = multiply(minus, power);
+
+    // stay strictly inside the interval despite the rounding above
+    lower.f++;
+    upper.f--;
+    return generateDigits(w, upper, upper.f - lower.f, digits, k);
+}
+
+
+static int writeInteger(uint64_t n, char* buffer) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+
+    for (int i = 0; i < count; i++) buffer[i] = digits[count - 1 - i];
+    return count;
+}
+
+
+// lay out `length` digits with value digits * 10^k
+static int layoutDigits(const char* digits, int length, int k, char* buffer) {
+    int point = length + k;     // where the decimal point goes
+    int written = 0;
+
+    if (length <= point && point <= 21) {
+        // a whole number: digits then zeros
+        memcpy(buffer, digits, length);
+        memset(buffer + length, '0', point - length);
+        return point;
+    }
+
+    if (0 < point && point <= 21) {
+        // 123.45
+        memcpy(buffer, digits, point);
+        buffer[point] = '.';
+        memcpy(buffer + point + 1, digits + point, length - point);
+        return length + 1;
+    }
+
+    if (-6 < point && point <= 0) {
+        // 0.00123
+        buffer[written++] = '0';
+        buffer[written++] = '.';
+        memset(buffer + written, '0', -point);
+        written += -point;
+        memcpy(buffer + written, digits, length);
+        return written + length;
+    }
+
+    // 1.2345e+67
+    buffer[written++] = digits[0];
+    if (length > 1) {
+        buffer[written++] = '.';
+        memcpy(buffer + written, digits + 1, length - 1);
+        written += length - 1;
+    }
+    buffer[written++] = 'e';
+    int exponent = point - 1;
+    buffer[written++] = exponent < 0 ? '-' : '+';
+    return written + writeInteger((uint64_t)(exponent < 0 ? -exponent : exponent), buffer + written);
+}
+
+
+int formatInteger(int64_t value, char* buffer) {
+    if (value >= 0) return writeInteger((uint64_t)value, buffer);
+
+    // negate as unsigned, so INT64_MIN works too
+    buffer[0] = '-';
+    return 1 + writeInteger(0 - (uint64_t)value, buffer + 1);
+}
+
+
+int formatNumber(double value, char* buffer) {
+    if (isnan(value)) {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+
+    int written = 0;
+    if (signbit(value)) {
+        buffer[written++] = '-';
+        value = -value;
+    }
+
+    if (isinf(value)) {
+        memcpy(buffer + written, "inf", 3);
+        return written + 3;
+    }
+
+    // integer fast path: counters, indices and sums are almost always whole
+    if (value < EXACT_INTEGER_LIMIT && value == (double)(uint64_t)value) {
+        return written + writeInteger((uint64_t)value, buffer + written);
+    }
+
+    char digits[18];
+    int k;
+    int length = grisu2(value, digits, &k);
+    return written + layoutDigits(digits, length, k, buffer + written);
+}
+
+
+
+/**
+ * Decimal to binary with Eisel-Lemire (Lemire, "Number Parsing at a
+ * Gigabyte per Second", 2021).
+ *
+ * The mantissa is multiplied by a 128-bit approximation of 5^q; the top
+ * bits of the product are the double's significand, and if the bits that
+ * decide the rounding could be off because of the approximation, it gives
+ * up. Powers beyond EISEL_LEMIRE_MAX_POWER can't come out of literals of
+ * any sensible length, so the table stops there.
+ */
+
+#define EISEL_LEMIRE_MAX_POWER 64
+
+// 5^q normalized to [2^127, 2^128) as {high, low} words, q = -64 ... 64;
+// negative powers are rounded up
+static const uint64_t powersOf5[][2] = {
+    {0xa87fea27a539e9a5ull, 0x3f2398d747b36225ull},
+    {0xd29fe4b18e88640eull, 0x8eec7f0d19a03aaeull},
+    {0x83a3eeeef9153e89ull, 0x1953cf68300424adull},
+    {0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd8ull},
+    {0xcdb02555653131b6ull, 0x3792f412cb06794eull},
+    {0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd1ull},
+    {0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec5ull},
+    {0xc8de047564d20a8bull, 0xf245825a5a445276ull},
+    {0xfb158592be068d2eull, 0xeed6e2f0f0d56713ull},
+    {0x9ced737bb6c4183dull, 0x55464dd69685606cull},
+    {0xc428d05aa4751e4cull, 0xaa97e14c3c26b887ull},
+    {0xf53304714d9265dfull, 0xd53dd99f4b3066a9ull},
+    {0x993fe2c6d07b7fabull, 0xe546a8038efe402aull},
+    {0xbf8fdb78849a5f96ull, 0xde98520472bdd034ull},
+    {0xef73d256a5c0f77cull, 0x963e66858f6d4441ull},
+    {0x95a8637627989aadull, 0xdde7001379a44aa9ull},
+    {0xbb127c53b17ec159ull, 0x5560c018580d5d53ull},
+    {0xe9d71b689dde71afull, 0xaab8f01e6e10b4a7ull},
+    {0x9226712162ab070dull, 0xcab3961304ca70e9ull},
+    {0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d23ull},
+    {0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506bull},
+    {0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb243ull},
+    {0xb267ed1940f1c61cull, 0x55f038b237591ed4ull},
+    {0xdf01e85f912e37a3ull, 0x6b6c46dec52f6689ull},
+    {0x8b61313bbabce2c6ull, 0x2323ac4b3b3da016ull},
+    {0xae397d8aa96c1b77ull, 0xabec975e0a0d081bull},
+    {0xd9c7dced53c72255ull, 0x96e7bd358c904a22ull},
+    {0x881cea14545c7575ull, 0x7e50d64177da2e55ull},
+    {0xaa242499697392d2ull, 0xdde50bd1d5d0b9eaull},
+    {0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e865ull},
+    {0x84ec3c97da624ab4ull, 0xbd5af13bef0b113full},
+    {0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58full},
+    {0xcfb11ead453994baull, 0x67de18eda5814af3ull},
+    {0x81ceb32c4b43fcf4ull, 0x80eacf948770ced8ull},
+    {0xa2425ff75e14fc31ull, 0xa1258379a94d028eull},
+    {0xcad2f7f5359a3b3eull, 0x096ee45813a04331ull},
+    {0xfd87b5f28300ca0dull, 0x8bca9d6e188853fdull},
+    {0x9e74d1b791e07e48ull, 0x775ea264cf55347eull},
+    {0xc612062576589ddaull, 0x95364afe032a819eull},
+    {0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull},
+    {0x9abe14cd44753b52ull, 0xc4926a9672793543ull},
+    {0xc16d9a0095928a27ull, 0x75b7053c0f178294ull},
+    {0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull},
+    {0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull},
+    {0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull},
+    {0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull},
+    {0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull},
+    {0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull},
+    {0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull},
+    {0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull},
+    {0xb424dc35095cd80full, 0x538484c19ef38c95ull},
+    {0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull},
+    {0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull},
+    {0xafebff0bcb24aafeull, 0xf78f69a51539d749ull},
+    {0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull},
+    {0x89705f4136b4a597ull, 0x31680a88f8953031ull},
+    {0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull},
+    {0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull},
+    {0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull},
+    {0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull},
+    {0xd1b71758e219652bull, 0xd3c36113404ea4a9ull},
+    {0x83126e978d4fdf3bull, 0x645a1cac083126eaull},
+    {0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull},
+    {0xccccccccccccccccull, 0xcccccccccccccccdull},
+    {0x8000000000000000ull, 0x0000000000000000ull},
+    {0xa000000000000000ull, 0x0000000000000000ull},
+    {0xc800000000000000ull, 0x0000000000000000ull},
+    {0xfa00000000000000ull, 0x0000000000000000ull},
+    {0x9c40000000000000ull, 0x0000000000000000ull},
+    {0xc350000000000000ull, 0x0000000000000000ull},
+    {0xf424000000000000ull, 0x0000000000000000ull},
+    {0x9896800000000000ull, 0x0000000000000000ull},
+    {0xbebc200000000000ull, 0x0000000000000000ull},
+    {0xee6b280000000000ull, 0x0000000000000000ull},
+    {0x9502f90000000000ull, 0x0000000000000000ull},
+    {0xba43b74000000000ull, 0x0000000000000000ull},
+    {0xe8d4a51000000000ull, 0x0000000000000000ull},
+    {0x9184e72a00000000ull, 0x0000000000000000ull},
+    {0xb5e620f480000000ull, 0x0000000000000000ull},
+    {0xe35fa931a0000000ull, 0x0000000000000000ull},
+    {0x8e1bc9bf04000000ull, 0x0000000000000000ull},
+    {0xb1a2bc2ec5000000ull, 0x0000000000000000ull},
+    {0xde0b6b3a76400000ull, 0x0000000000000000ull},
+    {0x8ac7230489e80000ull, 0x0000000000000000ull},
+    {0xad78ebc5ac620000ull, 0x0000000000000000ull},
+    {0xd8d726b7177a8000ull, 0x0000000000000000ull},
+    {0x878678326eac9000ull, 0x0000000000000000ull},
+    {0xa968163f0a57b400ull, 0x0000000000000000ull},
+    {0xd3c21bcecceda100ull, 0x0000000000000000ull},
+    {0x84595161401484a0ull, 0x0000000000000000ull},
+    {0xa56fa5b99019a5c8ull, 0x0000000000000000ull},
+    {0xcecb8f27f4200f3aull, 0x0000000000000000ull},
+    {0x813f3978f8940984ull, 0x4000000000000000ull},
+    {0xa18f07d736b90be5ull, 0x5000000000000000ull},
+    {0xc9f2c9cd04674edeull, 0xa400000000000000ull},
+    {0xfc6f7c4045812296ull, 0x4d00000000000000ull},
+    {0x9dc5ada82b70b59dull, 0xf020000000000000ull},
+    {0xc5371912364ce305ull, 0x6c28000000000000ull},
+    {0xf684df56c3e01bc6ull, 0xc732000000000000ull},
+    {0x9a130b963a6c115cull, 0x3c7f400000000000ull},
+    {0xc097ce7bc90715b3ull, 0x4b9f100000000000ull},
+    {0xf0bdc21abb48db20ull, 0x1e86d40000000000ull},
+    {0x96769950b50d88f4ull, 0x1314448000000000ull},
+    {0xbc143fa4e250eb31ull, 0x17d955a000000000ull},
+    {0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull},
+    {0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull},
+    {0xb7abc627050305adull, 0xf14a3d9e40000000ull},
+    {0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull},
+    {0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull},
+    {0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull},
+    {0xe0352f62a19e306eull, 0xd50b2037ad200000ull},
+    {0x8c213d9da502de45ull, 0x4526f422cc340000ull},
+    {0xaf298d050e4395d6ull, 0x9670b12b7f410000ull},
+    {0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull},
+    {0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull},
+    {0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull},
+    {0xd5d238a4abe98068ull, 0x72a4904598d6d880ull},
+    {0x85a36366eb71f041ull, 0x47a6da2b7f864750ull},
+    {0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull},
+    {0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull},
+    {0x82818f1281ed449full, 0xbff8f10e7a8921a4ull},
+    {0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull},
+    {0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull},
+    {0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull},
+    {0x9f4f2726179a2245ull, 0x01d762422c946590ull},
+    {0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull},
+    {0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull},
+    {0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full},
+    {0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull},
+};
+
+// powers of ten a double holds exactly
+static const double exactPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+
+static bool eiselLemire(uint64_t mantissa, int q, double* result) {
+    int shift = __builtin_clzll(mantissa);
+    mantissa <<= shift;
+
+    const uint64_t* power = powersOf5[q + EISEL_LEMIRE_MAX_POWER];
+    unsigned __int128 product = (unsigned __int128)mantissa * power[0];
+    uint64_t upper = (uint64_t)(product >> 64);
+    uint64_t lower = (uint64_t)product;
+
+    // the rounding bits are all ones -> the low word of 5^q may carry into them
+    if ((upper & 0x1FF) == 0x1FF && lower + mantissa < lower) {
+        unsigned __int128 low = (unsigned __int128)mantissa * power[1];
+        uint64_t middle = lower + (uint64_t)(low >> 64);
+        if (middle < lower) upper++;
+        if (middle + 1 == 0 && (upper & 0x1FF) == 0x1FF &&
+            (uint64_t)low + mantissa < (uint64_t)low) {
+            return false;
+        }
+        lower = middle;
+    }
+
+    uint64_t upperBit = upper >> 63;
+    uint64_t significand = upper >> (upperBit + 9);
+    shift += (int)(1 ^ upperBit);
+
+    // exactly halfway between two doubles, as far as we can tell
+    if (lower == 0 && (upper & 0x1FF) == 0 && (significand & 3) == 1) return false;
+
+    significand += significand & 1;     // round half to even (the rest above)
+    significand >>= 1;
+    if (significand >= (1ull << 53)) {
+        significand = 1ull << 52;
+        shift--;
+    }
+    significand &= ~(1ull << 52);
+
+    // floor(log2(10^q)) + 1024 + 63, less the normalization shifts
+    int64_t exponent = (((152170 + 65536) * (int64_t)q) >> 16) + 1087 - shift;
+    if (exponent < 1 || exponent > 2046) return false;     // subnormal or too big
+
+    uint64_t bits = significand | ((uint64_t)exponent << 52);
+    memcpy(result, &bits, sizeof(bits));
+    return true;
+}
+
+
+static double parseWithStrtod(const char* text, int length) {
+    // strtod() needs a terminator, and must not read on past the literal
+    char small[64];
+    char* copy = length < (int)sizeof(small) ? small : (char*)malloc((size_t)length + 1);
+    if (copy == NULL) exit(1);
+    memcpy(copy, text, (size_t)length);
+    copy[length] = '\0';
+
+    double value = strtod(copy, NULL);
+    if (copy != small) free(copy);
+    return value;
+}
+
+
+double decimalToDouble(uint64_t mantissa, int exponent, bool truncated,
+                       const char* text, int length) {
+    if (mantissa == 0 && !truncated) return 0.0;
+
+    if (!truncated) {
+        // both operands exact -> a single correctly rounded operation
+        if (mantissa <= (1ull << 53) && -22 <= exponent && exponent <= 22) {
+            double value = (double)mantissa;
+            if (exponent < 0) return value / exactPowersOf10[-exponent];
+            return value * exactPowersOf10[exponent];
+        }
+
+        double value;
+        if (-EISEL_LEMIRE_MAX_POWER <= exponent && exponent <= EISEL_LEMIRE_MAX_POWER &&
+            eiselLemire(mantissa, exponent, &value)) {
+            return value;
+        }
+    }
+
+    return parseWithStrtod(text, length);
+}
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/memory.h"
+#include "include/object.h"
+#include "include/table.h"
+#include "include/value.h"
+#include "include/vm.h"
+
+
+// allocate an object of the given size and link it into the VM's object list
+#define ALLOCATE_OBJ(type, size, objectType) \
+    (type*)allocateObject(size, objectType)
+
+static Obj* allocateObject(size_t size, ObjType type) {
+    Obj* object = (Obj*)reallocate(NULL, 0, size);
+    object->type = type;
+    object->isMarked = vm.gc.phase == GC_MARKING;   // allocated black during a mark
+    object->isOld = false;          // every object starts out in the nursery
+    object->isRemembered = false;
+    object->age = 0;
+
+    object->next = vm.objects;
+    vm.objects = object;
+    return object;
+}
+
+
+ObjFunction* newFunction() {
+    ObjFunction* function = ALLOCATE_OBJ(ObjFunction, sizeof(ObjFunction), OBJ_FUNCTION);
+    function->arity = 0;
+    function->upvalueCount = 0;
+    function->name = NULL;
+    function->oldConstants = 0;
+    function->loopCount = 0;
+    function->loopHeat = NULL;
+    function->lazySource = NULL;
+    function->lazyLength = 0;
+    function->lazyLine = 0;
+    function->ownsSource = false;
+    initChunk(&function->chunk);
+    return function;
+}
+
+
+
+// the captures are filled in by OP_CLOSURE; until then they hold nothing
+ObjClosure* newClosure(ObjFunction* function) {
+    int count = function->upvalueCount;
+    ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, sizeof(ObjClosure) + sizeof(Capture) * count,
+                                       OBJ_CLOSURE);
+    closure->function = function;
+    closure->captureCount = count;
+    for (int i = 0; i < count; i++) {
+        closure->captures[i] = (Capture){.location = NULL, .cell = NULL, .value = NULL_VAL};
+    }
+    return closure;
+}
+
+
+
+ObjUpvalue* newUpvalue(Value* slot) {
+    ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, sizeof(ObjUpvalue), OBJ_UPVALUE);
+    upvalue->location = slot;
+    upvalue->closed = NULL_VAL;
+    upvalue->next = NULL;
+    return upvalue;
+}
+
+
+
+ObjNative* newNative(NativeFn function) {
+    ObjNative* native = ALLOCATE_OBJ(ObjNative, sizeof(ObjNative), OBJ_NATIVE);
+    native->function = function;
+    return native;
+}
+
+
+
+static ObjShape* newShape(ObjShape* parent, ObjString* name) {
+    ObjShape* shape = ALLOCATE_OBJ(ObjShape, sizeof(ObjShape), OBJ_SHAPE);
+    shape->parent = parent;
+    shape->name = name;
+    shape->fieldCount = parent == NULL ? 0 : parent->fieldCount + 1;
+    initTable(&shape->transitions);
+    return shape;
+}
+
+
+
+ObjClass* newClass(ObjString* name) {
+    ObjShape* root = newShape(NULL, NULL);
+    push(OBJ_VAL(root));        // allocating the class may collect
+
+    ObjClass* klass = ALLOCATE_OBJ(ObjClass, sizeof(ObjClass), OBJ_CLASS);
+    klass->name = name;
+    initTable(&klass->methods);
+    klass->shape = root;
+    klass->superclass = NULL;
+
+    pop();
+    return klass;
+}
+
+
+
+ObjInstance* newInstance(ObjClass* klass) {
+    ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, sizeof(ObjInstance), OBJ_INSTANCE);
+    instance->klass = klass;
+    instance->shape = klass->shape;
+    instance->fields = NULL;
+    instance->fieldCapacity = 0;
+    return instance;
+}
+
+
+
+ObjBoundMethod* newBoundMethod(Value receiver, Obj* method) {
+    ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, sizeof(ObjBoundMethod), OBJ_BOUND_METHOD);
+    bound->receiver = receiver;
+    bound->method = method;
+    return bound;
+}
+
+
+
+/**
+ * Finds the slot of field `name` in instances of `shape`.
+ *
+ * Walks from the shape towards the root; each step is one field, newest
+ * first. Names are interned, so comparing pointers is enough.
+ *
+ * @return The slot, or -1 if the shape has no such field.
+ */
+int shapeSlot(ObjShape* shape, ObjString* name) {
+    for (; shape->parent != NULL; shape = shape->parent) {
+        if (shape->name == name) return shape->fieldCount - 1;
+    }
+    return -1;
+}
+
+
+
+// the shape an instance of `shape` has after gaining field `name`
+ObjShape* shapeTransition(ObjShape* shape, ObjString* name) {
+    Value child;
+    if (tableGet(&shape->transitions, name, &child)) return (ObjShape*)AS_OBJ(child);
+
+    ObjShape* next = newShape(shape, name);
+    push(OBJ_VAL(next));        // growing the table may collect
+    tableSet(&shape->transitions, name, OBJ_VAL(next));
+    writeBarrier((Obj*)shape, OBJ_VAL(next));
+    pop();
+    return next;
+}
+
+
+/**
+ * Hashes a string using 32-bit FNV-1a.
+ *
+ * FNV-1a is cheap (one xor and one multiply per byte) and spreads short
+ * identifiers well, which is all the interning table needs.
+ *
+ * @param key The characters to hash.
+ * @param length The number of characters.
+ * @return The 32-bit hash.
+ */
+uint32_t hashString(const char* key, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+
+// allocate an uninitialized string large enough to hold `length` chars
+static ObjString* allocateString(int length) {
+    ObjString* string = ALLOCATE_OBJ(ObjString, sizeof(ObjString) + length + 1, OBJ_STRING);
+    string->length = length;
+    string->storage = STRING_INLINE;
+    string->chars = string->inlineChars;
+    string->inlineChars[length] = '\0';
+    return string;
+}
+
+
+// hash and register a freshly built string in the intern table
+static ObjString* internString(ObjString* string, uint32_t hash) {
+    string->hash = hash;
+    push(OBJ_VAL(string));      // growing the table may collect
+    tableSet(&vm.strings, string, NULL_VAL);
+    pop();
+    return string;
+}
+
+
+/**
+ * Returns the interned string with the given contents, creating it if needed.
+ *
+ * The intern table is probed before allocating, so repeated literals and
+ * identifiers never allocate more than once.
+ *
+ * @param chars The characters to copy (need not be null-terminated).
+ * @param length The number of characters.
+ * @return The canonical ObjString for these characters.
+ */
+ObjString* copyString(const char* chars, int length) {
+    uint32_t hash = hashString(chars, length);
+    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    if (interned != NULL) {
+        reviveObject((Obj*)interned);
+        return interned;
+    }
+
+    ObjString* string = allocateString(length);
+    memcpy(string->inlineChars, chars, length);
+    return internString(string, hash);
+}
+
+
+/**
+ * Like `copyString()`, but a new string borrows `chars` instead of copying.
+ *
+ * Used for constants, whose characters are already sitting in the source
+ * text. The caller must later pass that source to `releaseSource()`, or
+ * keep it alive until `freeVM()`.
+ */
+ObjString* viewString(const char* chars, int length) {
+    uint32_t hash = hashString(chars, length);
+    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    if (interned != NULL) {
+        reviveObject((Obj*)interned);
+        return interned;
+    }
+
+    ObjString* string = ALLOCATE_OBJ(ObjString, sizeof(ObjString), OBJ_STRING);
+    string->length = length;
+    string->storage = STRING_VIEW;
+    string->chars = chars;
+    return internString(string, hash);
+}
+
+
+/**
+ * Gives every view into [start, end) its own copy of its characters.
+ *
+ * All strings are interned, so the intern table is the list of views.
+ */
+void copySourceStrings(const char* start, const char* end) {
+    for (int i = 0; i < vm.strings.capacity; i++) {
+        ObjString* string = vm.strings.entries[i].key;
+        if (string == NULL || string->storage != STRING_VIEW) continue;
+        if (string->chars < start || string->chars >= end) continue;
+
+        push(OBJ_VAL(string));      // allocating may collect
+        char* copy = ALLOCATE(char, string->length + 1);
+        pop();
+
+        memcpy(copy, string->chars, string->length);
+        copy[string->length] = '\0';
+        string->chars = copy;
+        string->storage = STRING_COPY;
+    }
+}
+
+
+
+/**
+ * Gives every function whose body is still to be compiled from [start, end)
+ * its own copy of the body's text.
+ *
+ * The copies are malloc()ed, so nothing collects while the lists are walked.
+ */
+void copyLazySources(const char* start, const char* end) {
+    Obj* lists[] = {vm.objects, vm.oldObjects};
+    for (int i = 0; i < 2; i++) {
+        for (Obj* object = lists[i]; object != NULL; object = object->next) {
+            if (object->type != OBJ_FUNCTION) continue;
+            ObjFunction* function = (ObjFunction*)object;
+            if (function->ownsSource || function->lazySource < start || function->lazySource >= end) continue;
+
+            char* copy = (char*)malloc(function->lazyLength + 1);
+            if (copy == NULL) exit(1);
+            memcpy(copy, function->lazySource, function->lazyLength);
+            copy[function->lazyLength] = '\0';
+            function->lazySource = copy;
+            function->ownsSource = true;
+        }
+    }
+}
+
+
+/**
+ * Returns a string value with the given contents.
+ *
+ * Strings of up to SHORT_STRING_MAX characters are stored inline in the
+ * Value and never touch the heap; longer ones are interned ObjStrings.
+ * Every string value is built through here, `concatenateStrings()` or the
+ * compiler's literals (which apply the same rule), so a given string always
+ * has the same representation.
+ */
+Value stringValue(const char* chars, int length) {
+    if (length <= SHORT_STRING_MAX) return shortStringValue(chars, length);
+    return OBJ_VAL(copyString(chars, length));
+}
+
+
+/**
+ * Builds the rope for `a + b` (see ObjRope).
+ *
+ * Extends a's buffer in place when `a` is a rope at the end of it, and
+ * starts a new buffer with room to grow otherwise.
+ */
+static ObjRope* appendRope(Value a, Value b, int length) {
+    ObjRope* rope = ALLOCATE_OBJ(ObjRope, sizeof(ObjRope), OBJ_ROPE);
+    rope->length = length;
+    rope->buffer = NULL;
+    push(OBJ_VAL(rope));        // growing the buffer may collect
+
+    int aLength = stringLength(a);
+    StringBuffer* buffer;
+    if (IS_ROPE(a) && AS_ROPE(a)->buffer->length == aLength) {
+        buffer = AS_ROPE(a)->buffer;
+    } else {
+        buffer = ALLOCATE(StringBuffer, 1);
+        buffer->chars = NULL;
+        buffer->length = 0;
+        buffer->capacity = 0;
+        buffer->ropes = 0;
+    }
+    rope->buffer = buffer;
+    buffer->ropes++;
+
+    if (buffer->capacity < length) {
+        int oldCapacity = buffer->capacity;
+        int capacity = oldCapacity;
+        while (capacity < length) capacity = GROW_CAPACITY(capacity);
+        buffer->chars = GROW_ARRAY(char, buffer->chars, oldCapacity, capacity);
+        buffer->capacity = capacity;
+    }
+
+    // read the operands only now: if either shares this buffer, growing it
+    // may have moved their characters
+    if (buffer->length == 0) memcpy(buffer->chars, stringChars(&a), aLength);
+    memcpy(buffer->chars + aLength, stringChars(&b), length - aLength);
+    buffer->length = length;
+
+    pop();
+    return rope;
+}
+
+
+/**
+ * Concatenates two string values (of any kind).
+ *
+ * A result too long to be inline but shorter than ROPE_MIN_LENGTH becomes
+ * a new interned string; if it is already interned, the scratch copy is
+ * released and the existing string is returned instead. Anything longer,
+ * or any append to a rope, builds a rope. Heap operands must stay
+ * reachable (on the stack) meanwhile.
+ */
+Value concatenateStrings(Value a, Value b) {
+    int aLength = stringLength(a);
+    int bLength = stringLength(b);
+    int length = aLength + bLength;
+
+    if (length <= SHORT_STRING_MAX) {
+        char chars[SHORT_STRING_MAX];
+        memcpy(chars, stringChars(&a), aLength);
+        memcpy(chars + aLength, stringChars(&b), bLength);
+        return shortStringValue(chars, length);
+    }
+
+    if (length >= ROPE_MIN_LENGTH) return OBJ_VAL(appendRope(a, b, length));
+
+    ObjString* result = allocateString(length);
+    memcpy(result->inlineChars, stringChars(&a), aLength);
+    memcpy(result->inlineChars + aLength, stringChars(&b), bLength);
+
+    uint32_t hash = hashString(result->chars, length);
+    ObjString* interned = tableFindString(&vm.strings, result->chars, length, hash);
+    if (interned != NULL) {
+        // unlink the scratch copy again (it is still at the head of the list)
+        vm.objects = result->obj.next;
+        reallocate(result, sizeof(ObjString) + length + 1, 0);
+        reviveObject((Obj*)interned);
+        return OBJ_VAL(interned);
+    }
+
+    return OBJ_VAL(internString(result, hash));
+}
+
+
+static void writeFunction(OutputBuffer* output, ObjFunction* function) {
+    if (function->name == NULL) {
+        writeOutput(output, "<script>", 8);
+        return;
+    }
+    writeFormatted(output, "<fn %.*s>", function->name->length, function->name->chars);
+}
+
+
+void writeObject(OutputBuffer* output, Value value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_FUNCTION:
+            writeFunction(output, AS_FUNCTION(value));
+            break;
+        case OBJ_CLOSURE:
+            writeFunction(output, AS_CLOSURE(value)->function);
+            break;
+        case OBJ_UPVALUE:
+            writeOutput(output, "<upvalue>", 9);   // never reachable from a script
+            break;
+        case OBJ_NATIVE:
+            writeOutput(output, "<native fn>", 11);
+            break;
+        case OBJ_STRING:
+            writeOutput(output, AS_CSTRING(value), AS_STRING(value)->length);
+            break;
+        case OBJ_ROPE:
+            writeOutput(output, AS_ROPE(value)->buffer->chars, AS_ROPE(value)->length);
+            break;
+        case OBJ_SHAPE:
+            writeOutput(output, "<shape>", 7);     // never reachable from a script
+            break;
+        case OBJ_CLASS: {
+            ObjString* name = AS_CLASS(value)->name;
+            writeOutput(output, name->chars, name->length);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjString* name = AS_INSTANCE(value)->klass->name;
+            writeFormatted(output, "%.*s instance", name->length, name->chars);
+            break;
+        }
+        case OBJ_BOUND_METHOD:
+            writeFunction(output, methodFunction(AS_BOUND_METHOD(value)->method));
+            break;
+    }
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/optimizer.h"
+
+#ifdef DEBUG_PRINT_CODE
+#include "include/debug.h"
+#endif
+
+
+static uint16_t readOffset(Chunk* chunk, int offset) {
+    return (uint16_t)((chunk->code[offset] << 8) | chunk->code[offset + 1]);
+}
+
+
+
+/**
+ * Flags every offset some jump in the chunk lands on.
+ *
+ * A sequence may only be fused if no jump lands past its first
+ * instruction, and the jump doing so may be anywhere in the function.
+ * The start of each catch block counts as a target too.
+ */
+static bool* findJumpTargets(Chunk* chunk) {
+    bool* targets = (bool*)calloc(chunk->count + 1, sizeof(bool));
+    if (targets == NULL) exit(1);
+
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+        switch (chunk->code[offset]) {
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_LESS:
+            case OP_JUMP_IF_NOT_LESS:
+            case OP_JUMP_IF_GREATER:
+            case OP_JUMP_IF_NOT_GREATER:
+            case OP_JUMP_IF_EQUAL:
+            case OP_JUMP_IF_NOT_EQUAL:
+                targets[offset + 3 + readOffset(chunk, offset + 1)] = true;
+                break;
+
+            case OP_LOOP:
+                targets[offset + 4 - readOffset(chunk, offset + 2)] = true;
+                break;
+
+            case OP_FOR_INCR_LT:
+            case OP_FOR_INCR_LT_CONST:
+                targets[offset + 6 - readOffset(chunk, offset + 4)] = true;
+                break;
+
+            case OP_INLINE_GUARD:
+                // where a call that didn't match the inlined callee returns
+                targets[offset + 7 + readOffset(chunk, offset + 5)] = true;
+                break;
+        }
+    }
+
+    // a catch block is entered by unwinding, not by a jump
+    for (int i = 0; i < chunk->handlerCount; i++) {
+        targets[chunk->handlers[i].handler] = true;
+    }
+    return targets;
+}
+
+
+
+// the operators OP_LOCALS_BINARY and OP_LOCAL_CONSTANT_BINARY take over
+static bool isFusableOperator(uint8_t instruction) {
+    switch (instruction) {
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_LESS:
+        case OP_GREATER:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+
+void optimizeLoop(ObjFunction* function, int start, int end) {
+    Chunk* chunk = &function->chunk;
+    uint8_t* code = chunk->code;
+    bool* targets = findJumpTargets(chunk);
+
+    for (int offset = start; offset < end;) {
+        // GET_LOCAL a; (GET_LOCAL b | CONSTANT k); op
+        if (code[offset] == OP_GET_LOCAL && offset + 5 <= end &&
+            (code[offset + 2] == OP_GET_LOCAL || code[offset + 2] == OP_CONSTANT) &&
+            isFusableOperator(code[offset + 4]) &&
+            !targets[offset + 2] && !targets[offset + 4]) {
+            code[offset] = code[offset + 2] == OP_GET_LOCAL ? OP_LOCALS_BINARY
+                                                            : OP_LOCAL_CONSTANT_BINARY;
+            offset += 5;
+            continue;
+        }
+
+        // (SET_LOCAL | SET_GLOBAL) x; POP -> an assignment statement
+        if ((code[offset] == OP_SET_LOCAL || code[offset] == OP_SET_GLOBAL) && offset + 3 <= end &&
+            code[offset + 2] == OP_POP && !targets[offset + 2]) {
+            code[offset] = code[offset] == OP_SET_LOCAL ? OP_SET_LOCAL_POP : OP_SET_GLOBAL_POP;
+            offset += 3;
+            continue;
+        }
+
+        offset += instructionLength(chunk, offset);
+    }
+
+    free(targets);
+
+#ifdef DEBUG_PRINT_CODE
+    printf("=== hot loop %d..%d ===\n", start, end);
+    for (int offset = start; offset < end;) {
+        offset = disassembleInstruction(chunk, offset);
+    }
+#endif
+}
@@ -0,0 +1,132 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/output.h"
+
+
+void initOutput(OutputBuffer* output, int fd) {
+    output->chars = NULL;
+    output->count = 0;
+    output->capacity = 0;
+    output->fd = fd;
+}
+
+
+void freeOutput(OutputBuffer* output) {
+    flushOutput(output);
+    free(output->chars);
+    initOutput(output, output->fd);
+}
+
+
+// write all of `chars` to `fd`, however many calls that takes
+static void writeAll(int fd, const char* chars, int length) {
+    // anything still sitting in stdio's buffer was printed first
+    if (fd == STDOUT_FILENO) fflush(stdout);
+
+    while (length > 0) {
+        ssize_t written = write(fd, chars, (size_t)length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;         // nowhere to report it; drop the output
+        }
+        chars += written;
+        length -= (int)written;
+    }
+}
+
+
+// make room for `length` more bytes
+static void reserveOutput(OutputBuffer* output, int length) {
+    if (output->capacity - output->count >= length) return;
+
+    if (output->fd != OUTPUT_MEMORY) {
+        flushOutput(output);
+        if (output->capacity >= length) return;
+    }
+
+    int capacity = output->capacity;
+    while (capacity - output->count < length) {
+        capacity = capacity < OUTPUT_BUFFER_SIZE ? OUTPUT_BUFFER_SIZE : capacity * 2;
+    }
+    output->chars = (char*)realloc(output->chars, (size_t)capacity);
+    if (output->chars == NULL) exit(1);
+    output->capacity = capacity;
+}
+
+
+/**
+ * Appends `length` bytes to the output.
+ *
+ * A block too big for the buffer bypasses it once what is already
+ * buffered has been flushed.
+ */
+void writeOutput(OutputBuffer* output, const char* chars, int length) {
+    if (output->fd != OUTPUT_MEMORY && length > OUTPUT_BUFFER_SIZE) {
+        flushOutput(output);
+        writeAll(output->fd, chars, length);
+        return;
+    }
+
+    reserveOutput(output, length);
+    memcpy(output->chars + output->count, chars, (size_t)length);
+    output->count += length;
+}
+
+
+// appends printf-style formatted text
+void writeFormatted(OutputBuffer* output, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    char small[64];
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+
+    if (length < (int)sizeof(small)) {
+        writeOutput(output, small, length);
+        return;
+    }
+
+    // too long for the scratch space -> format again straight into the buffer
+    reserveOutput(output, length + 1);
+    va_start(args, format);
+    vsnprintf(output->chars + output->count, (size_t)length + 1, format, args);
+    va_end(args);
+    output->count += length;
+}
+
+
+void flushOutput(OutputBuffer* output) {
+    if (output->fd == OUTPUT_MEMORY || output->count == 0) return;
+    writeAll(output->fd, output->chars, output->count);
+    output->count = 0;
+}
+
+
+/**
+ * Sends all further output to `fd` (or OUTPUT_MEMORY).
+ *
+ * What was written so far goes to the previous sink; when that was
+ * memory it is kept, and is flushed to `fd` along with the rest.
+ */
+void redirectOutput(OutputBuffer* output, int fd) {
+    flushOutput(output);
+    output->fd = fd;
+}
+
+
+// the text collected by a memory sink (not null-terminated)
+const char* outputContents(OutputBuffer* output, int* length) {
+    *length = output->count;
+    return output->chars;
+}
+
+
+// drops collected text, e.g. once the embedder has consumed it
+void clearOutput(OutputBuffer* output) {
+    output->count = 0;
+}
@@ -2,12 +2,14 @@
 #include <string.h>
 
 #include "include/common.h"
+#include "include/number.h"
 #include "include/scanner.h"    
 
 typedef struct {
     const char* start;
     const char* current;
     int line;
+    bool noinline;      // a `// @noinline` comment was skipped since the last token
 } Scanner;
 
 Scanner scanner;
@@ -24,6 +26,15 @@ void initScanner(const char* source) {
     scanner.start = source;
     scanner.current = source;
     scanner.line = 1;
+    scanner.noinline = false;
+}
+
+
+
+// carries on scanning from `source`, some way into a script, at `line`
+void initScannerAt(const char* source, int line) {
+    initScanner(source);
+    scanner.line = line;
 }
 
 
@@ -89,6 +100,8 @@ static Token makeToken(TokenType type) {
     token.start = scanner.start;
     token.length = (int) (scanner.current - scanner.start);
     token.line = scanner.line;
+    token.noinline = scanner.noinline;
+    scanner.noinline = false;
 
     return token;
 }
@@ -99,10 +112,20 @@ static Token errorToken(const char* message) {
     token.start = message;
     token.length = (int) strlen(message);
     token.line = scanner.line;
+    token.noinline = false;
     return token;
 }
 
 
+// whether a `//` comment's text is the pragma that keeps the function
+// declared after it from being inlined
+static bool isNoInlinePragma(const char* text, const char* end) {
+    while (text < end && (*text == ' ' || *text == '\t')) text++;
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    return end - text == 9 && memcmp(text, "@noinline", 9) == 0;
+}
+
+
 /**
  * @brief Skips over any whitespace characters in the input.
  *
@@ -132,7 +155,9 @@ static void skipWhitespace() {
                 // single-line comments
                 if (peekNext() == '/') {
                     // A comment goes until the end of the line
+                    const char* text = scanner.current + 2;
                     while (peek() != '\n' && !isAtEnd()) advance();
+                    if (isNoInlinePragma(text, scanner.current)) scanner.noinline = true;
                 }
                 // multi-line comments 
                 else if (peek() == '*') {
@@ -225,7 +250,15 @@ static TokenType checkKeyword(int start, int length, const char* rest, TokenType
 static TokenType identifierType() {
     switch (scanner.start[0]) {
         case 'a': return checkKeyword(1, 2, "nd", TOKEN_AND);
-        case 'c': return checkKeyword(1, 4, "lass", TOKEN_CLASS);
+        case 'c':
+            // check for 'catch', 'class'
+            if (scanner.current - scanner.start > 1) {
+                switch (scanner.start[1]) {
+                    case 'a': return checkKeyword(2, 3, "tch", TOKEN_CATCH);
+                    case 'l': return checkKeyword(2, 3, "ass", TOKEN_CLASS);
+                }
+            }
+            break;
         case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
         case 'f': 
         // check for 'false', 'for', 'fun'
@@ -245,11 +278,21 @@ static TokenType identifierType() {
         case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
         case 's': return checkKeyword(1, 4, "uper", TOKEN_SUPER);
         case 't': 
-            // check for 'this', 'true'
-            if (scanner.current - scanner.start > 1) {
+            // check for 'this', 'throw', 'true', 'try'
+            if (scanner.current - scanner.start > 2) {
                 switch (scanner.start[1]) {
-                    case 'h': return checkKeyword(2, 2, "is", TOKEN_THIS);
-                    case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
+                    case 'h':
+                        switch (scanner.start[2]) {
+                            case 'i': return checkKeyword(3, 1, "s", TOKEN_THIS);
+                            case 'r': return checkKeyword(3, 2, "ow", TOKEN_THROW);
+                        }
+                        break;
+                    case 'r':
+                        switch (scanner.start[2]) {
+                            case 'u': return checkKeyword(3, 1, "e", TOKEN_TRUE);
+                            case 'y': return checkKeyword(3, 0, "", TOKEN_TRY);
+                        }
+                        break;
                 }
             }
             break;
@@ -282,19 +325,55 @@ static Token identifier() {
   *  as it appears in the source code
 **/
 
-static Token number() {
+// significant digits that fit in the 64-bit mantissa
+#define MANTISSA_DIGITS 19
 
-    while (isDigit(peek())) advance();
+/**
+ * Scans a number literal, computing its value on the way.
+ *
+ * The digits are accumulated as an integer mantissa and a power of ten,
+ * so the compiler doesn't have to parse the text again.
+ */
+static Token number() {
+    uint64_t mantissa = (uint64_t)(scanner.start[0] - '0');
+    int digits = mantissa != 0;     // significant ones, leading zeros don't count
+    int exponent = 0;
+    bool truncated = false;
+
+    while (isDigit(peek())) {
+        int digit = advance() - '0';
+        if (digits < MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + digit;
+            if (mantissa != 0) digits++;
+        } else {
+            exponent++;             // a dropped digit still scales the rest
+            if (digit != 0) truncated = true;
+        }
+    }
 
     // look for a fractional part.
-    if (peek() == '.' && isDigit(peekNext())) {
+    bool fraction = peek() == '.' && isDigit(peekNext());
+    if (fraction) {
         // consume the '.'
         advance();
 
-        while (isDigit(peek())) advance();
+        while (isDigit(peek())) {
+            int digit = advance() - '0';
+            if (digits < MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + digit;
+                exponent--;
+                if (mantissa != 0) digits++;
+            } else if (digit != 0) {
+                truncated = true;
+            }
+        }
     }
 
-    return makeToken(TOKEN_NUMBER);
+    Token token = makeToken(TOKEN_NUMBER);
+    token.number = decimalToDouble(mantissa, exponent, truncated, token.start, token.length);
+    token.isInteger = !fraction && exponent == 0 && mantissa <= (uint64_t)INT64_MAX;
+    token.integer = token.isInteger ? (int64_t)mantissa : 0;
+    return token;
 }
 
 
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/memory.h"
+#include "include/object.h"
+#include "include/table.h"
+#include "include/value.h"
+#include "include/vm.h"
+
+// grow the table once it is more than 75% full
+#define TABLE_MAX_LOAD 0.75
+
+
+void initTable(Table* table) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+}
+
+
+void freeTable(Table* table) {
+    FREE_ARRAY(Entry, table->entries, table->capacity);
+    initTable(table);
+}
+
+
+/**
+ * Finds the bucket for `key` using linear probing.
+ *
+ * The capacity is always a power of two, so the modulo reduces to a mask.
+ * Keys are interned, so comparing pointers is enough.
+ *
+ * Deleted entries are left behind as tombstones (NULL key, `true` value) so
+ * that probe sequences running through them are not cut short. If `key` is
+ * absent, the first tombstone passed is returned so it can be reused.
+ *
+ * @return The entry holding `key`, or the entry where it should be inserted.
+ */
+static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
+    uint32_t index = key->hash & (capacity - 1);
+    Entry* tombstone = NULL;
+
+    for (;;) {
+        Entry* entry = &entries[index];
+        if (entry->key == NULL) {
+            if (IS_NULL(entry->value)) {
+                // truly empty -> the key is not in the table
+                return tombstone != NULL ? tombstone : entry;
+            } else {
+                // remember the first tombstone we pass
+                if (tombstone == NULL) tombstone = entry;
+            }
+        } else if (entry->key == key) {
+            return entry;
+        }
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+
+/**
+ * Looks up `key` and copies its value into `value`.
+ *
+ * @return true if the key was found.
+ */
+bool tableGet(Table* table, ObjString* key, Value* value) {
+    if (table->count == 0) return false;
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return false;
+
+    *value = entry->value;
+    return true;
+}
+
+
+// rehash every entry into a freshly allocated array of `capacity` buckets
+static void adjustCapacity(Table* table, int capacity) {
+    Entry* entries = ALLOCATE(Entry, capacity);
+    for (int i = 0; i < capacity; i++) {
+        entries[i].key = NULL;
+        entries[i].value = NULL_VAL;
+    }
+
+    // tombstones are dropped while rehashing, so recount from scratch
+    table->count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->key == NULL) continue;
+
+        Entry* dest = findEntry(entries, capacity, entry->key);
+        dest->key = entry->key;
+        dest->value = entry->value;
+        table->count++;
+    }
+
+    FREE_ARRAY(Entry, table->entries, table->capacity);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+
+/**
+ * Inserts or overwrites the value stored under `key`.
+ *
+ * @return true if `key` was not present before.
+ */
+bool tableSet(Table* table, ObjString* key, Value value) {
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
+        int capacity = GROW_CAPACITY(table->capacity);
+        adjustCapacity(table, capacity);
+    }
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    bool isNewKey = entry->key == NULL;
+    // reusing a tombstone doesn't change the count, it was never decremented
+    if (isNewKey && IS_NULL(entry->value)) table->count++;
+
+    entry->key = key;
+    entry->value = value;
+    return isNewKey;
+}
+
+
+/**
+ * Removes `key` by replacing its entry with a tombstone.
+ *
+ * The count is left alone: tombstones still occupy a bucket and must be
+ * counted against the load factor, otherwise a table full of tombstones
+ * could leave no empty bucket to terminate a probe.
+ *
+ * @return true if the key was present.
+ */
+bool tableDelete(Table* table, ObjString* key) {
+    if (table->count == 0) return false;
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return false;
+
+    entry->key = NULL;
+    entry->value = BOOL_VAL(true);
+    return true;
+}
+
+
+// copy every entry of `from` into `to`
+void tableAddAll(Table* from, Table* to) {
+    for (int i = 0; i < from->capacity; i++) {
+        Entry* entry = &from->entries[i];
+        if (entry->key != NULL) {
+            tableSet(to, entry->key, entry->value);
+        }
+    }
+}
+
+
+/**
+ * Looks up a string by content rather than by pointer.
+ *
+ * This is the one place where characters are actually compared; it is used
+ * by the interning functions to find the canonical copy of a string.
+ */
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
+    if (table->count == 0) return NULL;
+
+    uint32_t index = hash & (table->capacity - 1);
+    for (;;) {
+        Entry* entry = &table->entries[index];
+        if (entry->key == NULL) {
+            // stop at an empty, non-tombstone entry
+            if (IS_NULL(entry->value)) return NULL;
+        } else if (entry->key->length == length &&
+            entry->key->hash == hash &&
+            memcmp(entry->key->chars, chars, length) == 0) {
+            return entry->key;      // found it
+        }
+
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+
+// mark every key and value -> the table is a GC root
+void markTable(Table* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        markObject((Obj*)entry->key);
+        markValue(entry->value);
+    }
+}
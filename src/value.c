@@ -1,5 +1,10 @@
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "include/memory.h"
+#include "include/number.h"
+#include "include/object.h"
 #include "include/value.h"
 
 /**
@@ -58,25 +63,74 @@ void freeValueArray(ValueArray* array) {
 }
 
 
-void printValue(Value value) {
+void writeValue(OutputBuffer* output, Value value) {
     switch (value.type) {
         case VAL_BOOL:
-            printf(AS_BOOL(value) ? "true": "false");
+            if (AS_BOOL(value)) writeOutput(output, "true", 4);
+            else writeOutput(output, "false", 5);
+            break;
+        case VAL_NULL:      writeOutput(output, "null", 4); break;
+        case VAL_NUMBER: {
+            char chars[NUMBER_BUFFER_SIZE];
+            writeOutput(output, chars, formatNumber(AS_NUMBER(value), chars));
+            break;
+        }
+        case VAL_INT: {
+            char chars[NUMBER_BUFFER_SIZE];
+            writeOutput(output, chars, formatInteger(AS_INT(value), chars));
             break;
-        case VAL_NULL:      printf("null"); break;
-        case VAL_NUMBER:    printf("%g", AS_NUMBER(value));
-        break;
+        }
+        case VAL_SHORT_STRING:
+            writeOutput(output, AS_SHORT_CSTRING(value), stringLength(value));
+            break;
+        case VAL_OBJ:       writeObject(output, value); break;
     }
 }
 
 
+// straight to stdout, for the disassembler and execution traces
+void printValue(Value value) {
+    OutputBuffer output;
+    initOutput(&output, STDOUT_FILENO);
+    writeValue(&output, value);
+    freeOutput(&output);
+}
+
+
+
+// whether `number` is exactly the integer `integer`
+static bool sameNumber(double number, int64_t integer) {
+    // 2^63 itself is out of range, and NaN fails both comparisons
+    if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0)) return false;
+    return (double)(int64_t)number == number && (int64_t)number == integer;
+}
+
 
 bool valuesEqual(Value a, Value b) {
+    // 1 and 1.0 are the same number
+    if (IS_INT(a) && IS_NUMBER(b)) return sameNumber(AS_NUMBER(b), AS_INT(a));
+    if (IS_NUMBER(a) && IS_INT(b)) return sameNumber(AS_NUMBER(a), AS_INT(b));
+
     if (a.type != b.type) return false;
     switch (a.type) {
         case VAL_BOOL:      return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NULL:      return true;
         case VAL_NUMBER:    return AS_NUMBER(a) == AS_NUMBER(b);
+        case VAL_INT:       return AS_INT(a) == AS_INT(b);
+        // short strings are always inline and longer ones never are, so a
+        // short string can only equal another short string
+        case VAL_SHORT_STRING:
+            return memcmp(AS_SHORT_CSTRING(a), AS_SHORT_CSTRING(b), sizeof(a.as.shortChars)) == 0;
+        // strings are interned, so equal contents means the same object --
+        // except for ropes, whose characters have to be compared
+        case VAL_OBJ:
+            if (AS_OBJ(a) == AS_OBJ(b)) return true;
+            if ((IS_ROPE(a) || IS_ROPE(b)) && IS_ANY_STRING(a) && IS_ANY_STRING(b)) {
+                int length = stringLength(a);
+                return length == stringLength(b) &&
+                       memcmp(stringChars(&a), stringChars(&b), length) == 0;
+            }
+            return false;
         default:            return false;       // Unreachable.
     }
 }
\ No newline at end of file
@@ -1,46 +1,214 @@
+#include <setjmp.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <time.h>
 #include "include/common.h"  
 #include "include/vm.h"      // Virtual machine (VM) definitions
 #include "include/debug.h"
 #include "include/compiler.h"
+#include "include/memory.h"
+#include "include/object.h"
+#include "include/optimizer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 VM vm;  // Global VM instance
 
+// innermost frames shown in a runtime error's stack trace
+#define TRACE_MAX 16
+
+// where a fault on one of the guard pages resumes (see interpret())
+static sigjmp_buf overflowJump;
+static volatile sig_atomic_t overflowArmed = 0;
+
 static void resetStack() {
     vm.stackTop = vm.stack;
+    vm.frameCount = 0;
+    vm.openUpvalues = NULL;
 }
 
 
+// the message of the runtime error being raised, until it is caught or reported
+static char errorMessage[512];
+static bool errorRaised = false;    // the exception is that error, not a thrown value
+
+
+/**
+ * Raises a runtime error in the running instruction.
+ *
+ * Only the message is recorded; run() then unwinds to a handler, where
+ * the message becomes the caught value (see catchException()), or
+ * reports the error if there is none.
+ */
 static void runtimeError(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vsnprintf(errorMessage, sizeof(errorMessage), format, args);
     va_end(args);
-    fputs("\n", stderr);
+    errorRaised = true;
+}
+
+
+
+// prints an exception nothing caught, with a stack trace, and abandons the script
+static void reportException() {
+    flushOutput(&vm.output);    // so the error comes after what was printed
+
+    if (errorRaised) {
+        fprintf(stderr, "%s\n", errorMessage);
+    } else {
+        // a thrown value, on top of the stack
+        OutputBuffer error;
+        initOutput(&error, STDERR_FILENO);
+        writeFormatted(&error, "Uncaught exception: ");
+        writeValue(&error, vm.stackTop[-1]);
+        writeOutput(&error, "\n", 1);
+        freeOutput(&error);
+    }
+    errorRaised = false;
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
+    // print a stack trace, innermost call first
+    for (int i = vm.frameCount - 1; i >= 0; i--) {
+        // deep recursion would otherwise dump millions of identical lines
+        if (vm.frameCount - i > TRACE_MAX && i > 0) {
+            fprintf(stderr, "... %d more calls\n", i);
+            i = 0;
+        }
+
+        CallFrame* frame = &vm.frames[i];
+        ObjFunction* function = frame->function;
+        size_t instruction = frame->ip - function->chunk.code - 1;
 
-    // use getLine to correctly retrieve the line number.
-    //int line = vm.chunk->lines->lineNumber[instruction];    // may create seg-fault
-    int line = getLine(vm.chunk, instruction);
-    fprintf(stderr, "line[ %d] in script \n", line);
+        // use getLine to correctly retrieve the line number.
+        int line = getLine(&function->chunk, instruction);
+
+        // calls inlined there get a line of their own, as if they had a frame
+        Chunk* chunk = &function->chunk;
+        for (int j = 0; j < chunk->inlinedCount; j++) {
+            InlinedCall* call = &chunk->inlined[j];
+            if ((int)instruction < call->start || (int)instruction >= call->end) continue;
+            fprintf(stderr, "line[ %d] in %.*s() \n", line, call->function->name->length, call->function->name->chars);
+            line = call->line;
+        }
+
+        if (function->name == NULL) {
+            fprintf(stderr, "line[ %d] in script \n", line);
+        } else {
+            fprintf(stderr, "line[ %d] in %.*s() \n", line, function->name->length, function->name->chars);
+        }
+    }
     
     resetStack(); 
 }
 
 
 
+/**
+ * @brief SIGSEGV handler that turns a guard-page hit into a stack overflow.
+ *
+ * Pushes and frame setups never compare against a limit; running off the end
+ * of either stack touches its PROT_NONE guard page instead. If the faulting
+ * address is inside one of the two guard pages, control jumps back to
+ * interpret(), which reports a runtime error. Any other fault is a genuine
+ * crash and is re-raised with the default action.
+ */
+static void guardPageHandler(int signal, siginfo_t* info, void* context) {
+    (void)context;
+    char* address = (char*)info->si_addr;
+    char* framesEnd = (char*)vm.frames + (size_t)vm.frameCapacity * sizeof(CallFrame);
+    char* stackEnd = (char*)(vm.stack + vm.stackCapacity);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    bool inGuard = (address >= framesEnd && address < framesEnd + page) ||
+                   (address >= stackEnd && address < stackEnd + page);
+
+    if (inGuard && overflowArmed) {
+        siglongjmp(overflowJump, 1);
+    }
+
+    // not ours: fall back to the default action when the fault repeats
+    struct sigaction action;
+    action.sa_handler = SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(signal, &action, NULL);
+}
+
+
+
+static Value clockNative(int argCount, Value* args) {
+    (void)argCount;
+    (void)args;
+    return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+
+
+static void defineNative(const char* name, NativeFn function) {
+    // keep both objects on the stack while the table may reallocate
+    push(OBJ_VAL(copyString(name, (int)strlen(name))));
+    push(OBJ_VAL(newNative(function)));
+    tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
+    globalsBarrier(vm.stack[0]);
+    globalsBarrier(vm.stack[1]);
+    pop();
+    pop();
+}
+
+
+
 // Initialize the virtual machine
 void initVM() {
+    size_t framesBytes = FRAMES_RESERVE;
+    size_t stackBytes = STACK_RESERVE;
+    vm.frames = (CallFrame*)reserveGuarded(&framesBytes);
+    vm.stack = (Value*)reserveGuarded(&stackBytes);
+    if (vm.frames == NULL || vm.stack == NULL) {
+        fprintf(stderr, "Could not reserve the VM stack.\n");
+        exit(1);
+    }
+
+    // the guard pages sit right after the last whole element
+    vm.frameCapacity = (int)(framesBytes / sizeof(CallFrame));
+    vm.stackCapacity = stackBytes / sizeof(Value);
     resetStack();
+
+    struct sigaction action;
+    action.sa_sigaction = guardPageHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &action, NULL);
+
+    vm.objects = NULL;
+    vm.oldObjects = NULL;
+    vm.bytesAllocated = 0;
+    initGC(&vm.gc);
+    initTable(&vm.globals);
+    initTable(&vm.strings);
+    initOutput(&vm.output, STDOUT_FILENO);
+    vm.optimizeLevel = 0;
+    vm.strict = false;
+
+    vm.initString = NULL;   // so a collection while copying it finds no garbage
+    vm.initString = copyString("init", 4);
+
+    defineNative("clock", clockNative);
 }
 
 // Free resources used by the virtual machine
 void freeVM() {
-    // Cleanup logic goes here
+    freeOutput(&vm.output);     // flushes whatever is left
+    freeTable(&vm.globals);
+    freeTable(&vm.strings);
+    freeCompiler();
+    vm.initString = NULL;
+    freeObjects();
+    freeGC(&vm.gc);
+    releaseGuarded(vm.frames, (size_t)vm.frameCapacity * sizeof(CallFrame));
+    releaseGuarded(vm.stack, vm.stackCapacity * sizeof(Value));
 }
 
 
@@ -54,11 +222,7 @@ void freeVM() {
  * @param value The Value to be pushed onto the stack.
  */
 void push(Value value) {
-    if (vm.stackTop > vm.stack + STACK_MAX) {
-        fprintf(stderr, "Stack overflow\n");
-        exit(1);
-    }
-
+    // no bounds check: overflowing hits the guard page (see guardPageHandler)
     *vm.stackTop = value;
     vm.stackTop++;
 }
@@ -99,11 +263,487 @@ static Value peek(int distance) {
 
 
 
+// a function the compiler declared without its body gets it on the first call
+static bool compileOnCall(ObjFunction* function) {
+    if (function->lazySource != NULL) {
+        flushOutput(&vm.output);    // any compile error comes after what was printed
+        if (compileLazy(function)) return true;
+    }
+    runtimeError("Can't call '%.*s', its body failed to compile.",
+                 function->name->length, function->name->chars);
+    return false;
+}
+
+
+
+/**
+ * @brief Pushes a new call frame for `function`.
+ *
+ * The arguments are already on the stack, right above the callee itself,
+ * so the new frame's window simply starts at the callee's slot.
+ *
+ * @return false if the argument count doesn't match the function's arity,
+ *         or a body compiled on this call fails to compile.
+ */
+static bool call(ObjFunction* function, int argCount) {
+    if (argCount != function->arity) {
+        runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
+        return false;
+    }
+    if (function->chunk.count == 0 && !compileOnCall(function)) return false;
+
+    // fill the frame before counting it, so a fault on the guard page
+    // never leaves a half-written frame on the call stack
+    CallFrame* frame = &vm.frames[vm.frameCount];
+    frame->function = function;
+    frame->closure = NULL;
+    frame->ip = function->chunk.code;
+    frame->slots = vm.stackTop - argCount - 1;
+    vm.frameCount++;
+    return true;
+}
+
+
+
+static bool callClosure(ObjClosure* closure, int argCount) {
+    if (!call(closure->function, argCount)) return false;
+    vm.frames[vm.frameCount - 1].closure = closure;
+    return true;
+}
+
+
+
+// a method is stored as a plain function unless it captured something
+static bool callMethod(Obj* method, int argCount) {
+    if (method->type == OBJ_CLOSURE) return callClosure((ObjClosure*)method, argCount);
+    return call((ObjFunction*)method, argCount);
+}
+
+
+
+static bool callValue(Value callee, int argCount) {
+    if (IS_OBJ(callee)) {
+        switch (OBJ_TYPE(callee)) {
+            case OBJ_FUNCTION:
+                return call(AS_FUNCTION(callee), argCount);
+
+            case OBJ_CLOSURE:
+                return callClosure(AS_CLOSURE(callee), argCount);
+
+            case OBJ_BOUND_METHOD: {
+                // the receiver takes the callee's slot, where the method finds `this`
+                ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
+                vm.stackTop[-argCount - 1] = bound->receiver;
+                return callMethod(bound->method, argCount);
+            }
+
+            case OBJ_CLASS: {
+                // calling a class makes an instance and runs `init` on it, if any
+                ObjClass* klass = AS_CLASS(callee);
+                vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));
+
+                Value initializer;
+                if (tableGet(&klass->methods, vm.initString, &initializer)) {
+                    return callMethod(AS_OBJ(initializer), argCount);
+                }
+                if (argCount != 0) {
+                    runtimeError("Expected 0 arguments but got %d.", argCount);
+                    return false;
+                }
+                return true;
+            }
+
+            case OBJ_NATIVE: {
+                NativeFn native = AS_NATIVE(callee);
+                Value result = native(argCount, vm.stackTop - argCount);
+                vm.stackTop -= argCount + 1;
+                push(result);
+                return true;
+            }
+
+            default:
+                break;      // Non-callable object type.
+        }
+    }
+
+    runtimeError("Can only call functions.");
+    return false;
+}
+
+
+
+/**
+ * Finds or creates the open upvalue for stack slot `local`.
+ *
+ * Closures capturing the same variable must share one cell, so the open
+ * list (sorted, topmost slot first) is searched before making a new one.
+ */
+static ObjUpvalue* captureUpvalue(Value* local) {
+    ObjUpvalue* previous = NULL;
+    ObjUpvalue* upvalue = vm.openUpvalues;
+    while (upvalue != NULL && upvalue->location > local) {
+        previous = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue != NULL && upvalue->location == local) return upvalue;
+
+    ObjUpvalue* created = newUpvalue(local);
+    created->next = upvalue;
+    if (previous == NULL) {
+        vm.openUpvalues = created;
+    } else {
+        previous->next = created;
+    }
+    return created;
+}
+
+
+
+// close every open upvalue at or above `last` -> their slots are about to go
+static void closeUpvalues(Value* last) {
+    while (vm.openUpvalues != NULL && vm.openUpvalues->location >= last) {
+        ObjUpvalue* upvalue = vm.openUpvalues;
+        upvalue->closed = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        writeBarrier((Obj*)upvalue, upvalue->closed);
+        vm.openUpvalues = upvalue->next;
+    }
+}
+
+
+
+/**
+ * Unwinds to the catch block for the exception being raised.
+ *
+ * The exception tables of the running function and then of its callers
+ * are searched for the innermost `try` covering the instruction each
+ * frame is at; a `try` costs nothing until this runs. Frames above the
+ * one with the handler are discarded and its stack is cut back to the
+ * locals in scope at the `try`, with the exception pushed for the catch
+ * variable: the value thrown, or a runtime error's message.
+ *
+ * @return false if nothing catches it; it has been reported then.
+ */
+static bool catchException() {
+    for (int i = vm.frameCount - 1; i >= 0; i--) {
+        CallFrame* frame = &vm.frames[i];
+        Chunk* chunk = &frame->function->chunk;
+        int instruction = (int)(frame->ip - chunk->code - 1);
+
+        for (int j = 0; j < chunk->handlerCount; j++) {
+            ExceptionHandler* handler = &chunk->handlers[j];
+            if (instruction < handler->start || instruction >= handler->end) continue;
+
+            Value exception = errorRaised
+                ? OBJ_VAL(copyString(errorMessage, (int)strlen(errorMessage)))
+                : vm.stackTop[-1];
+            errorRaised = false;
+
+            closeUpvalues(frame->slots + handler->height);
+            vm.frameCount = i + 1;
+            vm.stackTop = frame->slots + handler->height;
+            push(exception);
+            frame->ip = chunk->code + handler->handler;
+            return true;
+        }
+    }
+
+    reportException();
+    return false;
+}
+
+
+
+// where the variable behind one of a closure's captures is right now
+static inline Value* captureSlot(Capture* capture) {
+    return capture->cell != NULL ? capture->cell->location : capture->location;
+}
+
+
+
+/**
+ * Fills in the captures of `closure`, just created in `frame`, from the
+ * operands of the OP_CLOSURE being run. The closure must be on the stack:
+ * making a cell may collect.
+ */
+static void captureVariables(CallFrame* frame, ObjClosure* closure) {
+    for (int i = 0; i < closure->captureCount; i++) {
+        uint8_t kind = *frame->ip++;
+        uint16_t index = (uint16_t)((frame->ip[0] << 8) | frame->ip[1]);
+        frame->ip += 2;
+
+        Capture* capture = &closure->captures[i];
+        switch (kind) {
+            case CAPTURE_FLAT:
+                capture->value = frame->slots[index];
+                capture->location = &capture->value;
+                break;
+            case CAPTURE_STACK:
+                capture->location = &frame->slots[index];
+                break;
+            case CAPTURE_CELL:
+                capture->cell = captureUpvalue(&frame->slots[index]);
+                break;
+            default: {
+                // CAPTURE_UPVALUE: a flat copy must point at its own value
+                *capture = frame->closure->captures[index];
+                if (capture->location == &frame->closure->captures[index].value) {
+                    capture->location = &capture->value;
+                }
+                break;
+            }
+        }
+
+        if (capture->cell != NULL) writeBarrier((Obj*)closure, OBJ_VAL(capture->cell));
+        writeBarrier((Obj*)closure, capture->value);
+    }
+}
+
+
+
+/**
+ * @brief Calls `callee` in place of the current frame (a proper tail call).
+ *
+ * The callee and its arguments are slid down over the current frame's
+ * window and the frame is reused, so tail-recursive loops run in constant
+ * stack space. Variables of the frame that cells captured are closed
+ * first. Anything that isn't a script function or closure (natives) is
+ * called normally; the OP_RETURN that follows OP_TAIL_CALL then returns
+ * its result.
+ */
+static bool tailCall(CallFrame* frame, Value callee, int argCount) {
+    if (!IS_FUNCTION(callee) && !IS_CLOSURE(callee)) return callValue(callee, argCount);
+
+    ObjClosure* closure = IS_CLOSURE(callee) ? AS_CLOSURE(callee) : NULL;
+    ObjFunction* function = closure != NULL ? closure->function : AS_FUNCTION(callee);
+    if (argCount != function->arity) {
+        runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
+        return false;
+    }
+    if (function->chunk.count == 0 && !compileOnCall(function)) return false;
+
+    closeUpvalues(frame->slots);
+    Value* args = vm.stackTop - argCount - 1;
+    memmove(frame->slots, args, sizeof(Value) * (argCount + 1));
+    vm.stackTop = frame->slots + argCount + 1;
+
+    frame->function = function;
+    frame->closure = closure;
+    frame->ip = function->chunk.code;
+    return true;
+}
+
+
+
+// replace the instance on top of the stack with its method `name`, bound to it
+static bool bindMethod(ObjClass* klass, ObjString* name) {
+    Value method;
+    if (!tableGet(&klass->methods, name, &method)) {
+        runtimeError("Undefined property '%.*s'.", name->length, name->chars);
+        return false;
+    }
+
+    ObjBoundMethod* bound = newBoundMethod(peek(0), AS_OBJ(method));
+    pop();
+    push(OBJ_VAL(bound));
+    return true;
+}
+
+
+
+// the class is just below the method on the stack
+static void defineMethod(ObjString* name) {
+    Value method = peek(0);
+    ObjClass* klass = AS_CLASS(peek(1));
+    tableSet(&klass->methods, name, method);
+    writeBarrier((Obj*)klass, OBJ_VAL(name));
+    writeBarrier((Obj*)klass, method);
+    pop();
+}
+
+
+
+// the entry of `cache` for receivers of `shape`, NULL on a miss
+static inline CacheEntry* findCacheEntry(InlineCache* cache, ObjShape* shape) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].shape == shape) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+
+
+// records `entry`, unless the cache is already full (megamorphic)
+static void fillCache(ObjFunction* function, InlineCache* cache, CacheEntry entry) {
+    if (cache->count == INLINE_CACHE_WAYS) return;
+
+    cache->entries[cache->count++] = entry;
+    writeBarrier((Obj*)function, OBJ_VAL(entry.shape));
+    if (entry.transition != NULL) writeBarrier((Obj*)function, OBJ_VAL(entry.transition));
+    if (entry.method != NULL) writeBarrier((Obj*)function, OBJ_VAL(entry.method));
+}
+
+
+
+/**
+ * Works out what storing field `cache->name` does to an instance of `shape`.
+ *
+ * An existing field is overwritten in place; a new one moves the instance
+ * to the child shape that adds it, creating that shape the first time.
+ * The instance must be on the stack, as creating the shape may collect.
+ */
+static CacheEntry resolveStore(ObjFunction* function, InlineCache* cache, ObjShape* shape) {
+    CacheEntry entry = {.shape = shape, .slot = shapeSlot(shape, cache->name)};
+    if (entry.slot == -1) {
+        entry.transition = shapeTransition(shape, cache->name);
+        entry.slot = shape->fieldCount;
+    }
+    fillCache(function, cache, entry);
+    return entry;
+}
+
+
+
+// what `name(...)` calls on `instance`: a field, if its shape has one, else a method
+static CacheEntry resolveInvoke(ObjFunction* function, InlineCache* cache, ObjInstance* instance) {
+    CacheEntry entry = {.shape = instance->shape, .slot = shapeSlot(instance->shape, cache->name)};
+
+    Value method;
+    if (entry.slot == -1 && tableGet(&instance->klass->methods, cache->name, &method)) {
+        entry.method = AS_OBJ(method);
+    }
+    fillCache(function, cache, entry);
+    return entry;
+}
+
+
+
+/**
+ * Calls method `cache->name` on the receiver below the arguments.
+ *
+ * This is `receiver.name(args)` without the bound method the separate
+ * property read would allocate: the receiver already sits in the slot
+ * where the method expects `this`.
+ */
+static bool invoke(ObjFunction* function, InlineCache* cache, int argCount) {
+    Value receiver = peek(argCount);
+    if (!IS_INSTANCE(receiver)) {
+        runtimeError("Only instances have methods.");
+        return false;
+    }
+
+    ObjInstance* instance = AS_INSTANCE(receiver);
+    CacheEntry* hit = findCacheEntry(cache, instance->shape);
+    CacheEntry entry = hit != NULL ? *hit : resolveInvoke(function, cache, instance);
+
+    if (entry.slot != -1) {
+        // a field holding something callable -> call it like any other value
+        Value field = instance->fields[entry.slot];
+        vm.stackTop[-argCount - 1] = field;
+        return callValue(field, argCount);
+    }
+    if (entry.method == NULL) {
+        runtimeError("Undefined property '%.*s'.", cache->name->length, cache->name->chars);
+        return false;
+    }
+    return callMethod(entry.method, argCount);
+}
+
+
+
+/**
+ * Finds the class whose declaration holds `method`, starting from `klass`.
+ *
+ * Subclasses get copies of inherited methods, so the same function sits in
+ * a run of tables up the chain; the topmost one declared it. Going by the
+ * receiver's chain rather than by the function alone keeps this right when
+ * one class declaration runs several times (in a loop), creating classes
+ * that share their method functions.
+ */
+static ObjClass* definingClass(ObjClass* klass, Obj* method) {
+    ObjString* name = methodFunction(method)->name;
+    ObjClass* found = NULL;
+    for (; klass != NULL; klass = klass->superclass) {
+        Value value;
+        if (tableGet(&klass->methods, name, &value) && AS_OBJ(value) == method) {
+            found = klass;
+        } else if (found != NULL) {
+            break;
+        }
+    }
+    return found;
+}
+
+
+
+/**
+ * What `super.name` in the method `frame` is running means for a receiver
+ * of class `klass`, from `cache`.
+ *
+ * Entries are keyed by the root shape of the receiver's class: the call
+ * site is inside that method, so that class decides the answer.
+ *
+ * @return The method, or NULL (reported) if the superclass has none.
+ */
+static Obj* superMethod(CallFrame* frame, InlineCache* cache, ObjClass* klass) {
+    CacheEntry* hit = findCacheEntry(cache, klass->shape);
+    if (hit != NULL && hit->method != NULL) return hit->method;
+
+    CacheEntry entry = {.shape = klass->shape, .slot = -1};
+    Obj* running = frame->closure != NULL ? (Obj*)frame->closure : (Obj*)frame->function;
+    ObjClass* defining = definingClass(klass, running);
+    Value method;
+    if (defining != NULL && defining->superclass != NULL &&
+        tableGet(&defining->superclass->methods, cache->name, &method)) {
+        entry.method = AS_OBJ(method);
+        fillCache(frame->function, cache, entry);
+        return entry.method;
+    }
+
+    runtimeError("Undefined property '%.*s'.", cache->name->length, cache->name->chars);
+    return NULL;
+}
+
+
+
+// copy-down inheritance: the subclass's own methods overwrite these afterwards
+static void inherit(ObjClass* subclass, ObjClass* superclass) {
+    tableAddAll(&superclass->methods, &subclass->methods);
+    for (int i = 0; i < superclass->methods.capacity; i++) {
+        Entry* entry = &superclass->methods.entries[i];
+        if (entry->key != NULL) writeBarrier((Obj*)subclass, entry->value);
+    }
+    subclass->superclass = superclass;
+    writeBarrier((Obj*)subclass, OBJ_VAL(superclass));
+}
+
+
+
+static void growFields(ObjInstance* instance, int count) {
+    if (count <= instance->fieldCapacity) return;
+
+    int oldCapacity = instance->fieldCapacity;
+    instance->fieldCapacity = GROW_CAPACITY(oldCapacity);
+    instance->fields = GROW_ARRAY(Value, instance->fields, oldCapacity, instance->fieldCapacity);
+}
+
+
+
 static bool isFalsey(Value value) {
     return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
 
+// pop two strings and push their (interned) concatenation
+static void concatenate() {
+    // peek rather than pop: the operands must stay reachable while allocating
+    Value result = concatenateStrings(peek(1), peek(0));
+    pop();
+    pop();
+    push(result);
+}
+
+
 
 
 /**
@@ -113,18 +753,67 @@ static bool isFalsey(Value value) {
  *
  * @return The 32-bit unsigned integer read from the bytecode.
  */
-static uint32_t readLongIndex() {
+static uint32_t readLongIndex(CallFrame* frame) {
     uint32_t index = 0;
-    index |= (uint32_t)(*vm.ip++) << 16;  // Read the first byte (most significant)
-    index |= (uint32_t)(*vm.ip++) << 8;   // Read the second byte
-    index |= (uint32_t)(*vm.ip++);        // Read the third byte (least significant)
+    index |= (uint32_t)(*frame->ip++) << 16;  // Read the first byte (most significant)
+    index |= (uint32_t)(*frame->ip++) << 8;   // Read the second byte
+    index |= (uint32_t)(*frame->ip++);        // Read the third byte (least significant)
     return index;
 }
 
 
+/**
+ * Counts a backward jump of loop number `loop`, just taken.
+ *
+ * The jump that makes the loop hot has the optimizer rewrite its body,
+ * from where `frame` now resumes up to the jump itself, at `backedge`.
+ * The rewrite is in place and keeps every offset, so the frame simply
+ * carries on in the optimized code.
+ */
+static inline void countBackedge(CallFrame* frame, uint8_t loop, uint8_t* backedge) {
+    uint16_t* heat = &frame->function->loopHeat[loop];
+    if (*heat >= HOT_LOOP_THRESHOLD) return;
+
+    if (++*heat == HOT_LOOP_THRESHOLD) {
+        uint8_t* code = frame->function->chunk.code;
+        optimizeLoop(frame->function, (int)(frame->ip - code), (int)(backedge - code));
+    }
+}
+
+
+
+// `a op b` for the operators of OP_LOCALS_BINARY, false unless it stays an int or a bool
+static inline bool integerBinary(uint8_t op, int64_t a, int64_t b, Value* result) {
+    int64_t value;
+    switch (op) {
+        case OP_ADD:
+            if (__builtin_add_overflow(a, b, &value)) return false;
+            break;
+        case OP_SUBTRACT:
+            if (__builtin_sub_overflow(a, b, &value)) return false;
+            break;
+        case OP_MULTIPLY:
+            if (__builtin_mul_overflow(a, b, &value)) return false;
+            break;
+        case OP_LESS:
+            *result = BOOL_VAL(a < b);
+            return true;
+        case OP_GREATER:
+            *result = BOOL_VAL(a > b);
+            return true;
+        default:
+            return false;
+    }
+    *result = INT_VAL(value);
+    return true;
+}
+
+
 
 // Execute bytecode instructions
 static InterpretResult run() {
+    CallFrame* frame = &vm.frames[vm.frameCount - 1];   // the function currently executing
+
     /**
      * @brief Macro to read a constant value from the chunk's constants.
      *
@@ -133,7 +822,11 @@ static InterpretResult run() {
      *
      * @return The constant value from the chunk's constants array.
      */
-    #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+    #define READ_CONSTANT() (frame->function->chunk.constants.values[READ_BYTE()])
+
+    // variable names are stored in the constant table as strings
+    #define READ_STRING()       AS_STRING(READ_CONSTANT())
+    #define READ_STRING_LONG()  AS_STRING(frame->function->chunk.constants.values[readLongIndex(frame)])
 
     
     /**
@@ -147,18 +840,65 @@ static InterpretResult run() {
      */
     #define BINARY_OP(ValueType, op) \
     do { \
-        if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+        if (!IS_ANY_NUMBER(peek(0)) || !IS_ANY_NUMBER(peek(1))) { \
           runtimeError("Operands must be numbers."); \
-          return INTERPRET_RUNTIME_ERROR; \
+          goto throwing; \
+        } \
+        Value b = pop(); \
+        Value a = pop(); \
+        push(ValueType(AS_FLOAT(a) op AS_FLOAT(b))); \
+      } while (false)
+
+    // two ints compare exactly; anything else as doubles
+    #define COMPARISON_OP(op) \
+    do { \
+        if (IS_INT(peek(0)) && IS_INT(peek(1))) { \
+            int64_t b = AS_INT(pop()); \
+            int64_t a = AS_INT(pop()); \
+            push(BOOL_VAL(a op b)); \
+        } else { \
+            BINARY_OP(BOOL_VAL, op); \
+        } \
+      } while (false)
+
+    // fused compare-and-branch: pop both operands, jump if `a op b` is `when`
+    #define COMPARE_JUMP(op, when) \
+    do { \
+        uint16_t offset = READ_SHORT(); \
+        bool result; \
+        if (IS_INT(peek(0)) && IS_INT(peek(1))) { \
+            result = AS_INT(peek(1)) op AS_INT(peek(0)); \
+        } else if (IS_ANY_NUMBER(peek(0)) && IS_ANY_NUMBER(peek(1))) { \
+            result = AS_FLOAT(peek(1)) op AS_FLOAT(peek(0)); \
+        } else { \
+            runtimeError("Operands must be numbers."); \
+            goto throwing; \
+        } \
+        vm.stackTop -= 2; \
+        if (result == when) frame->ip += offset; \
+      } while (false)
+
+    // int op int stays an int unless it overflows, then it's done in doubles
+    #define INTEGER_OP(checked, op) \
+    do { \
+        int64_t result; \
+        if (IS_INT(peek(0)) && IS_INT(peek(1)) && \
+            !checked(AS_INT(peek(1)), AS_INT(peek(0)), &result)) { \
+            pop(); \
+            pop(); \
+            push(INT_VAL(result)); \
+        } else { \
+            BINARY_OP(NUMBER_VAL, op); \
         } \
-        double b = AS_NUMBER(pop()); \
-        double a = AS_NUMBER(pop()); \
-        push(ValueType(a op b)); \
       } while (false)
 
 
     // Read the next byte from the instruction pointer using (*) and advance it
-    #define READ_BYTE() (*vm.ip++)
+    #define READ_BYTE() (*frame->ip++)
+
+    // Read a two-byte (big-endian) jump offset
+    #define READ_SHORT() \
+        (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 
     // Continuously execute instructions
     for (;;) {
@@ -172,13 +912,11 @@ static InterpretResult run() {
             }
             printf("\n");
 
-            printf("[DEBUG] Executing instruction at offset %ld\n", (vm.ip - vm.chunk->code));
-            disassembleInstruction(vm.chunk, (int)(vm.ip - vm.chunk->code));    // calculates the offset of the current ip within the bytecode array
+            printf("[DEBUG] Executing instruction at offset %ld\n", (frame->ip - frame->function->chunk.code));
+            disassembleInstruction(&frame->function->chunk, (int)(frame->ip - frame->function->chunk.code));    // calculates the offset of the current ip within the bytecode array
 
         #endif
 
-        // printf("Executing instruction at offset %d\n", (int)(vm.ip - vm.chunk->code));
-
         uint8_t instruction = READ_BYTE();  // Fetch the next instruction
         switch (instruction) {
             case OP_CONSTANT: {
@@ -189,8 +927,8 @@ static InterpretResult run() {
 
             case OP_CONSTANT_LONG: {
                 // read a 3-byte index and fetch the constant
-                uint32_t index = readLongIndex();
-                Value constant = vm.chunk->constants.values[index];
+                uint32_t index = readLongIndex(frame);
+                Value constant = frame->function->chunk.constants.values[index];
                 push(constant);
                 break;
             }
@@ -202,6 +940,174 @@ static InterpretResult run() {
             
             case OP_FALSE: push(BOOL_VAL(false)); break;
 
+            case OP_POP: pop(); break;
+
+            // locals live in fixed stack slots resolved by the compiler
+            case OP_GET_LOCAL: {
+                uint8_t slot = READ_BYTE();
+                push(frame->slots[slot]);
+                break;
+            }
+
+            case OP_GET_LOCAL_LONG: {
+                uint32_t slot = readLongIndex(frame);
+                push(frame->slots[slot]);
+                break;
+            }
+
+            case OP_SET_LOCAL: {
+                uint8_t slot = READ_BYTE();
+                frame->slots[slot] = peek(0);   // assignment is an expression, leave the value
+                break;
+            }
+
+            case OP_SET_LOCAL_POP: {
+                uint8_t slot = READ_BYTE();
+                frame->slots[slot] = pop();
+                frame->ip++;        // over the POP it stands in for
+                break;
+            }
+
+            case OP_SET_LOCAL_LONG: {
+                uint32_t slot = readLongIndex(frame);
+                frame->slots[slot] = peek(0);
+                break;
+            }
+
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG: {
+                ObjString* name = instruction == OP_GET_GLOBAL ? READ_STRING() : READ_STRING_LONG();
+                Value value;
+                if (!tableGet(&vm.globals, name, &value)) {
+                    runtimeError("Undefined variable '%.*s'.", name->length, name->chars);
+                    goto throwing;
+                }
+                push(value);
+                break;
+            }
+
+            case OP_DEFINE_GLOBAL:
+            case OP_DEFINE_GLOBAL_LONG: {
+                ObjString* name = instruction == OP_DEFINE_GLOBAL ? READ_STRING() : READ_STRING_LONG();
+                tableSet(&vm.globals, name, peek(0));
+                globalsBarrier(OBJ_VAL(name));
+                globalsBarrier(peek(0));
+                pop();      // popped after the insert so the value stays reachable meanwhile
+                break;
+            }
+
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG:
+            case OP_SET_GLOBAL_POP: {
+                ObjString* name = instruction == OP_SET_GLOBAL_LONG ? READ_STRING_LONG() : READ_STRING();
+                // assignment never creates a global; undo the insert and report
+                if (tableSet(&vm.globals, name, peek(0))) {
+                    tableDelete(&vm.globals, name);
+                    runtimeError("Undefined variable '%.*s'.", name->length, name->chars);
+                    goto throwing;
+                }
+                globalsBarrier(peek(0));
+                if (instruction == OP_SET_GLOBAL_POP) {
+                    pop();
+                    frame->ip++;    // over the POP it stands in for
+                }
+                break;      // the assigned value stays on the stack as the expression result
+            }
+
+            case OP_GET_UPVALUE: {
+                uint8_t index = READ_BYTE();
+                push(*captureSlot(&frame->closure->captures[index]));
+                break;
+            }
+
+            case OP_SET_UPVALUE: {
+                // never a flat capture: those are only made of variables nobody assigns
+                Capture* capture = &frame->closure->captures[READ_BYTE()];
+                *captureSlot(capture) = peek(0);
+                if (capture->cell != NULL) writeBarrier((Obj*)capture->cell, peek(0));
+                break;
+            }
+
+            // the parameters of an inlined function are where its caller pushed them
+            case OP_GET_ARGUMENT: {
+                uint8_t distance = READ_BYTE();
+                push(vm.stackTop[-1 - distance]);
+                break;
+            }
+
+            case OP_SET_ARGUMENT: {
+                uint8_t distance = READ_BYTE();
+                vm.stackTop[-1 - distance] = peek(0);
+                break;
+            }
+
+            case OP_GET_PROPERTY: {
+                InlineCache* cache = &frame->function->chunk.caches[READ_SHORT()];
+                if (!IS_INSTANCE(peek(0))) {
+                    runtimeError("Only instances have properties.");
+                    goto throwing;
+                }
+
+                ObjInstance* instance = AS_INSTANCE(peek(0));
+                CacheEntry* entry = findCacheEntry(cache, instance->shape);
+                int slot;
+                if (entry != NULL) {
+                    slot = entry->slot;
+                } else {
+                    slot = shapeSlot(instance->shape, cache->name);
+                    fillCache(frame->function, cache, (CacheEntry){.shape = instance->shape, .slot = slot});
+                }
+
+                if (slot != -1) {
+                    vm.stackTop[-1] = instance->fields[slot];
+                    break;
+                }
+                // not a field -> a method, bound to the instance
+                if (!bindMethod(instance->klass, cache->name)) {
+                    goto throwing;
+                }
+                break;
+            }
+
+            case OP_SET_PROPERTY: {
+                InlineCache* cache = &frame->function->chunk.caches[READ_SHORT()];
+                if (!IS_INSTANCE(peek(1))) {
+                    runtimeError("Only instances have fields.");
+                    goto throwing;
+                }
+
+                ObjInstance* instance = AS_INSTANCE(peek(1));
+                CacheEntry* hit = findCacheEntry(cache, instance->shape);
+                CacheEntry entry = hit != NULL ? *hit : resolveStore(frame->function, cache, instance->shape);
+
+                if (entry.transition != NULL) {
+                    growFields(instance, entry.transition->fieldCount);
+                    instance->fields[entry.slot] = peek(0);
+                    instance->shape = entry.transition;
+                    writeBarrier((Obj*)instance, OBJ_VAL(entry.transition));
+                } else {
+                    instance->fields[entry.slot] = peek(0);
+                }
+                writeBarrier((Obj*)instance, peek(0));
+
+                // the assigned value is the result of the expression
+                Value value = pop();
+                pop();
+                push(value);
+                break;
+            }
+
+            case OP_GET_SUPER: {
+                InlineCache* cache = &frame->function->chunk.caches[READ_SHORT()];
+                Obj* method = superMethod(frame, cache, AS_INSTANCE(peek(0))->klass);
+                if (method == NULL) goto throwing;
+
+                ObjBoundMethod* bound = newBoundMethod(peek(0), method);
+                pop();
+                push(OBJ_VAL(bound));
+                break;
+            }
+
             case OP_EQUAL: {
                 Value b = pop();
                 Value a = pop();
@@ -209,28 +1115,57 @@ static InterpretResult run() {
                 break;
             }
 
-            case OP_GREATER:    BINARY_OP(BOOL_VAL, >); break;
+            case OP_GREATER:    COMPARISON_OP(>); break;
             
-            case OP_LESS:       BINARY_OP(BOOL_VAL, <); break;
+            case OP_LESS:       COMPARISON_OP(<); break;
 
 
             // for binary operations
             case OP_ADD: {
-                BINARY_OP(NUMBER_VAL, +);
+                if (IS_ANY_NUMBER(peek(0)) && IS_ANY_NUMBER(peek(1))) {
+                    INTEGER_OP(__builtin_add_overflow, +);
+                } else if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
+                    concatenate();
+                } else {
+                    runtimeError("Operands must be two numbers or two strings.");
+                    goto throwing;
+                }
+                break;
+            }
+
+            // written by the optimizer over `GET_LOCAL a; GET_LOCAL b (or CONSTANT k); op`
+            case OP_LOCALS_BINARY:
+            case OP_LOCAL_CONSTANT_BINARY: {
+                Value a = frame->slots[frame->ip[0]];
+                Value b = instruction == OP_LOCALS_BINARY
+                              ? frame->slots[frame->ip[2]]
+                              : frame->function->chunk.constants.values[frame->ip[2]];
+                Value result;
+                if (IS_INT(a) && IS_INT(b) && integerBinary(frame->ip[3], AS_INT(a), AS_INT(b), &result)) {
+                    push(result);
+                    frame->ip += 4;
+                    break;
+                }
+
+                // anything else: push both and run the operator that is still in place
+                push(a);
+                push(b);
+                frame->ip += 3;
                 break;
             }
 
             case OP_SUBTRACT: {
-                BINARY_OP(NUMBER_VAL, -);
+                INTEGER_OP(__builtin_sub_overflow, -);
                 break;
             }
 
             case OP_MULTIPLY: {
-                BINARY_OP(NUMBER_VAL, *);
+                INTEGER_OP(__builtin_mul_overflow, *);
                 break;
             }
 
             case OP_DIVIDE: {
+                // always in doubles: 7 / 2 is 3.5
                 BINARY_OP(NUMBER_VAL, /);
                 break;
             }
@@ -242,43 +1177,291 @@ static InterpretResult run() {
 
             // for unary operators
             case OP_NEGATE: {
-                if (!IS_NUMBER(peek(0))) {
+                if (IS_INT(peek(0)) && AS_INT(peek(0)) != INT64_MIN) {
+                    push(INT_VAL(-AS_INT(pop())));
+                    break;
+                }
+                if (!IS_ANY_NUMBER(peek(0))) {
                     runtimeError("Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    goto throwing;
+                }
+                Value operand = pop();
+                push(NUMBER_VAL(-AS_FLOAT(operand)));
+                break;
+            }
+
+            case OP_PRINT: {
+                writeValue(&vm.output, pop());
+                writeOutput(&vm.output, "\n", 1);
+                break;
+            }
+
+            case OP_JUMP: {
+                uint16_t offset = READ_SHORT();
+                frame->ip += offset;
+                break;
+            }
+
+            case OP_JUMP_IF_FALSE: {
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(peek(0))) frame->ip += offset;     // the condition stays on the stack
+                break;
+            }
+
+            case OP_LOOP: {
+                uint8_t* backedge = frame->ip - 1;
+                uint8_t loop = READ_BYTE();
+                uint16_t offset = READ_SHORT();
+                frame->ip -= offset;
+                countBackedge(frame, loop, backedge);
+                break;
+            }
+
+            case OP_FOR_INCR_LT:
+            case OP_FOR_INCR_LT_CONST: {
+                uint8_t* backedge = frame->ip - 1;
+                Value* counter = &frame->slots[READ_BYTE()];
+                uint8_t index = READ_BYTE();
+                uint8_t loop = READ_BYTE();
+                uint16_t offset = READ_SHORT();
+                Value limit = instruction == OP_FOR_INCR_LT
+                                  ? frame->slots[index]
+                                  : frame->function->chunk.constants.values[index];
+
+                if (IS_INT(*counter) && IS_INT(limit) && AS_INT(*counter) < INT64_MAX) {
+                    int64_t next = AS_INT(*counter) + 1;
+                    *counter = INT_VAL(next);
+                    if (next < AS_INT(limit)) {
+                        frame->ip -= offset;
+                        countBackedge(frame, loop, backedge);
+                    }
+                    break;
+                }
+
+                // anything else does exactly what `i = i + 1` and `i < limit` would
+                if (!IS_ANY_NUMBER(*counter)) {
+                    runtimeError("Operands must be two numbers or two strings.");
+                    goto throwing;
+                }
+                if (IS_INT(*counter) && AS_INT(*counter) < INT64_MAX) {
+                    *counter = INT_VAL(AS_INT(*counter) + 1);
+                } else {
+                    *counter = NUMBER_VAL(AS_FLOAT(*counter) + 1);
+                }
+
+                if (!IS_ANY_NUMBER(limit)) {
+                    runtimeError("Operands must be numbers.");
+                    goto throwing;
+                }
+                bool less = IS_INT(*counter) && IS_INT(limit)
+                                ? AS_INT(*counter) < AS_INT(limit)
+                                : AS_FLOAT(*counter) < AS_FLOAT(limit);
+                if (less) {
+                    frame->ip -= offset;
+                    countBackedge(frame, loop, backedge);
+                }
+                break;
+            }
+
+            case OP_JUMP_IF_LESS:        COMPARE_JUMP(<, true); break;
+            case OP_JUMP_IF_NOT_LESS:    COMPARE_JUMP(<, false); break;
+            case OP_JUMP_IF_GREATER:     COMPARE_JUMP(>, true); break;
+            case OP_JUMP_IF_NOT_GREATER: COMPARE_JUMP(>, false); break;
+
+            case OP_JUMP_IF_EQUAL:
+            case OP_JUMP_IF_NOT_EQUAL: {
+                uint16_t offset = READ_SHORT();
+                bool equal = valuesEqual(peek(1), peek(0));
+                vm.stackTop -= 2;
+                if (equal == (instruction == OP_JUMP_IF_EQUAL)) frame->ip += offset;
+                break;
+            }
+
+            case OP_INLINE_GUARD: {
+                int argCount = READ_BYTE();
+                Value expected = frame->function->chunk.constants.values[readLongIndex(frame)];
+                uint16_t offset = READ_SHORT();
+                Value callee = peek(argCount);
+                if (IS_OBJ(callee) && AS_OBJ(callee) == AS_OBJ(expected)) break;   // run the body
+
+                // the variable holds something else now: call that, returning past the body
+                frame->ip += offset;
+                if (!callValue(callee, argCount)) {
+                    goto throwing;
+                }
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+
+            case OP_INLINE_RETURN: {
+                int argCount = READ_BYTE();
+                vm.stackTop[-argCount - 2] = vm.stackTop[-1];
+                vm.stackTop -= argCount + 1;
+                break;
+            }
+
+            case OP_CALL: {
+                int argCount = READ_BYTE();
+                if (!callValue(peek(argCount), argCount)) {
+                    goto throwing;
+                }
+                frame = &vm.frames[vm.frameCount - 1];      // continue in the callee
+                break;
+            }
+
+            case OP_INVOKE: {
+                InlineCache* cache = &frame->function->chunk.caches[READ_SHORT()];
+                int argCount = READ_BYTE();
+                if (!invoke(frame->function, cache, argCount)) {
+                    goto throwing;
+                }
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+
+            case OP_SUPER_INVOKE: {
+                InlineCache* cache = &frame->function->chunk.caches[READ_SHORT()];
+                int argCount = READ_BYTE();
+                // the receiver is `this`, so always an instance
+                ObjClass* klass = AS_INSTANCE(peek(argCount))->klass;
+                Obj* method = superMethod(frame, cache, klass);
+                if (method == NULL || !callMethod(method, argCount)) {
+                    goto throwing;
                 }
-                push(NUMBER_VAL(-AS_NUMBER(pop())));
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+
+            case OP_TAIL_CALL: {
+                int argCount = READ_BYTE();
+                if (!tailCall(frame, peek(argCount), argCount)) {
+                    goto throwing;
+                }
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
+            }
+
+            case OP_CLOSURE:
+            case OP_CLOSURE_LONG: {
+                Value constant = instruction == OP_CLOSURE
+                                     ? READ_CONSTANT()
+                                     : frame->function->chunk.constants.values[readLongIndex(frame)];
+                ObjClosure* closure = newClosure(AS_FUNCTION(constant));
+                push(OBJ_VAL(closure));
+                captureVariables(frame, closure);
+                break;
+            }
+
+            case OP_CLOSE_UPVALUE:
+                closeUpvalues(vm.stackTop - 1);
+                pop();
+                break;
+
+            case OP_CLASS:
+            case OP_CLASS_LONG: {
+                ObjString* name = instruction == OP_CLASS ? READ_STRING() : READ_STRING_LONG();
+                push(OBJ_VAL(newClass(name)));
                 break;
             }
 
+            case OP_METHOD:
+            case OP_METHOD_LONG:
+                defineMethod(instruction == OP_METHOD ? READ_STRING() : READ_STRING_LONG());
+                break;
+
+            case OP_INHERIT: {
+                if (!IS_CLASS(peek(1))) {
+                    runtimeError("Superclass must be a class.");
+                    goto throwing;
+                }
+                inherit(AS_CLASS(peek(0)), AS_CLASS(peek(1)));
+                pop();
+                pop();
+                break;
+            }
+
+            case OP_THROW:
+                goto throwing;      // the value stays on top of the stack
+
             case OP_RETURN: {
-                // printValue(pop());
-                printf("\n");
-                return INTERPRET_OK;  
+                Value result = pop();
+                if (vm.openUpvalues != NULL) closeUpvalues(frame->slots);     // usually none
+                vm.frameCount--;
+                if (vm.frameCount == 0) {
+                    // returning from the top-level script -> exit interpreter
+                    pop();
+                    return INTERPRET_OK;
+                }
+
+                // discard the callee's window and hand the result to the caller
+                vm.stackTop = frame->slots;
+                push(result);
+                frame = &vm.frames[vm.frameCount - 1];
+                break;
             }  
         }
+        continue;
+
+    throwing:
+        // the instruction raised an exception: carry on in its handler
+        if (!catchException()) return INTERPRET_RUNTIME_ERROR;
+        frame = &vm.frames[vm.frameCount - 1];
     }
 
     // Clean up the macro
     #undef READ_BYTE  
+    #undef READ_SHORT
     #undef READ_CONSTANT
+    #undef READ_STRING
+    #undef READ_STRING_LONG
     #undef BINARY_OP
+    #undef COMPARISON_OP
+    #undef COMPARE_JUMP
+    #undef INTEGER_OP
 }
 
-// Interpret a chunk of bytecode
+/**
+ * @brief Compiles and runs a piece of source code.
+ *
+ * String constants keep pointing into `source`, so it must stay valid
+ * until it is passed to releaseSource() or the VM is freed.
+ *
+ * A stack overflow surfaces here: the SIGSEGV handler jumps back to the
+ * sigsetjmp() below when either stack runs into its guard page.
+ */
 InterpretResult interpret(const char* source) {
-    Chunk chunk;
-    initChunk(&chunk);
+    ObjFunction* function = compile(source);
+    if (function == NULL) return INTERPRET_COMPILE_ERROR;
 
-    if (!compile(source, &chunk)) {
-        freeChunk(&chunk);
-        return INTERPRET_COMPILE_ERROR;
-    }
+    push(OBJ_VAL(function));
+    call(function, 0);
 
-    vm.chunk = &chunk;          // loading the compiled chunk to vm
-    vm.ip = vm.chunk->code;     // set the ip to the start of bytecode
+    if (sigsetjmp(overflowJump, 1) != 0) {
+        overflowArmed = 0;
+        runtimeError("Stack overflow.");
+        reportException();      // the stacks may be half updated: not catchable
+        return INTERPRET_RUNTIME_ERROR;
+    }
 
+    overflowArmed = 1;
     InterpretResult result = run();
+    overflowArmed = 0;
 
-    freeChunk(&chunk);
+    flushOutput(&vm.output);
     return result;
-}
\ No newline at end of file
+}
+
+
+
+/**
+ * @brief Lets the VM stop referring to a source passed to interpret().
+ *
+ * Constants that are still alive and point into `source` get their own
+ * copy of their characters, and so do function bodies not compiled yet.
+ * Afterwards the caller may free or reuse it.
+ */
+void releaseSource(const char* source) {
+    const char* end = source + strlen(source);
+    copySourceStrings(source, end);
+    copyLazySources(source, end);
+}
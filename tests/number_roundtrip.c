@@ -0,0 +1,117 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./include/number.h"
+#include "./include/scanner.h"
+
+// Checks that formatNumber() output reads back as the same double, and
+// that number literals scanned by the scanner agree with strtod().
+// Build: gcc -I. tests/number_roundtrip.c src/scanner.c src/number.c -lm -o tests/output/number_roundtrip
+
+static int failures = 0;
+
+static void check(double value) {
+    char text[NUMBER_BUFFER_SIZE + 1];
+    int length = formatNumber(value, text);
+    text[length] = '\0';
+
+    double back = strtod(text, NULL);
+    if (memcmp(&back, &value, sizeof(double)) != 0) {
+        printf("%.17g -> \"%s\" -> %.17g\n", value, text, back);
+        failures++;
+    }
+}
+
+static void expect(double value, const char* expected) {
+    char text[NUMBER_BUFFER_SIZE + 1];
+    int length = formatNumber(value, text);
+    text[length] = '\0';
+
+    if (strcmp(text, expected) != 0) {
+        printf("%.17g -> \"%s\", expected \"%s\"\n", value, text, expected);
+        failures++;
+    }
+}
+
+static void checkLiteral(const char* text) {
+    double expected = strtod(text, NULL);
+
+    // through the scanner, as a literal in a script would be
+    initScanner(text);
+    Token token = scanToken();
+    if (token.type != TOKEN_NUMBER || token.length != (int)strlen(text)) {
+        printf("\"%s\" didn't scan as one number\n", text);
+        failures++;
+        return;
+    }
+
+    double parsed = token.number;
+    if (memcmp(&parsed, &expected, sizeof(double)) != 0) {
+        printf("\"%s\" -> %.17g, expected %.17g\n", text, parsed, expected);
+        failures++;
+    }
+}
+
+int main() {
+    // Shortest output and layout
+    expect(0.0, "0");
+    expect(-0.0, "-0");
+    expect(42.0, "42");
+    expect(-7.0, "-7");
+    expect(0.1, "0.1");
+    expect(0.1 + 0.2, "0.30000000000000004");
+    expect(3.5, "3.5");
+    expect(1.0 / 3.0, "0.3333333333333333");
+    expect(123456789012.5, "123456789012.5");
+    expect(1e20, "100000000000000000000");
+    expect(1e21, "1e+21");
+    expect(1.5e300, "1.5e+300");
+    expect(0.000001, "0.000001");
+    expect(1e-7, "1e-7");
+    expect(5e-324, "5e-324");
+    expect(1.7976931348623157e308, "1.7976931348623157e+308");
+    expect(9007199254740993.0, "9007199254740992");
+
+    // Round trips: every power of two, and random bit patterns
+    for (int e = -1074; e <= 1023; e++) check(ldexp(1.0, e));
+
+    srand(1);
+    for (int i = 0; i < 1000000; i++) {
+        unsigned long long bits = 0;
+        for (int j = 0; j < 4; j++) bits = (bits << 16) ^ (unsigned long long)(rand() & 0xFFFF);
+
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        if (value != value || value - value != 0) continue;     // NaN, infinity
+        check(value);
+    }
+
+    // Literals: short and long, with up to 40 digits on either side
+    checkLiteral("0");
+    checkLiteral("0.0");
+    checkLiteral("9007199254740993");
+    checkLiteral("0.30000000000000004");
+    checkLiteral("123456789012345678901234567890");
+    checkLiteral("0.000000000000000000000000000000000000001");
+    checkLiteral("179769313486231570000000000000000000000000000000000000000000000000000");
+    for (int i = 0; i < 1000000; i++) {
+        char text[96];
+        int length = 0;
+        int whole = rand() % 24, fractional = rand() % 24;
+        if (rand() % 4 == 0) whole += rand() % 20;
+        if (rand() % 4 == 0) fractional += rand() % 20;
+
+        text[length++] = (char)('0' + rand() % 10);
+        for (int j = 0; j < whole; j++) text[length++] = (char)('0' + rand() % 10);
+        if (fractional > 0) {
+            text[length++] = '.';
+            for (int j = 0; j < fractional; j++) text[length++] = (char)('0' + rand() % 10);
+        }
+        text[length] = '\0';
+        checkLiteral(text);
+    }
+
+    printf(failures == 0 ? "All tests passed.\n" : "%d failures.\n", failures);
+    return failures != 0;
+}